@@ -0,0 +1,139 @@
+#ifndef DERIVATIVES_H
+#define DERIVATIVES_H
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "EXPRESSION.h"
+
+namespace ExpressionLibrary {
+
+    // Values, Jacobian and Hessians of a vector of functions compiled into a
+    // single multi-output program. All derivatives are built through one
+    // simplifying NodeFactory with one memoized Differentiation per
+    // variable, so a subexpression shared by several functions or
+    // derivatives is created, and then computed, once. Hessians are built
+    // for j >= i only and mirrored. Derivatives follow the rules of
+    // differentiate(variable, true).
+    template <typename T>
+    class DerivativeProgram {
+    public:
+        // variables fixes the differentiation variables and the order of
+        // values passed to evaluate; it must cover every variable the
+        // functions use. order is 1 (values and Jacobian) or 2 (and Hessians).
+        DerivativeProgram(const std::vector<Expression<T>>& functions, std::vector<std::string> variables, unsigned order = 2)
+            : names(std::move(variables)), count(functions.size()), degree(order) {
+            if (count == 0) {
+                throw std::invalid_argument("Expected at least one function");
+            }
+            if (order < 1 || order > 2) {
+                throw std::invalid_argument("Derivative order must be 1 or 2");
+            }
+            build(functions);
+        }
+
+        DerivativeProgram(const Expression<T>& function, std::vector<std::string> variables, unsigned order = 2)
+            : DerivativeProgram(std::vector<Expression<T>>{function}, std::move(variables), order) {}
+
+        // value receives the functions()' values; jacobian the row-major
+        // functions() x variables() matrix; hessian, for order 2, one
+        // variables() x variables() matrix per function, back to back.
+        // Spans may be empty to skip an output.
+        void evaluate(std::span<const T> values, std::span<T> value, std::span<T> jacobian, std::span<T> hessian = {}) const {
+            if (values.size() < names.size()) {
+                throw std::invalid_argument("Expected " + std::to_string(names.size()) + " values");
+            }
+            const std::size_t n = names.size();
+            check(value, count, "value");
+            check(jacobian, count * n, "jacobian");
+            if (!hessian.empty() && degree < 2) {
+                throw std::invalid_argument("Hessians need a second order program");
+            }
+            check(hessian, count * n * n, "hessian");
+
+            thread_local std::vector<T> registers;
+            if (registers.size() < code.registers()) {
+                registers.resize(code.registers());
+            }
+            const T* r = registers.data();
+            code.run(values.data(), registers.data());
+
+            const std::uint32_t* out = outputs.data();
+            for (std::size_t f = 0; f < count; ++f) {
+                if (!value.empty()) value[f] = r[*out];
+                ++out;
+                for (std::size_t i = 0; i < n; ++i, ++out) {
+                    if (!jacobian.empty()) jacobian[f * n + i] = r[*out];
+                }
+                if (degree < 2) continue;
+                for (std::size_t i = 0; i < n; ++i) {
+                    for (std::size_t j = i; j < n; ++j, ++out) {
+                        if (!hessian.empty()) {
+                            hessian[(f * n + i) * n + j] = r[*out];
+                            hessian[(f * n + j) * n + i] = r[*out];
+                        }
+                    }
+                }
+            }
+        }
+
+        std::size_t functions() const { return count; }
+        const std::vector<std::string>& variables() const { return names; }
+        unsigned order() const { return degree; }
+
+        // The underlying program; its result register holds the last output.
+        const Program<T>& program() const { return code; }
+
+    private:
+        std::vector<std::string> names;
+        std::size_t count;
+        unsigned degree;
+        Program<T> code;
+        // Per function: value, n gradient entries, then the upper Hessian
+        // triangle row by row.
+        std::vector<std::uint32_t> outputs;
+
+        static void check(std::span<T> out, std::size_t size, const char* name) {
+            if (!out.empty() && out.size() < size) {
+                throw std::invalid_argument(std::string("Expected ") + std::to_string(size) + " " + name + " entries");
+            }
+        }
+
+        void build(const std::vector<Expression<T>>& functions) {
+            NodeFactory<T> factory(true);
+            std::vector<Differentiation<T>> d;
+            d.reserve(names.size());
+            for (const auto& name : names) {
+                d.emplace_back(factory, name);
+            }
+            std::vector<std::shared_ptr<Node<T>>> roots;
+            for (const auto& function : functions) {
+                auto f = factory.intern(function.root);
+                roots.push_back(f);
+                std::size_t first = roots.size();
+                for (auto& di : d) {
+                    roots.push_back(di(f));
+                }
+                if (degree < 2) continue;
+                for (std::size_t i = 0; i < names.size(); ++i) {
+                    for (std::size_t j = i; j < names.size(); ++j) {
+                        roots.push_back(d[j](roots[first + i]));
+                    }
+                }
+            }
+            std::vector<const Node<T>*> pointers;
+            pointers.reserve(roots.size());
+            for (const auto& root : roots) {
+                pointers.push_back(root.get());
+            }
+            Program<T> compiled = Program<T>::compile(std::span<const Node<T>* const>(pointers), outputs);
+            code = compiled.variables() == names ? std::move(compiled) : compiled.bind(names);
+        }
+    };
+
+}
+
+#endif // DERIVATIVES_H
@@ -1,6 +1,8 @@
 #include "EXPRESSION.h"
 #include "NODE.h"
 #include <complex>
+#include <tuple>
+#include <unordered_map>
 
 namespace ExpressionLibrary {
 
@@ -11,73 +13,80 @@ namespace ExpressionLibrary {
     Expression<T>::Expression(const std::string& variable) : root(std::make_shared<VarNode<T>>(variable)) {}
 
     template <typename T>
-    Expression<T>::Expression(std::shared_ptr<Node<T>> node) : root(node) {}
+    Expression<T>::Expression(std::shared_ptr<Node<T>> node, std::shared_ptr<NodeArena> arena)
+        : root(node), arena(std::move(arena)) {}
 
     template <typename T>
-    Expression<T>::Expression(const Expression& other) : root(other.root->clone()) {}
+    Expression<T>::Expression(const Expression& other)
+        : root(other.root), arena(other.arena), program(other.program.load()) {}
 
     template <typename T>
-    Expression<T>::Expression(Expression&& other) noexcept : root(std::move(other.root)) {}
+    Expression<T>::Expression(Expression&& other) noexcept
+        : root(std::move(other.root)), arena(std::move(other.arena)), program(other.program.exchange(nullptr)) {}
 
     template <typename T>
     Expression<T>& Expression<T>::operator=(const Expression& other) {
         if (this != &other) {
-            root = other.root->clone();
+            root = other.root;
+            arena = other.arena;
+            program = other.program.load();
         }
         return *this;
     }
 
     template <typename T>
-    Expression<T>& Expression<T>::operator=(const Expression&& other) noexcept {
+    Expression<T>& Expression<T>::operator=(Expression&& other) noexcept {
         if (this != &other) {
             root = std::move(other.root);
+            arena = std::move(other.arena);
+            program = other.program.exchange(nullptr);
         }
         return *this;
     }
 
     template <typename T>
     Expression<T> Expression<T>::operator+(const Expression& other) const {
-        return Expression(std::make_shared<AddNode<T>>(root, other.root));
+        return Expression(std::make_shared<AddNode<T>>(root, other.root), arena);
     }
 
     template <typename T>
     Expression<T> Expression<T>::operator-(const Expression& other) const {
-        return Expression(std::make_shared<SubtractNode<T>>(root, other.root));
+        return Expression(std::make_shared<SubtractNode<T>>(root, other.root), arena);
     }
 
     template <typename T>
     Expression<T> Expression<T>::operator*(const Expression& other) const {
-        return Expression(std::make_shared<MultiplyNode<T>>(root, other.root));
+        return Expression(std::make_shared<MultiplyNode<T>>(root, other.root), arena);
     }
 
     template <typename T>
     Expression<T> Expression<T>::operator/(const Expression& other) const {
-        return Expression(std::make_shared<DivideNode<T>>(root, other.root));
+        return Expression(std::make_shared<DivideNode<T>>(root, other.root), arena);
     }
 
     template <typename T>
     Expression<T> Expression<T>::operator^(const Expression& other) const {
-        return Expression(std::make_shared<PowerNode<T>>(root, other.root));
+        return Expression(std::make_shared<PowerNode<T>>(root, other.root), arena);
     }
 
     template <typename T>
     Expression<T> Expression<T>::sin() const {
-        return Expression(std::make_shared<SinNode<T>>(root));
+        return Expression(std::make_shared<SinNode<T>>(root), arena);
     }
 
     template <typename T>
     Expression<T> Expression<T>::cos() const {
-        return Expression(std::make_shared<CosNode<T>>(root));
+        return Expression(std::make_shared<CosNode<T>>(root), arena);
     }
 
     template <typename T>
     Expression<T> Expression<T>::ln() const {
-        return Expression(std::make_shared<LnNode<T>>(root));
+        return Expression(std::make_shared<LnNode<T>>(root), arena);
     }
 
     template <typename T>
     Expression<T> Expression<T>::exp() const {
-        return Expression(std::make_shared<ExpNode<T>>(root));
+        return Expression(std::make_shared<ExpNode<T>>(root), arena);
     }
 
     template <typename T>
@@ -85,21 +94,174 @@ namespace ExpressionLibrary {
         return root->to_string();
     }
 
+    // Walks the distinct node objects once, bottom-up. Structural ids are
+    // assigned from kind, operand ids and payload, comparing constants
+    // bitwise as NodeFactory does.
     template <typename T>
-    Expression<T> Expression<T>::substitute(const std::string& variable, T value) const {
-        return Expression(root->substitute(variable, value));
+    ExpressionStats Expression<T>::stats() const {
+        struct Info {
+            std::uint64_t nodes;
+            std::size_t depth;
+            std::size_t id;
+        };
+        std::unordered_map<const Node<T>*, Info> info;
+        std::map<std::tuple<NodeKind, std::size_t, std::size_t, std::string>, std::size_t> ids;
+        ExpressionStats stats;
+        std::vector<std::pair<const Node<T>*, bool>> stack{{root.get(), false}};
+        while (!stack.empty()) {
+            auto [node, expanded] = stack.back();
+            stack.pop_back();
+            if (info.count(node)) {
+                continue;
+            }
+            if (!expanded && node->arity() > 0) {
+                stack.push_back({node, true});
+                for (std::size_t i = 0; i < node->arity(); ++i) {
+                    stack.push_back({node->operand(i).get(), false});
+                }
+                continue;
+            }
+            Info entry{1, 1, 0};
+            std::size_t operands[2] = {0, 0};
+            for (std::size_t i = 0; i < node->arity(); ++i) {
+                const Info& operand = info.at(node->operand(i).get());
+                entry.nodes = operand.nodes > std::numeric_limits<std::uint64_t>::max() - entry.nodes
+                    ? std::numeric_limits<std::uint64_t>::max() : entry.nodes + operand.nodes;
+                entry.depth = std::max(entry.depth, operand.depth + 1);
+                operands[i] = operand.id + 1;
+            }
+            std::string payload;
+            std::size_t bytes = 0;
+            switch (node->kind()) {
+                case NodeKind::Const: {
+                    const T& value = static_cast<const ConstNode<T>*>(node)->value;
+                    payload.assign(reinterpret_cast<const char*>(&value), sizeof(T));
+                    bytes = sizeof(ConstNode<T>);
+                    break;
+                }
+                case NodeKind::Var: {
+                    const std::string& name = static_cast<const VarNode<T>*>(node)->name;
+                    payload = name;
+                    stats.variables.insert(name);
+                    bytes = sizeof(VarNode<T>) + (name.capacity() > std::string().capacity() ? name.capacity() + 1 : 0);
+                    break;
+                }
+                case NodeKind::Add:      bytes = sizeof(AddNode<T>); break;
+                case NodeKind::Subtract: bytes = sizeof(SubtractNode<T>); break;
+                case NodeKind::Multiply: bytes = sizeof(MultiplyNode<T>); break;
+                case NodeKind::Divide:   bytes = sizeof(DivideNode<T>); break;
+                case NodeKind::Power:    bytes = sizeof(PowerNode<T>); break;
+                case NodeKind::Sin:      bytes = sizeof(SinNode<T>); break;
+                case NodeKind::Cos:      bytes = sizeof(CosNode<T>); break;
+                case NodeKind::Ln:       bytes = sizeof(LnNode<T>); break;
+                case NodeKind::Exp:      bytes = sizeof(ExpNode<T>); break;
+                case NodeKind::Negate:   bytes = sizeof(NegateNode<T>); break;
+            }
+            // Plus the shared_ptr control block: a vtable pointer and two counts.
+            stats.bytes += bytes + 2 * sizeof(void*);
+            entry.id = ids.emplace(std::make_tuple(node->kind(), operands[0], operands[1], std::move(payload)),
+                                   ids.size()).first->second;
+            info.emplace(node, entry);
+        }
+        const Info& top = info.at(root.get());
+        stats.nodes = top.nodes;
+        stats.depth = top.depth;
+        stats.uniqueNodes = ids.size();
+        return stats;
+    }
+
+    template <typename T>
+    Expression<T> Expression<T>::substitute(const std::string& variable, T value, NodeLimits limits) const {
+        NodeFactory<T> factory(false, arena, limits);
+        return Expression(factory.substitute(root, variable, value), arena);
     }
 
     template <typename T>
     T Expression<T>::evaluate(const std::map<std::string, T>& variables) const {
+        return compiled().evaluate(variables);
+    }
+
+    template <typename T>
+    T Expression<T>::evaluate_tree(const std::map<std::string, T>& variables) const {
         return root->evaluate(variables);
     }
 
     template <typename T>
-    Expression<T> Expression<T>::differentiate(const std::string& variable) const {
-        return Expression(root->differentiate(variable));
+    std::pair<T, std::map<std::string, T>> Expression<T>::evaluate_with_gradient(const std::map<std::string, T>& variables) const {
+        return compiled().evaluate_with_gradient(variables);
+    }
+
+    template <typename T>
+    std::pair<T, T> Expression<T>::evaluate_with_tangent(const std::map<std::string, T>& variables,
+                                                         const std::map<std::string, T>& direction) const {
+        return compiled().evaluate_with_tangent(variables, direction);
+    }
+
+    template <typename T>
+    Expression<T> Expression<T>::differentiate(const std::string& variable, bool simplify, NodeLimits limits) const {
+        NodeFactory<T> factory(simplify, arena);
+        std::shared_ptr<Node<T>> input = factory.intern(root);
+        factory.restrict(limits);
+        factory.checkDepth(input);
+        Differentiation<T> d(factory, variable);
+        return Expression(d(input), arena);
+    }
+
+    template <typename T>
+    Expression<T> Expression<T>::simplify() const {
+        NodeFactory<T> factory(true, arena);
+        return Expression(factory.intern(root), arena);
+    }
+
+    template <typename T>
+    Expression<T> Expression<T>::intern() const {
+        NodeFactory<T> factory(false, arena);
+        return Expression(factory.intern(root), arena);
+    }
+
+    // Threads racing on the first call may each compile; one result wins
+    // and the programs are identical.
+    template <typename T>
+    const Program<T>& Expression<T>::compiled() const {
+        std::shared_ptr<const Program<T>> current = program.load(std::memory_order_acquire);
+        if (!current) {
+            auto fresh = std::make_shared<const Program<T>>(Program<T>::compile(*root));
+            if (program.compare_exchange_strong(current, fresh, std::memory_order_acq_rel)) {
+                current = std::move(fresh);
+            }
+        }
+        return *current;
+    }
+
+    template <typename T>
+    Program<T> Expression<T>::compile() const {
+        return compiled();
+    }
+
+    template <typename T>
+    Program<T> Expression<T>::bind(const std::vector<std::string>& variables) const {
+        return compiled().bind(variables);
+    }
+
+    template <typename T>
+    void Expression<T>::evaluate_batch(const std::vector<std::string>& variables,
+                                       std::span<const T* const> columns, std::span<T> out) const {
+        bind(variables).evaluate_batch(columns, out);
+    }
+
+    template <typename T>
+    void Expression<T>::evaluate_parallel(const std::vector<std::string>& variables,
+                                          std::span<const T* const> columns, std::span<T> out,
+                                          ThreadPool& pool, std::size_t chunkRows) const {
+        bind(variables).evaluate_parallel(columns, out, pool, chunkRows);
+    }
+
+    template <typename T>
+    JitFunction Expression<T>::jit(const std::vector<std::string>& variables) const requires std::same_as<T, double> {
+        return JitFunction(bind(variables));
     }
 
+    template class Expression<float>;
     template class Expression<double>;
     template class Expression<std::complex<double>>;
 
@@ -3,26 +3,82 @@
 
 #include <cmath>
 #include <algorithm>
+#include <atomic>
 #include <string>
 #include <map>
+#include <set>
+#include <cstdint>
 #include <memory>
 #include <stdexcept>
 #include <cctype>
+#include <charconv>
+#include <limits>
+#include <string_view>
+#include <span>
 #include <vector>
 #include <complex>
+#include <concepts>
 #include "NODE.h"
+#include "PROGRAM.h"
+#include "JIT.h"
 
 namespace ExpressionLibrary{
 
     template <typename T>
     struct Node;
 
+    template <typename T> class FormulaWriter;
+    template <typename T> class FormulaFile;
+    template <typename T> class DerivativeProgram;
+    template <typename T> class EvaluationProfile;
+    template <typename T> class ParseCache;
+
+    // maxDepth bounds the open parentheses, function calls, '^' operators
+    // and unary minuses waiting for their operand at any point; maxLength
+    // bounds the input size in characters; nodes bounds the parsed tree
+    // itself, so a long flat sum is refused too. By default the tree is
+    // kept as shallow as maxDepth: ToString, tree evaluation and node
+    // destruction all recurse once per level.
+    struct ParseLimits {
+        std::size_t maxDepth = 10000;
+        std::size_t maxLength = std::numeric_limits<std::size_t>::max();
+        NodeLimits nodes;
+    };
+
+    // Size and shape of an expression. nodes counts a shared subtree once
+    // per use, as evaluate visits it, and saturates; uniqueNodes counts
+    // structurally distinct subtrees; bytes approximates the memory held by
+    // the node objects actually allocated.
+    struct ExpressionStats {
+        std::uint64_t nodes = 0;
+        std::size_t uniqueNodes = 0;
+        std::size_t depth = 0;
+        std::set<std::string> variables;
+        std::size_t bytes = 0;
+    };
+
+    // Expressions share their immutable node graphs, so copies only bump a
+    // reference count and every transformation returns a new root that
+    // reuses the unchanged subtrees of its input. Const members, evaluate
+    // included, may run concurrently on one expression or on expressions
+    // sharing nodes.
     template <typename T>
     class Expression{
     private:
         std::shared_ptr<Node<T>> root;
+        std::shared_ptr<NodeArena> arena;
+        // Compiled on first use by the evaluate family and shared by copies.
+        mutable std::atomic<std::shared_ptr<const Program<T>>> program;
 
-        Expression(std::shared_ptr<Node<T>> node);
+        Expression(std::shared_ptr<Node<T>> node, std::shared_ptr<NodeArena> arena = nullptr);
+
+        const Program<T>& compiled() const;
+
+        friend class FormulaWriter<T>;
+        friend class FormulaFile<T>;
+        friend class DerivativeProgram<T>;
+        friend class EvaluationProfile<T>;
+        friend class ParseCache<T>;
         
     public:
         Expression(T value);
@@ -32,7 +88,7 @@ namespace ExpressionLibrary{
         Expression(Expression&& other) noexcept;
 
         Expression& operator=(const Expression& other);
-        Expression& operator=(const Expression&& other) noexcept;
+        Expression& operator=(Expression&& other) noexcept;
 
 
         Expression operator+(const Expression& other) const;
@@ -47,14 +103,47 @@ namespace ExpressionLibrary{
         Expression exp() const;
 
         std::string ToString() const;
+        ExpressionStats stats() const;
 
-        Expression substitute(const std::string& variable, T value) const;
+        // limits as for differentiate.
+        Expression substitute(const std::string& variable, T value, NodeLimits limits = {}) const;
 
+        // Runs the expression's compiled program, built on the first call, so
+        // each distinct node is computed once however often it is shared.
+        // The span overloads of Program skip the map lookups and allocate
+        // nothing once their thread's workspace is sized.
         T evaluate(const std::map<std::string, T>& variables) const;
-
-        Expression differentiate(const std::string& variable) const;
+        // Walks the node graph recursively, once per path, without compiling:
+        // the reference the compiled paths are checked against.
+        T evaluate_tree(const std::map<std::string, T>& variables) const;
+        std::pair<T, std::map<std::string, T>> evaluate_with_gradient(const std::map<std::string, T>& variables) const;
+        std::pair<T, T> evaluate_with_tangent(const std::map<std::string, T>& variables,
+                                              const std::map<std::string, T>& direction) const;
+
+        // limits bounds the nodes created for the result and its depth; going
+        // over throws std::runtime_error instead of growing the graph further.
+        // differentiate does not count the input's own nodes, even when
+        // simplify rebuilds them, but refuses an input deeper than maxDepth.
+        Expression differentiate(const std::string& variable, bool simplify = false, NodeLimits limits = {}) const;
+        Expression simplify() const;
+        Expression intern() const;
+
+        Program<T> compile() const;
+        Program<T> bind(const std::vector<std::string>& variables) const;
+
+        void evaluate_batch(const std::vector<std::string>& variables,
+                            std::span<const T* const> columns, std::span<T> out) const;
+        void evaluate_parallel(const std::vector<std::string>& variables,
+                               std::span<const T* const> columns, std::span<T> out,
+                               ThreadPool& pool, std::size_t chunkRows = Program<T>::DefaultChunkRows) const;
+
+        // Native code for bind(variables); see JitFunction.
+        JitFunction jit(const std::vector<std::string>& variables) const requires std::same_as<T, double>;
         
-        static Expression Parse(const std::string& s);
+        // With an arena, the parsed nodes and every node later created by
+        // differentiate, substitute, simplify and intern on the result are
+        // allocated from it.
+        static Expression Parse(std::string_view s, std::shared_ptr<NodeArena> arena = nullptr, ParseLimits limits = {});
     };
 
     enum class TokenType {
@@ -67,206 +156,337 @@ namespace ExpressionLibrary{
         End
     };
 
+    enum class OperatorType {
+        Add,
+        Subtract,
+        Multiply,
+        Divide,
+        Power
+    };
+
+    enum class FunctionType {
+        Sin,
+        Cos,
+        Ln,
+        Exp,
+        Unknown
+    };
+
+    // text views the lexer's input; number, op and function are only
+    // meaningful for the matching token type.
     struct Token {
         TokenType type;
-        std::string value;
+        std::string_view text;
+        double number = 0.0;
+        OperatorType op = OperatorType::Add;
+        FunctionType function = FunctionType::Unknown;
     };
 
+    // Tokenizes a view of the caller's input without allocating; the input
+    // must outlive the lexer and its tokens.
     class Lexer {
     private:
-        std::string input;
+        std::string_view input;
         size_t pos;
 
         char currentChar() const {
             return (pos < input.size()) ? input[pos] : '\0';
         }
 
-        void advance() {
-            if (pos < input.size()) ++pos;
-        }
-
         void skipWhitespace() {
-            while (std::isspace(currentChar())) advance();
+            while (std::isspace(static_cast<unsigned char>(currentChar()))) ++pos;
         }
 
-        std::string readNumber() {
-            std::string result;
+        std::string_view readNumber() {
+            size_t start = pos;
             bool hasDecimal = false;
-            while (std::isdigit(currentChar()) || currentChar() == '.') {
+            while (std::isdigit(static_cast<unsigned char>(currentChar())) || currentChar() == '.') {
                 if (currentChar() == '.') {
                     if (hasDecimal) break;
                     hasDecimal = true;
                 }
-                result += currentChar();
-                advance();
+                ++pos;
             }
-            return result;
+            return input.substr(start, pos - start);
         }
 
-        std::string readIdentifier() {
-            std::string result;
-            while (std::isalnum(currentChar()) || currentChar() == '_') {
-                result += currentChar();
-                advance();
-            }
-            return result;
+        std::string_view readIdentifier() {
+            size_t start = pos;
+            while (std::isalnum(static_cast<unsigned char>(currentChar())) || currentChar() == '_') ++pos;
+            return input.substr(start, pos - start);
+        }
+
+        static FunctionType function(std::string_view name) {
+            if (name == "sin") return FunctionType::Sin;
+            if (name == "cos") return FunctionType::Cos;
+            if (name == "ln") return FunctionType::Ln;
+            if (name == "exp") return FunctionType::Exp;
+            return FunctionType::Unknown;
         }
 
     public:
-        Lexer(const std::string& input) : input(input), pos(0) {}
+        Lexer(std::string_view input) : input(input), pos(0) {}
 
         Token nextToken() {
             skipWhitespace();
-            if (pos >= input.size()) return {TokenType::End, ""};
+            if (pos >= input.size()) return {TokenType::End, {}};
 
             char c = currentChar();
 
-            if (std::isdigit(c) || c == '.') {
-                return {TokenType::Number, readNumber()};
-            } else if (std::isalpha(c)) {
-                std::string id = readIdentifier();
+            if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+                Token token{TokenType::Number, readNumber()};
+                const char* last = token.text.data() + token.text.size();
+                auto [end, error] = std::from_chars(token.text.data(), last, token.number);
+                if (error != std::errc() || end != last) {
+                    throw std::runtime_error("Invalid number: " + std::string(token.text));
+                }
+                return token;
+            } else if (std::isalpha(static_cast<unsigned char>(c))) {
+                std::string_view id = readIdentifier();
                 if (currentChar() == '(') {
-                    return {TokenType::Function, id};
+                    Token token{TokenType::Function, id};
+                    token.function = function(id);
+                    return token;
                 } else {
                     return {TokenType::Variable, id};
                 }
             } else if (c == '(') {
-                advance();
-                return {TokenType::LeftParen, "("};
+                return {TokenType::LeftParen, input.substr(pos++, 1)};
             } else if (c == ')') {
-                advance();
-                return {TokenType::RightParen, ")"};
+                return {TokenType::RightParen, input.substr(pos++, 1)};
             } else if (c == '+' || c == '-' || c == '*' || c == '/' || c == '^') {
-                advance();
-                return {TokenType::Operator, std::string(1, c)};
+                Token token{TokenType::Operator, input.substr(pos++, 1)};
+                token.op = c == '+' ? OperatorType::Add
+                         : c == '-' ? OperatorType::Subtract
+                         : c == '*' ? OperatorType::Multiply
+                         : c == '/' ? OperatorType::Divide
+                         : OperatorType::Power;
+                return token;
             } else {
                 throw std::runtime_error("Unexpected character: " + std::string(1, c));
             }
         }
     };
 
+    // Iterative precedence-climbing parser. The pending left operands of one
+    // parenthesis level live in locals; opening a group or call saves them on
+    // an explicit stack, so neither nesting nor long chains recurse. Unary
+    // minus binds to the following primary, '^' is right-associative and
+    // binds tighter than '*' and '/', which bind tighter than '+' and '-'.
     template <typename T>
     class Parser {
     private:
+        using NodePtr = std::shared_ptr<Node<T>>;
+
+        // Left operands waiting at one parenthesis level.
+        struct Level {
+            NodePtr sum;
+            OperatorType sumOp = OperatorType::Add;
+            NodePtr term;
+            OperatorType termOp = OperatorType::Multiply;
+            std::size_t powers = 0;
+        };
+
+        // An open group or call and the level it interrupted.
+        struct Frame {
+            Level level;
+            std::size_t negations;
+            bool call;
+            FunctionType function;
+            std::string_view name;
+        };
+
         Lexer lexer;
         Token currentToken;
+        NodeFactory<T> factory;
+        ParseLimits limits;
+        std::pmr::vector<Frame> frames{factory.scratchResource()};
+        std::pmr::vector<NodePtr> bases{factory.scratchResource()};
+        std::size_t openNegations = 0;
 
         void advance() {
             currentToken = lexer.nextToken();
         }
 
-        std::shared_ptr<Node<T>> parseExpression() {
-            auto left = parseTerm();
-            while (currentToken.type == TokenType::Operator &&
-                  (currentToken.value == "+" || currentToken.value == "-")) {
-                std::string op = currentToken.value;
-                advance();
-                auto right = parseTerm();
-                if (op == "+") {
-                    left = std::make_shared<AddNode<T>>(left, right);
-                } else {
-                    left = std::make_shared<SubtractNode<T>>(left, right);
-                }
+        // Every level of the tree takes at least one character, so an input
+        // no longer than maxDepth skips the factory's depth tracking.
+        static NodeLimits nodeLimits(std::string_view input, const ParseLimits& limits) {
+            NodeLimits nodes = limits.nodes;
+            if (input.size() <= nodes.maxDepth) {
+                nodes.maxDepth = std::numeric_limits<std::size_t>::max();
             }
-            return left;
+            return nodes;
         }
 
-        std::shared_ptr<Node<T>> parseTerm() {
-            auto left = parseFactor();
-            while (currentToken.type == TokenType::Operator &&
-                  (currentToken.value == "*" || currentToken.value == "/")) {
-                std::string op = currentToken.value;
-                advance();
-                auto right = parseFactor();
-                if (op == "*") {
-                    left = std::make_shared<MultiplyNode<T>>(left, right);
-                } else {
-                    left = std::make_shared<DivideNode<T>>(left, right);
-                }
+        // negations counts the unary minuses read for the current primary.
+        void checkDepth(std::size_t negations = 0) const {
+            if (frames.size() + bases.size() + openNegations + negations >= limits.maxDepth) {
+                throw std::runtime_error("Expression exceeds depth limit");
             }
-            return left;
         }
 
-        std::shared_ptr<Node<T>> parseFactor() {
-            auto left = parsePower();
-            if (currentToken.type == TokenType::Operator && currentToken.value == "^") {
-                advance();
-                auto right = parseFactor();
-                return std::make_shared<PowerNode<T>>(left, right);
+        NodePtr binary(OperatorType op, const NodePtr& left, const NodePtr& right) {
+            switch (op) {
+                case OperatorType::Add: return factory.add(left, right);
+                case OperatorType::Subtract: return factory.subtract(left, right);
+                case OperatorType::Multiply: return factory.multiply(left, right);
+                case OperatorType::Divide: return factory.divide(left, right);
+                default: return factory.power(left, right);
             }
-            return left;
         }
 
-        std::shared_ptr<Node<T>> parsePower() {
-            return parsePrimary();
+        NodePtr call(const Frame& frame, const NodePtr& arg) {
+            switch (frame.function) {
+                case FunctionType::Sin: return factory.sin(arg);
+                case FunctionType::Cos: return factory.cos(arg);
+                case FunctionType::Ln: return factory.ln(arg);
+                case FunctionType::Exp: return factory.exp(arg);
+                default: throw std::runtime_error("Unknown function: " + std::string(frame.name));
+            }
         }
 
-        std::shared_ptr<Node<T>> parsePrimary() {
-            Token token = currentToken;
-            if (token.type == TokenType::Number) {
+        void negate(NodePtr& node, std::size_t negations) {
+            for (; negations > 0; --negations) {
+                node = factory.negate(node);
+            }
+        }
+
+        // Folds the pending '^' bases of level into value.
+        void foldPowers(const Level& level, NodePtr& value) {
+            while (bases.size() > level.powers) {
+                value = factory.power(bases.back(), value);
+                bases.pop_back();
+            }
+        }
+
+        // Folds value into the pending product and leaves the product in
+        // level.term.
+        void foldTerm(Level& level, NodePtr& value) {
+            foldPowers(level, value);
+            if (level.term) {
+                level.term = binary(level.termOp, level.term, value);
+            } else {
+                level.term = std::move(value);
+            }
+        }
+
+        // Folds value into the pending sum and leaves the sum in level.sum.
+        void foldSum(Level& level, NodePtr& value) {
+            foldTerm(level, value);
+            if (level.sum) {
+                level.sum = binary(level.sumOp, level.sum, level.term);
+            } else {
+                level.sum = std::move(level.term);
+            }
+            level.term = nullptr;
+        }
+
+        // Reads one primary, opening a frame for every group or call before
+        // it. Returns null when a frame was opened.
+        NodePtr readPrimary(Level& level) {
+            std::size_t negations = 0;
+            while (currentToken.type == TokenType::Operator && currentToken.op == OperatorType::Subtract) {
+                checkDepth(++negations);
                 advance();
+            }
+            const Token& token = currentToken;
+            if (token.type == TokenType::Number) {
                 T value = T(0);
-                if constexpr (std::is_arithmetic_v<T>) {
-                    value = static_cast<T>(std::stod(token.value));
+                if constexpr (std::is_same_v<T, float>) {
+                    // Rounded once from the text rather than through double.
+                    std::from_chars(token.text.data(), token.text.data() + token.text.size(), value);
+                } else if constexpr (std::is_arithmetic_v<T>) {
+                    value = static_cast<T>(token.number);
                 } else {
                     throw std::runtime_error("Complex number parsing not implemented");
                 }
-                return std::make_shared<ConstNode<T>>(value);
+                advance();
+                NodePtr node = factory.constant(value);
+                negate(node, negations);
+                return node;
             } else if (token.type == TokenType::Variable) {
-                std::string varName = token.value;
+                std::string_view name = token.text;
                 advance();
-                return std::make_shared<VarNode<T>>(varName);
-            } else if (token.type == TokenType::Function) {
-                std::string funcName = token.value;
-                advance(); 
-                advance(); 
-                auto arg = parseExpression();
-                if (currentToken.type != TokenType::RightParen) {
-                    throw std::runtime_error("Expected ')' after function argument");
-                }
-                advance(); 
-                if (funcName == "sin") {
-                    return std::make_shared<SinNode<T>>(arg);
-                } else if (funcName == "cos") {
-                    return std::make_shared<CosNode<T>>(arg);
-                } else if (funcName == "ln") {
-                    return std::make_shared<LnNode<T>>(arg);
-                } else if (funcName == "exp") {
-                    return std::make_shared<ExpNode<T>>(arg);
-                } else {
-                    throw std::runtime_error("Unknown function: " + funcName);
-                }
-            } else if (token.type == TokenType::LeftParen) {
+                NodePtr node = factory.variable(std::string(name));
+                negate(node, negations);
+                return node;
+            } else if (token.type == TokenType::Function || token.type == TokenType::LeftParen) {
+                checkDepth(negations);
+                bool call = token.type == TokenType::Function;
+                frames.push_back({std::move(level), negations, call, token.function, token.text});
+                openNegations += negations;
+                level = Level{nullptr, OperatorType::Add, nullptr, OperatorType::Multiply, bases.size()};
                 advance();
-                auto expr = parseExpression();
-                if (currentToken.type != TokenType::RightParen) {
-                    throw std::runtime_error("Expected ')'");
+                if (call) {
+                    advance();
                 }
-                advance();
-                return expr;
-            } else if (token.type == TokenType::Operator && token.value == "-") {
-                advance();
-                auto expr = parsePrimary();
-                return std::make_shared<NegateNode<T>>(expr);
+                return nullptr;
             } else {
                 throw std::runtime_error("Unexpected token");
             }
         }
 
     public:
-        Parser(const std::string& input) : lexer(input) {
+        // input must outlive the parser.
+        Parser(std::string_view input, std::shared_ptr<NodeArena> arena = nullptr, ParseLimits limits = {})
+            : lexer(input), factory(false, std::move(arena), nodeLimits(input, limits)), limits(limits) {
+            if (input.size() > limits.maxLength) {
+                throw std::runtime_error("Expression exceeds length limit");
+            }
             advance();
         }
 
-        std::shared_ptr<Node<T>> parse() {
-            return parseExpression();
+        // Parsing stops at the first token that cannot continue the
+        // expression outside any parentheses; the rest is ignored.
+        NodePtr parse() {
+            Level level;
+            NodePtr value;
+            while (true) {
+                while (!(value = readPrimary(level))) {}
+
+                while (true) {
+                    if (currentToken.type == TokenType::Operator) {
+                        OperatorType op = currentToken.op;
+                        advance();
+                        if (op == OperatorType::Power) {
+                            checkDepth();
+                            bases.push_back(std::move(value));
+                        } else if (op == OperatorType::Multiply || op == OperatorType::Divide) {
+                            foldTerm(level, value);
+                            level.termOp = op;
+                        } else {
+                            foldSum(level, value);
+                            level.sumOp = op;
+                        }
+                        break;
+                    }
+
+                    foldSum(level, value);
+                    value = std::move(level.sum);
+                    if (frames.empty()) {
+                        return value;
+                    }
+                    Frame& frame = frames.back();
+                    if (currentToken.type != TokenType::RightParen) {
+                        throw std::runtime_error(frame.call ? "Expected ')' after function argument" : "Expected ')'");
+                    }
+                    advance();
+                    if (frame.call) {
+                        value = call(frame, value);
+                    }
+                    negate(value, frame.negations);
+                    openNegations -= frame.negations;
+                    level = std::move(frame.level);
+                    frames.pop_back();
+                }
+            }
         }
     };
 
     template <typename T>
-    Expression<T> Expression<T>::Parse(const std::string& s) {
-        Parser<T> parser(s);
-        return Expression<T>(parser.parse());
+    Expression<T> Expression<T>::Parse(std::string_view s, std::shared_ptr<NodeArena> arena, ParseLimits limits) {
+        Parser<T> parser(s, arena, limits);
+        return Expression<T>(parser.parse(), std::move(arena));
     }
 }
 
@@ -0,0 +1,66 @@
+#include "FORMULAFILE.h"
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FORMULAFILE_MMAP 1
+#endif
+
+namespace ExpressionLibrary {
+
+    namespace {
+
+        std::shared_ptr<std::max_align_t[]> alignedBuffer(std::size_t bytes) {
+            return std::shared_ptr<std::max_align_t[]>(new std::max_align_t[bytes / sizeof(std::max_align_t) + 1]);
+        }
+
+    }
+
+    MappedFile::MappedFile(const std::string& path) {
+#if FORMULAFILE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Cannot open " + path);
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat " + path);
+        }
+        length = static_cast<std::size_t>(info.st_size);
+        if (length == 0) {
+            ::close(fd);
+            return;
+        }
+        void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) throw std::runtime_error("Cannot map " + path);
+        std::size_t size = length;
+        owner = std::shared_ptr<const void>(mapped, [size](const void* p) { ::munmap(const_cast<void*>(p), size); });
+        bytes = static_cast<const std::byte*>(mapped);
+#else
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) throw std::runtime_error("Cannot open " + path);
+        length = static_cast<std::size_t>(in.tellg());
+        auto buffer = alignedBuffer(length);
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(buffer.get()), static_cast<std::streamsize>(length))) {
+            throw std::runtime_error("Cannot read " + path);
+        }
+        bytes = reinterpret_cast<const std::byte*>(buffer.get());
+        owner = std::move(buffer);
+#endif
+    }
+
+    MappedFile MappedFile::copy(std::span<const std::byte> source) {
+        MappedFile file;
+        auto buffer = alignedBuffer(source.size());
+        std::memcpy(buffer.get(), source.data(), source.size());
+        file.length = source.size();
+        file.bytes = reinterpret_cast<const std::byte*>(buffer.get());
+        file.owner = std::move(buffer);
+        return file;
+    }
+
+}
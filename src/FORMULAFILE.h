@@ -0,0 +1,445 @@
+#ifndef FORMULAFILE_H
+#define FORMULAFILE_H
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "EXPRESSION.h"
+
+namespace ExpressionLibrary {
+
+    // On-disk layout, version 2; version 1 files, which predate OpCode::Sqrt,
+    // are still read. All integers are native-endian; byteOrder lets readers
+    // reject files from the other endianness. Every section starts at a
+    // multiple of 16 bytes from the start of the file, so a mapped file can
+    // be read in place.
+    namespace FormulaFormat {
+
+        constexpr char Magic[8] = {'E', 'X', 'P', 'R', 'B', 'I', 'N', '\0'};
+        constexpr std::uint32_t Version = 2;
+        constexpr std::uint32_t ByteOrder = 0x01020304;
+        constexpr std::size_t Alignment = 16;
+
+        template <typename T> constexpr std::uint32_t scalar();
+        template <> constexpr std::uint32_t scalar<double>() { return 1; }
+        template <> constexpr std::uint32_t scalar<std::complex<double>>() { return 2; }
+        template <> constexpr std::uint32_t scalar<float>() { return 3; }
+
+        struct Section {
+            std::uint64_t offset;
+            std::uint64_t count;
+        };
+
+        // Bytes [offset, offset + length) of the string table.
+        struct StringRef {
+            std::uint32_t offset;
+            std::uint32_t length;
+        };
+
+        struct Header {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t scalar;
+            std::uint32_t byteOrder;
+            std::uint32_t reserved;
+            std::uint64_t fileSize;
+            Section strings;      // bytes
+            Section formulas;     // Formula
+            Section nodes;        // NodeRecord
+            Section instructions; // Instruction
+            Section constants;    // T
+            Section slots;        // StringRef
+        };
+
+        // Expression nodes in post-order, so operands precede their users and
+        // the last node of a formula is its root. a and b index the formula's
+        // nodes for operators; a indexes the constants section for Const;
+        // (a, b) is a StringRef for Var.
+        struct NodeRecord {
+            std::uint8_t kind;
+            std::uint8_t padding[3];
+            std::uint32_t a;
+            std::uint32_t b;
+        };
+
+        // One expression and its compiled program. Instruction operands are
+        // relative to the formula's own constants and slots.
+        struct Formula {
+            StringRef key;
+            std::uint32_t nodeBegin, nodeCount;
+            std::uint32_t instructionBegin, instructionCount;
+            std::uint32_t constantBegin, constantCount;
+            std::uint32_t slotBegin, slotCount;
+            std::uint32_t registers;
+            std::uint32_t result;
+        };
+
+        static_assert(sizeof(Header) == 128);
+        static_assert(sizeof(NodeRecord) == 12);
+        static_assert(sizeof(Instruction) == 16);
+        static_assert(sizeof(Formula) == 48);
+
+    }
+
+    // Read-only bytes of a file, memory-mapped where the platform allows it
+    // and read into an aligned buffer otherwise. Copies share the bytes.
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& path);
+
+        // An aligned copy of bytes already in memory.
+        static MappedFile copy(std::span<const std::byte> bytes);
+
+        const std::byte* data() const { return bytes; }
+        std::size_t size() const { return length; }
+
+    private:
+        MappedFile() = default;
+
+        std::shared_ptr<const void> owner;
+        const std::byte* bytes = nullptr;
+        std::size_t length = 0;
+    };
+
+    // Accumulates expressions and writes them, with their compiled programs,
+    // as one formula file. Strings are interned across all formulas.
+    template <typename T>
+    class FormulaWriter {
+    public:
+        // key is stored with the formula, e.g. its source text.
+        void add(const Expression<T>& expression, std::string_view key = {}) {
+            FormulaFormat::Formula formula{};
+            formula.key = intern(key);
+            addNodes(*expression.root, formula);
+
+            Program<T> program = expression.compile();
+            formula.instructionBegin = count(instructions);
+            formula.instructionCount = static_cast<std::uint32_t>(program.instructions().size());
+            for (const Instruction& ins : program.instructions()) {
+                Instruction record{};
+                std::memset(&record, 0, sizeof(record));
+                record.op = ins.op;
+                record.dst = ins.dst;
+                record.a = ins.a;
+                record.b = ins.b;
+                instructions.push_back(record);
+            }
+            formula.constantBegin = count(constants);
+            formula.constantCount = static_cast<std::uint32_t>(program.constantPool().size());
+            constants.insert(constants.end(), program.constantPool().begin(), program.constantPool().end());
+            formula.slotBegin = count(slots);
+            formula.slotCount = static_cast<std::uint32_t>(program.variables().size());
+            for (const auto& name : program.variables()) {
+                slots.push_back(intern(name));
+            }
+            formula.registers = program.registers();
+            formula.result = program.resultRegister();
+            formulas.push_back(formula);
+        }
+
+        std::size_t size() const { return formulas.size(); }
+
+        void write(std::ostream& out) const {
+            using namespace FormulaFormat;
+            Header header{};
+            std::memcpy(header.magic, Magic, sizeof(Magic));
+            header.version = Version;
+            header.scalar = scalar<T>();
+            header.byteOrder = ByteOrder;
+
+            std::uint64_t offset = sizeof(Header);
+            auto place = [&](Section& section, std::size_t count, std::size_t bytes) {
+                offset = (offset + Alignment - 1) / Alignment * Alignment;
+                section = {offset, count};
+                offset += bytes;
+            };
+            place(header.strings, strings.size(), strings.size());
+            place(header.formulas, formulas.size(), formulas.size() * sizeof(Formula));
+            place(header.nodes, nodes.size(), nodes.size() * sizeof(NodeRecord));
+            place(header.instructions, instructions.size(), instructions.size() * sizeof(Instruction));
+            place(header.constants, constants.size(), constants.size() * sizeof(T));
+            place(header.slots, slots.size(), slots.size() * sizeof(StringRef));
+            header.fileSize = offset;
+
+            std::uint64_t written = 0;
+            auto put = [&](const Section& section, const void* data, std::size_t bytes) {
+                static const char zeros[Alignment] = {};
+                out.write(zeros, static_cast<std::streamsize>(section.offset - written));
+                out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+                written = section.offset + bytes;
+            };
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            written = sizeof(header);
+            put(header.strings, strings.data(), strings.size());
+            put(header.formulas, formulas.data(), formulas.size() * sizeof(Formula));
+            put(header.nodes, nodes.data(), nodes.size() * sizeof(NodeRecord));
+            put(header.instructions, instructions.data(), instructions.size() * sizeof(Instruction));
+            put(header.constants, constants.data(), constants.size() * sizeof(T));
+            put(header.slots, slots.data(), slots.size() * sizeof(StringRef));
+            if (!out) {
+                throw std::runtime_error("Cannot write formula file");
+            }
+        }
+
+    private:
+        std::string strings;
+        std::unordered_map<std::string, FormulaFormat::StringRef> interned;
+        std::vector<FormulaFormat::Formula> formulas;
+        std::vector<FormulaFormat::NodeRecord> nodes;
+        std::vector<Instruction> instructions;
+        std::vector<T> constants;
+        std::vector<FormulaFormat::StringRef> slots;
+
+        template <typename V>
+        static std::uint32_t count(const V& v) {
+            if (v.size() > UINT32_MAX) {
+                throw std::length_error("Formula file section too large");
+            }
+            return static_cast<std::uint32_t>(v.size());
+        }
+
+        FormulaFormat::StringRef intern(std::string_view s) {
+            auto it = interned.find(std::string(s));
+            if (it != interned.end()) return it->second;
+            FormulaFormat::StringRef ref{count(strings), static_cast<std::uint32_t>(s.size())};
+            strings.append(s);
+            count(strings);
+            interned.emplace(std::string(s), ref);
+            return ref;
+        }
+
+        // Post-order walk with an explicit stack; nodes shared by pointer are
+        // written once.
+        void addNodes(const Node<T>& root, FormulaFormat::Formula& formula) {
+            formula.nodeBegin = count(nodes);
+            std::unordered_map<const Node<T>*, std::uint32_t> index;
+            std::vector<std::pair<const Node<T>*, std::size_t>> stack{{&root, 0}};
+            while (!stack.empty()) {
+                auto& [node, next] = stack.back();
+                if (next < node->arity()) {
+                    const Node<T>* child = node->operand(next++).get();
+                    if (!index.count(child)) stack.push_back({child, 0});
+                    continue;
+                }
+                if (!index.count(node)) {
+                    FormulaFormat::NodeRecord record{};
+                    record.kind = static_cast<std::uint8_t>(node->kind());
+                    if (node->kind() == NodeKind::Const) {
+                        record.a = count(constants);
+                        constants.push_back(static_cast<const ConstNode<T>&>(*node).value);
+                    } else if (node->kind() == NodeKind::Var) {
+                        auto ref = intern(static_cast<const VarNode<T>&>(*node).name);
+                        record.a = ref.offset;
+                        record.b = ref.length;
+                    } else {
+                        record.a = index.at(node->operand(0).get());
+                        if (node->arity() > 1) record.b = index.at(node->operand(1).get());
+                    }
+                    index.emplace(node, count(nodes) - formula.nodeBegin);
+                    nodes.push_back(record);
+                }
+                stack.pop_back();
+            }
+            formula.nodeCount = count(nodes) - formula.nodeBegin;
+        }
+    };
+
+    // A formula file loaded for reading. Opening validates every record once;
+    // afterwards programs are evaluated straight from the mapped bytes and
+    // expressions are rebuilt without parsing. Copies share the mapping.
+    template <typename T>
+    class FormulaFile {
+    public:
+        explicit FormulaFile(const std::string& path) : FormulaFile(MappedFile(path)) {}
+
+        explicit FormulaFile(MappedFile bytes) : file(std::move(bytes)) {
+            validate();
+        }
+
+        std::size_t size() const { return header().formulas.count; }
+
+        std::string_view key(std::size_t i) const { return string(formula(i).key); }
+
+        std::vector<std::string_view> variables(std::size_t i) const {
+            const auto& f = formula(i);
+            std::vector<std::string_view> names;
+            for (std::uint32_t s = 0; s < f.slotCount; ++s) {
+                names.push_back(string(section<FormulaFormat::StringRef>(header().slots)[f.slotBegin + s]));
+            }
+            return names;
+        }
+
+        // Evaluates in place; values follow variables(i). Valid while this
+        // file or a copy of it is alive.
+        ProgramView<T> program(std::size_t i) const {
+            const auto& f = formula(i);
+            return {
+                std::span<const Instruction>(section<Instruction>(header().instructions) + f.instructionBegin, f.instructionCount),
+                std::span<const T>(section<T>(header().constants) + f.constantBegin, f.constantCount),
+                f.registers,
+                f.result,
+            };
+        }
+
+        // An owning copy with gradient, tangent and batch evaluation.
+        Program<T> compile(std::size_t i) const {
+            auto names = variables(i);
+            return Program<T>(program(i), std::vector<std::string>(names.begin(), names.end()));
+        }
+
+        Expression<T> expression(std::size_t i, std::shared_ptr<NodeArena> arena = nullptr) const {
+            using namespace FormulaFormat;
+            const auto& f = formula(i);
+            const NodeRecord* records = section<NodeRecord>(header().nodes) + f.nodeBegin;
+            const T* values = section<T>(header().constants);
+            NodeFactory<T> factory(false, arena);
+            std::vector<std::shared_ptr<Node<T>>> built;
+            built.reserve(f.nodeCount);
+            for (std::uint32_t n = 0; n < f.nodeCount; ++n) {
+                const NodeRecord& r = records[n];
+                switch (static_cast<NodeKind>(r.kind)) {
+                    case NodeKind::Const:    built.push_back(factory.constant(values[r.a])); break;
+                    case NodeKind::Var:      built.push_back(factory.variable(std::string(string({r.a, r.b})))); break;
+                    case NodeKind::Add:      built.push_back(factory.add(built[r.a], built[r.b])); break;
+                    case NodeKind::Subtract: built.push_back(factory.subtract(built[r.a], built[r.b])); break;
+                    case NodeKind::Multiply: built.push_back(factory.multiply(built[r.a], built[r.b])); break;
+                    case NodeKind::Divide:   built.push_back(factory.divide(built[r.a], built[r.b])); break;
+                    case NodeKind::Power:    built.push_back(factory.power(built[r.a], built[r.b])); break;
+                    case NodeKind::Sin:      built.push_back(factory.sin(built[r.a])); break;
+                    case NodeKind::Cos:      built.push_back(factory.cos(built[r.a])); break;
+                    case NodeKind::Ln:       built.push_back(factory.ln(built[r.a])); break;
+                    case NodeKind::Exp:      built.push_back(factory.exp(built[r.a])); break;
+                    case NodeKind::Negate:   built.push_back(factory.negate(built[r.a])); break;
+                }
+            }
+            return Expression<T>(built.back(), std::move(arena));
+        }
+
+    private:
+        MappedFile file;
+
+        const FormulaFormat::Header& header() const {
+            return *reinterpret_cast<const FormulaFormat::Header*>(file.data());
+        }
+
+        template <typename R>
+        const R* section(const FormulaFormat::Section& s) const {
+            return reinterpret_cast<const R*>(file.data() + s.offset);
+        }
+
+        const FormulaFormat::Formula& formula(std::size_t i) const {
+            if (i >= size()) {
+                throw std::out_of_range("Formula index out of range");
+            }
+            return section<FormulaFormat::Formula>(header().formulas)[i];
+        }
+
+        std::string_view string(FormulaFormat::StringRef ref) const {
+            return {reinterpret_cast<const char*>(file.data() + header().strings.offset + ref.offset), ref.length};
+        }
+
+        static void fail(const std::string& what) {
+            throw std::runtime_error("Invalid formula file: " + what);
+        }
+
+        static bool within(std::uint64_t begin, std::uint64_t count, std::uint64_t limit) {
+            return begin <= limit && count <= limit - begin;
+        }
+
+        void validate() const {
+            using namespace FormulaFormat;
+            if (file.size() < sizeof(Header)) fail("truncated header");
+            const Header& h = header();
+            if (std::memcmp(h.magic, Magic, sizeof(Magic)) != 0) fail("bad magic");
+            if (h.byteOrder != ByteOrder) fail("written with another byte order");
+            if (h.version < 1 || h.version > Version) fail("unsupported version " + std::to_string(h.version));
+            if (h.scalar != scalar<T>()) fail("written for another scalar type");
+            if (h.fileSize != file.size()) fail("size mismatch");
+
+            auto checkSection = [&](const Section& s, std::size_t element) {
+                if (s.offset % Alignment != 0 || s.count > file.size() || !within(s.offset, s.count * element, file.size())) {
+                    fail("section out of bounds");
+                }
+            };
+            checkSection(h.strings, 1);
+            checkSection(h.formulas, sizeof(Formula));
+            checkSection(h.nodes, sizeof(NodeRecord));
+            checkSection(h.instructions, sizeof(Instruction));
+            checkSection(h.constants, sizeof(T));
+            checkSection(h.slots, sizeof(StringRef));
+
+            auto checkString = [&](StringRef ref) {
+                if (!within(ref.offset, ref.length, h.strings.count)) fail("string out of bounds");
+            };
+            for (const StringRef& ref : std::span(section<StringRef>(h.slots), h.slots.count)) {
+                checkString(ref);
+            }
+
+            std::vector<bool> written;
+            for (const Formula& f : std::span(section<Formula>(h.formulas), h.formulas.count)) {
+                checkString(f.key);
+                if (f.nodeCount == 0 || !within(f.nodeBegin, f.nodeCount, h.nodes.count)) fail("node range");
+                if (f.instructionCount == 0 || !within(f.instructionBegin, f.instructionCount, h.instructions.count)) {
+                    fail("instruction range");
+                }
+                if (!within(f.constantBegin, f.constantCount, h.constants.count)) fail("constant range");
+                if (!within(f.slotBegin, f.slotCount, h.slots.count)) fail("slot range");
+
+                const NodeRecord* records = section<NodeRecord>(h.nodes) + f.nodeBegin;
+                for (std::uint32_t n = 0; n < f.nodeCount; ++n) {
+                    const NodeRecord& r = records[n];
+                    if (r.kind > static_cast<std::uint8_t>(NodeKind::Negate)) fail("unknown node kind");
+                    auto kind = static_cast<NodeKind>(r.kind);
+                    if (kind == NodeKind::Const) {
+                        if (r.a >= h.constants.count) fail("constant out of range");
+                    } else if (kind == NodeKind::Var) {
+                        checkString({r.a, r.b});
+                    } else {
+                        bool binary = kind <= NodeKind::Power;
+                        if (r.a >= n || (binary && r.b >= n)) fail("operand does not precede its node");
+                    }
+                }
+
+                // Registers must be written before they are read, so the
+                // interpreter never sees an uninitialized value.
+                if (f.registers == 0 || f.registers > f.instructionCount || f.result >= f.registers) {
+                    fail("register count");
+                }
+                written.assign(f.registers, false);
+                const Instruction* code = section<Instruction>(h.instructions) + f.instructionBegin;
+                for (std::uint32_t n = 0; n < f.instructionCount; ++n) {
+                    const Instruction& ins = code[n];
+                    if (static_cast<std::uint8_t>(ins.op) > static_cast<std::uint8_t>(OpCode::Sqrt)) fail("unknown opcode");
+                    if (ins.op == OpCode::Sqrt && h.version < 2) fail("sqrt in a version 1 file");
+                    if (ins.op == OpCode::Const) {
+                        if (ins.a >= f.constantCount) fail("constant out of range");
+                    } else if (ins.op == OpCode::Var) {
+                        if (ins.a >= f.slotCount) fail("slot out of range");
+                    } else {
+                        bool binary = ins.op <= OpCode::Power;
+                        if (!binary && ins.b != 0) fail("second operand of a unary op");
+                        if (ins.a >= f.registers || !written[ins.a] ||
+                            (binary && (ins.b >= f.registers || !written[ins.b]))) {
+                            fail("register read before write");
+                        }
+                    }
+                    if (ins.dst >= f.registers) fail("register out of range");
+                    written[ins.dst] = true;
+                }
+                if (!written[f.result]) fail("result never written");
+            }
+        }
+    };
+
+}
+
+#endif // FORMULAFILE_H
@@ -0,0 +1,211 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <queue>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "EXPRESSION.h"
+
+namespace ExpressionLibrary {
+
+    // Stateful evaluator that keeps the value of every node of a program and
+    // recomputes only what a changed variable reaches. set() records the new
+    // value; the next evaluate() walks the users of the changed variables in
+    // topological order and stops wherever a recomputed value comes out
+    // unchanged, so the cost is proportional to the affected subgraph rather
+    // than the whole expression. Not thread-safe.
+    template <typename T>
+    class IncrementalEvaluator {
+    public:
+        // values[i] is the initial value of program.variables()[i].
+        IncrementalEvaluator(const Program<T>& program, std::span<const T> values)
+            : names(program.variables()), slots(values.begin(), values.end()) {
+            if (slots.size() < names.size()) {
+                throw std::invalid_argument("Expected " + std::to_string(names.size()) + " values");
+            }
+            slots.resize(names.size());
+            build(program);
+            recompute();
+        }
+
+        IncrementalEvaluator(const Program<T>& program, const std::map<std::string, T>& values)
+            : IncrementalEvaluator(program, std::span<const T>(lookup(program, values))) {}
+
+        IncrementalEvaluator(const Expression<T>& expression, const std::map<std::string, T>& values)
+            : IncrementalEvaluator(expression.compile(), values) {}
+
+        const std::vector<std::string>& variables() const { return names; }
+
+        // Variables the expression does not use are ignored.
+        void set(const std::string& variable, const T& value) {
+            auto it = slotIndex.find(variable);
+            if (it != slotIndex.end()) {
+                set(it->second, value);
+            }
+        }
+
+        // slot indexes variables().
+        void set(std::size_t slot, const T& value) {
+            if (slot >= slots.size()) {
+                throw std::out_of_range("Variable slot out of range");
+            }
+            slots[slot] = value;
+            for (std::uint32_t i : loads[slot]) {
+                if (!same(values[i], value)) {
+                    values[i] = value;
+                    touch(i);
+                }
+            }
+        }
+
+        T evaluate() {
+            updates = 0;
+            while (!pending.empty()) {
+                std::uint32_t i = pending.top();
+                pending.pop();
+                queued[i] = false;
+                T value = compute(code[i]);
+                ++updates;
+                if (!same(values[i], value)) {
+                    values[i] = value;
+                    touch(i);
+                }
+            }
+            return values[result];
+        }
+
+        // Number of nodes the last evaluate() recomputed.
+        std::size_t updated() const { return updates; }
+
+        // Nodes in the program; a full evaluation recomputes all of them.
+        std::size_t size() const { return code.size(); }
+
+    private:
+        std::vector<std::string> names;
+        std::vector<T> slots;
+        std::unordered_map<std::string, std::size_t> slotIndex;
+
+        // The program's tape: code[i] computes values[i] from earlier entries.
+        std::vector<Instruction> code;
+        std::vector<T> constants;
+        std::vector<T> values;
+        std::uint32_t result = 0;
+        MathAccuracy accuracy = MathAccuracy::Full;
+
+        // users[userBegin[i] .. userBegin[i + 1]) read entry i.
+        std::vector<std::uint32_t> userBegin;
+        std::vector<std::uint32_t> users;
+        std::vector<std::vector<std::uint32_t>> loads;
+
+        std::priority_queue<std::uint32_t, std::vector<std::uint32_t>, std::greater<std::uint32_t>> pending;
+        std::vector<bool> queued;
+        std::size_t updates = 0;
+
+        static std::vector<T> lookup(const Program<T>& program, const std::map<std::string, T>& values) {
+            std::vector<T> result;
+            for (const auto& name : program.variables()) {
+                auto it = values.find(name);
+                if (it == values.end()) {
+                    throw std::runtime_error("Variable " + name + " not found");
+                }
+                result.push_back(it->second);
+            }
+            return result;
+        }
+
+        // Bitwise, so NaN results compare equal to themselves and a sign
+        // change of zero still propagates.
+        static bool same(const T& a, const T& b) {
+            return std::memcmp(&a, &b, sizeof(T)) == 0;
+        }
+
+        static bool binary(OpCode op) {
+            return op >= OpCode::Add && op <= OpCode::Power;
+        }
+
+        void build(const Program<T>& program) {
+            for (std::size_t i = 0; i < names.size(); ++i) {
+                slotIndex.emplace(names[i], i);
+            }
+            constants = program.constantPool();
+            accuracy = program.accuracy();
+            code = program.tapeInstructions();
+            result = program.tapeResult();
+            loads.resize(names.size());
+            for (const Instruction& ins : code) {
+                if (ins.op == OpCode::Var) {
+                    loads[ins.a].push_back(ins.dst);
+                }
+            }
+
+            userBegin.assign(code.size() + 1, 0);
+            for (const Instruction& ins : code) {
+                if (ins.op == OpCode::Const || ins.op == OpCode::Var) continue;
+                ++userBegin[ins.a + 1];
+                if (binary(ins.op) && ins.b != ins.a) ++userBegin[ins.b + 1];
+            }
+            for (std::size_t i = 1; i < userBegin.size(); ++i) {
+                userBegin[i] += userBegin[i - 1];
+            }
+            users.resize(userBegin.back());
+            std::vector<std::uint32_t> fill(userBegin.begin(), userBegin.end() - 1);
+            for (const Instruction& ins : code) {
+                if (ins.op == OpCode::Const || ins.op == OpCode::Var) continue;
+                users[fill[ins.a]++] = ins.dst;
+                if (binary(ins.op) && ins.b != ins.a) users[fill[ins.b]++] = ins.dst;
+            }
+
+            values.resize(code.size());
+            queued.assign(code.size(), false);
+        }
+
+        void recompute() {
+            for (const Instruction& ins : code) {
+                values[ins.dst] = ins.op == OpCode::Var ? slots[ins.a] : compute(ins);
+            }
+            updates = code.size();
+        }
+
+        void touch(std::uint32_t i) {
+            for (std::uint32_t u = userBegin[i]; u < userBegin[i + 1]; ++u) {
+                std::uint32_t user = users[u];
+                if (!queued[user]) {
+                    queued[user] = true;
+                    pending.push(user);
+                }
+            }
+        }
+
+        T compute(const Instruction& ins) const {
+            const T* v = values.data();
+            switch (ins.op) {
+                case OpCode::Const:    return constants[ins.a];
+                case OpCode::Var:      return slots[ins.a];
+                case OpCode::Add:      return v[ins.a] + v[ins.b];
+                case OpCode::Subtract: return v[ins.a] - v[ins.b];
+                case OpCode::Multiply: return v[ins.a] * v[ins.b];
+                case OpCode::Divide:   return v[ins.a] / v[ins.b];
+                case OpCode::Power:    return std::pow(v[ins.a], v[ins.b]);
+                case OpCode::Sin:      return MathFunctions<T>::sin(v[ins.a], accuracy);
+                case OpCode::Cos:      return MathFunctions<T>::cos(v[ins.a], accuracy);
+                case OpCode::Ln:       return MathFunctions<T>::log(v[ins.a], accuracy);
+                case OpCode::Exp:      return MathFunctions<T>::exp(v[ins.a], accuracy);
+                case OpCode::Negate:   return -v[ins.a];
+                case OpCode::Sqrt:     return std::sqrt(v[ins.a]);
+            }
+            return T(0);
+        }
+    };
+
+}
+
+#endif // INCREMENTAL_H
@@ -0,0 +1,290 @@
+#include "JIT.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if EXPRESSION_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace ExpressionLibrary {
+
+#if EXPRESSION_JIT
+    namespace {
+
+        enum class Base { Stack, Values };
+
+        constexpr std::uint32_t NoRegister = UINT32_MAX;
+        constexpr std::size_t PageBytes = 4096;
+
+        // Emits System V x86-64 code. Program registers live in 8-byte stack
+        // slots; rbx points at the current row of variable values.
+        class Assembler {
+        public:
+            std::vector<unsigned char> bytes;
+
+            void emit(std::initializer_list<unsigned char> b) {
+                bytes.insert(bytes.end(), b);
+            }
+
+            void emit32(std::uint32_t v) {
+                for (int i = 0; i < 4; ++i) bytes.push_back(static_cast<unsigned char>(v >> (8 * i)));
+            }
+
+            void emit64(std::uint64_t v) {
+                for (int i = 0; i < 8; ++i) bytes.push_back(static_cast<unsigned char>(v >> (8 * i)));
+            }
+
+            // F2 0F op with xmm<reg> and [rsp + disp] or [rbx + disp].
+            void sse(unsigned char op, int reg, Base base, std::uint32_t disp) {
+                emit({0xF2, 0x0F, op});
+                if (base == Base::Stack) {
+                    emit({static_cast<unsigned char>(0x84 | (reg << 3)), 0x24});
+                } else {
+                    emit({static_cast<unsigned char>(0x83 | (reg << 3))});
+                }
+                emit32(disp);
+            }
+
+            void load(int reg, std::uint32_t slot) { sse(0x10, reg, Base::Stack, slot * 8); }
+            void store(std::uint32_t slot) { sse(0x11, 0, Base::Stack, slot * 8); }
+
+            // movabs rax, imm64
+            void movRax(std::uint64_t value) {
+                emit({0x48, 0xB8});
+                emit64(value);
+            }
+
+            // movq xmm<reg>, rax
+            void movqFromRax(int reg) {
+                emit({0x66, 0x48, 0x0F, 0x6E, static_cast<unsigned char>(0xC0 | (reg << 3))});
+            }
+
+            void call(const void* target) {
+                movRax(reinterpret_cast<std::uintptr_t>(target));
+                emit({0xFF, 0xD0});
+            }
+
+            // Grows the stack by frame bytes, touching each page on the way so
+            // the guard page is never skipped.
+            void allocate(std::uint32_t frame) {
+                while (frame > PageBytes) {
+                    emit({0x48, 0x81, 0xEC});
+                    emit32(PageBytes);
+                    emit({0x48, 0x83, 0x0C, 0x24, 0x00});
+                    frame -= PageBytes;
+                }
+                emit({0x48, 0x81, 0xEC});
+                emit32(frame);
+            }
+
+            void release(std::uint32_t frame) {
+                emit({0x48, 0x81, 0xC4});
+                emit32(frame);
+            }
+
+            void patch(std::size_t at, std::size_t target) {
+                auto rel = static_cast<std::uint32_t>(static_cast<std::int64_t>(target) - static_cast<std::int64_t>(at + 4));
+                std::memcpy(bytes.data() + at, &rel, 4);
+            }
+        };
+
+        using Unary = double (*)(double);
+        using Binary = double (*)(double, double);
+
+        template <MathAccuracy A> double sinAt(double x) { return VecMath::sin(x, A); }
+        template <MathAccuracy A> double cosAt(double x) { return VecMath::cos(x, A); }
+        template <MathAccuracy A> double logAt(double x) { return VecMath::log(x, A); }
+        template <MathAccuracy A> double expAt(double x) { return VecMath::exp(x, A); }
+
+        // The function a Sin, Cos, Ln or Exp instruction calls at the
+        // program's accuracy tier.
+        template <MathAccuracy A>
+        Unary unary(OpCode op) {
+            if constexpr (A == MathAccuracy::Full) {
+                return op == OpCode::Sin ? static_cast<Unary>(std::sin)
+                     : op == OpCode::Cos ? static_cast<Unary>(std::cos)
+                     : op == OpCode::Ln  ? static_cast<Unary>(std::log)
+                     :                     static_cast<Unary>(std::exp);
+            } else {
+                return op == OpCode::Sin ? sinAt<A>
+                     : op == OpCode::Cos ? cosAt<A>
+                     : op == OpCode::Ln  ? logAt<A>
+                     :                     expAt<A>;
+            }
+        }
+
+        Unary unary(OpCode op, MathAccuracy accuracy) {
+            switch (accuracy) {
+                case MathAccuracy::Digits12: return unary<MathAccuracy::Digits12>(op);
+                case MathAccuracy::Digits7:  return unary<MathAccuracy::Digits7>(op);
+                default:                     return unary<MathAccuracy::Full>(op);
+            }
+        }
+
+        // Keeps track of the register xmm0 already holds so chains of
+        // instructions skip reloading the previous result.
+        void body(Assembler& as, const Program<double>& program) {
+            std::uint32_t cached = NoRegister;
+            auto loadA = [&](std::uint32_t a) {
+                if (a != cached) as.load(0, a);
+            };
+            for (const Instruction& ins : program.instructions()) {
+                switch (ins.op) {
+                    case OpCode::Const: {
+                        std::uint64_t bits;
+                        std::memcpy(&bits, &program.constantPool()[ins.a], sizeof(bits));
+                        as.movRax(bits);
+                        as.movqFromRax(0);
+                        break;
+                    }
+                    case OpCode::Var:
+                        as.sse(0x10, 0, Base::Values, ins.a * 8);
+                        break;
+                    case OpCode::Add:
+                    case OpCode::Subtract:
+                    case OpCode::Multiply:
+                    case OpCode::Divide: {
+                        unsigned char op = ins.op == OpCode::Add      ? 0x58  // addsd
+                                         : ins.op == OpCode::Subtract ? 0x5C  // subsd
+                                         : ins.op == OpCode::Multiply ? 0x59  // mulsd
+                                         :                              0x5E; // divsd
+                        loadA(ins.a);
+                        as.sse(op, 0, Base::Stack, ins.b * 8);
+                        break;
+                    }
+                    case OpCode::Power:
+                        as.load(1, ins.b);
+                        loadA(ins.a);
+                        as.call(reinterpret_cast<const void*>(static_cast<Binary>(std::pow)));
+                        break;
+                    case OpCode::Sin:
+                    case OpCode::Cos:
+                    case OpCode::Ln:
+                    case OpCode::Exp: {
+                        Unary f = unary(ins.op, program.accuracy());
+                        loadA(ins.a);
+                        as.call(reinterpret_cast<const void*>(f));
+                        break;
+                    }
+                    case OpCode::Negate:
+                        loadA(ins.a);
+                        as.movRax(0x8000000000000000ull);
+                        as.movqFromRax(1);
+                        as.emit({0x66, 0x0F, 0x57, 0xC1});
+                        break;
+                    case OpCode::Sqrt:
+                        loadA(ins.a);
+                        as.emit({0xF2, 0x0F, 0x51, 0xC0}); // sqrtsd xmm0, xmm0
+                        break;
+                }
+                as.store(ins.dst);
+                cached = ins.dst;
+            }
+            if (cached != program.resultRegister()) {
+                as.load(0, program.resultRegister());
+            }
+        }
+
+        // Frame size that keeps rsp 16-byte aligned at calls after pushes
+        // callee-saved registers on top of the return address.
+        std::uint32_t frameBytes(const Program<double>& program, std::uint32_t pushes) {
+            std::uint32_t frame = std::max<std::uint32_t>(program.registers(), 1) * 8;
+            while ((frame + 8 * (pushes + 1)) % 16 != 0) frame += 8;
+            return frame;
+        }
+
+        // double f(const double* values)
+        void scalarFunction(Assembler& as, const Program<double>& program) {
+            std::uint32_t frame = frameBytes(program, 1);
+            as.emit({0x53});                   // push rbx
+            as.allocate(frame);
+            as.emit({0x48, 0x89, 0xFB});       // mov rbx, rdi
+            body(as, program);
+            as.release(frame);
+            as.emit({0x5B, 0xC3});             // pop rbx; ret
+        }
+
+        // void f(const double* rows, double* out, size_t count, size_t stride)
+        void batchFunction(Assembler& as, const Program<double>& program) {
+            std::uint32_t frame = frameBytes(program, 4);
+            as.emit({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56}); // push rbx, r12, r13, r14
+            as.allocate(frame);
+            as.emit({0x48, 0x89, 0xFB});       // mov rbx, rdi
+            as.emit({0x49, 0x89, 0xF4});       // mov r12, rsi
+            as.emit({0x49, 0x89, 0xD5});       // mov r13, rdx
+            as.emit({0x49, 0x89, 0xCE});       // mov r14, rcx
+            as.emit({0x49, 0xC1, 0xE6, 0x03}); // shl r14, 3
+            as.emit({0x4D, 0x85, 0xED});       // test r13, r13
+            as.emit({0x0F, 0x84});             // jz done
+            std::size_t skip = as.bytes.size();
+            as.emit32(0);
+
+            std::size_t loop = as.bytes.size();
+            body(as, program);
+            as.emit({0xF2, 0x41, 0x0F, 0x11, 0x04, 0x24}); // movsd [r12], xmm0
+            as.emit({0x49, 0x83, 0xC4, 0x08}); // add r12, 8
+            as.emit({0x4C, 0x01, 0xF3});       // add rbx, r14
+            as.emit({0x49, 0xFF, 0xCD});       // dec r13
+            as.emit({0x0F, 0x85});             // jnz loop
+            as.emit32(0);
+            as.patch(as.bytes.size() - 4, loop);
+
+            as.patch(skip, as.bytes.size());
+            as.release(frame);
+            as.emit({0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3}); // pop r14, r13, r12, rbx; ret
+        }
+
+    }
+#endif
+
+    JitFunction::JitFunction(Program<double> compiled, bool native) : program(std::move(compiled)) {
+#if EXPRESSION_JIT
+        if (!native) return;
+
+        Assembler as;
+        scalarFunction(as, program);
+        std::size_t batchOffset = (as.bytes.size() + 15) & ~std::size_t(15);
+        as.bytes.resize(batchOffset, 0xCC);
+        batchFunction(as, program);
+
+        long page = sysconf(_SC_PAGESIZE);
+        std::size_t size = (as.bytes.size() + page - 1) / page * page;
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) return;
+        std::memcpy(memory, as.bytes.data(), as.bytes.size());
+        if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory, size);
+            return;
+        }
+        code = std::shared_ptr<void>(memory, [size](void* p) { munmap(p, size); });
+        scalar = reinterpret_cast<Function>(memory);
+        batch = reinterpret_cast<BatchFunction>(static_cast<unsigned char*>(memory) + batchOffset);
+#else
+        (void)native;
+#endif
+    }
+
+    bool JitFunction::supported() {
+#if EXPRESSION_JIT
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void JitFunction::evaluate_batch(const double* rows, std::span<double> out, std::size_t stride) const {
+        if (stride == 0) stride = variables().size();
+        if (batch) {
+            batch(rows, out.data(), out.size(), stride);
+            return;
+        }
+        for (std::size_t i = 0; i < out.size(); ++i) {
+            out[i] = program.evaluate(std::span<const double>(rows + i * stride, variables().size()));
+        }
+    }
+
+}
@@ -0,0 +1,66 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+#include "PROGRAM.h"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__)) && !defined(EXPRESSION_NO_JIT)
+#define EXPRESSION_JIT 1
+#endif
+
+namespace ExpressionLibrary {
+
+    // Program<double> translated to native x86-64 code. Every instruction is
+    // lowered to the scalar SSE2 operation, or the libm call (the tier's
+    // approximation for an approximate() program), the interpreter performs,
+    // so results are bit-for-bit those of Program<double>::evaluate
+    // and Node<double>::evaluate; only which NaN comes out may differ, as it
+    // does between any two compilations of the same C++. Where no code can be
+    // generated (another architecture, a build with EXPRESSION_NO_JIT, or a
+    // system refusing executable mappings) the same interface runs the
+    // interpreter instead.
+    // Copies share the generated code, which is released with the last one.
+    class JitFunction {
+    public:
+        using Function = double (*)(const double* values);
+        using BatchFunction = void (*)(const double* rows, double* out, std::size_t count, std::size_t stride);
+
+        // Native code is only generated when native is true.
+        explicit JitFunction(Program<double> program, bool native = true);
+
+        static bool supported();
+
+        bool native() const { return scalar != nullptr; }
+
+        // The generated function, or nullptr when running on the interpreter.
+        // values[i] is the value of variables()[i].
+        Function function() const { return scalar; }
+
+        const std::vector<std::string>& variables() const { return program.variables(); }
+
+        double evaluate(std::span<const double> values) const {
+            return scalar ? scalar(values.data()) : program.evaluate(values);
+        }
+
+        double operator()(const double* values) const {
+            return scalar ? scalar(values) : program.evaluate(std::span<const double>(values, variables().size()));
+        }
+
+        // Row-major evaluation: row i holds the values of variables() starting
+        // at rows[i * stride]. stride defaults to variables().size().
+        void evaluate_batch(const double* rows, std::span<double> out, std::size_t stride = 0) const;
+
+    private:
+        Program<double> program;
+        std::shared_ptr<void> code;
+        Function scalar = nullptr;
+        BatchFunction batch = nullptr;
+    };
+
+}
+
+#endif // JIT_H
@@ -1,13 +1,26 @@
 #ifndef NODE_H
 #define NODE_H
 
+#include <algorithm>
+#include <bit>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <map>
+#include <optional>
 #include <string>
 #include <stdexcept>
 #include <cmath>
 #include <complex>
 #include <sstream>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace ExpressionLibrary {
 
@@ -23,15 +36,45 @@ namespace ExpressionLibrary {
     template <typename T> struct LnNode;
     template <typename T> struct ExpNode;
     template <typename T> struct NegateNode;
+    template <typename T> class NodeFactory;
+    template <typename T> class Differentiation;
+
+    enum class NodeKind {
+        Const,
+        Var,
+        Add,
+        Subtract,
+        Multiply,
+        Divide,
+        Power,
+        Sin,
+        Cos,
+        Ln,
+        Exp,
+        Negate
+    };
 
+    // Nodes are never modified after construction, so any number of parents,
+    // expressions and threads may share one.
     template <typename T>
     struct Node {
         virtual ~Node() = default;
+        virtual NodeKind kind() const = 0;
+        virtual std::size_t arity() const { return 0; }
+        virtual const std::shared_ptr<Node<T>>& operand(std::size_t) const {
+            throw std::out_of_range("Node has no operands");
+        }
         virtual T evaluate(const std::map<std::string, T>& variables) const = 0;
         virtual std::string to_string() const = 0;
         virtual std::shared_ptr<Node<T>> clone() const = 0;
-        virtual std::shared_ptr<Node<T>> differentiate(const std::string& variable) const = 0;
+        virtual std::shared_ptr<Node<T>> derivative(Differentiation<T>& d) const = 0;
         virtual std::shared_ptr<Node<T>> substitute(const std::string& variable, const T& value) const = 0;
+
+        std::shared_ptr<Node<T>> differentiate(const std::string& variable) const {
+            NodeFactory<T> factory;
+            Differentiation<T> d(factory, variable);
+            return derivative(d);
+        }
     };
 
     template <typename T>
@@ -40,6 +83,10 @@ namespace ExpressionLibrary {
 
         ConstNode(T value) : value(value) {}
 
+        NodeKind kind() const override {
+            return NodeKind::Const;
+        }
+
         T evaluate(const std::map<std::string, T>&) const override {
             return value;
         }
@@ -54,8 +101,8 @@ namespace ExpressionLibrary {
             return std::make_shared<ConstNode<T>>(value);
         }
 
-        std::shared_ptr<Node<T>> differentiate(const std::string&) const override {
-            return std::make_shared<ConstNode<T>>(0);
+        std::shared_ptr<Node<T>> derivative(Differentiation<T>& d) const override {
+            return d.factory().constant(T(0));
         }
 
         std::shared_ptr<Node<T>> substitute(const std::string&, const T&) const override {
@@ -69,6 +116,10 @@ namespace ExpressionLibrary {
 
         VarNode(const std::string& name) : name(name) {}
 
+        NodeKind kind() const override {
+            return NodeKind::Var;
+        }
+
         T evaluate(const std::map<std::string, T>& variables) const override {
             auto it = variables.find(name);
             if (it == variables.end()) {
@@ -85,8 +136,8 @@ namespace ExpressionLibrary {
             return std::make_shared<VarNode<T>>(name);
         }
 
-        std::shared_ptr<Node<T>> differentiate(const std::string& variable) const override {
-            return std::make_shared<ConstNode<T>>(name == variable ? 1 : 0);
+        std::shared_ptr<Node<T>> derivative(Differentiation<T>& d) const override {
+            return d.factory().constant(T(name == d.variable() ? 1 : 0));
         }
 
         std::shared_ptr<Node<T>> substitute(const std::string& variable, const T& value) const override {
@@ -104,6 +155,18 @@ namespace ExpressionLibrary {
         AddNode(std::shared_ptr<Node<T>> left, std::shared_ptr<Node<T>> right)
             : left(left), right(right) {}
 
+        NodeKind kind() const override {
+            return NodeKind::Add;
+        }
+
+        std::size_t arity() const override {
+            return 2;
+        }
+
+        const std::shared_ptr<Node<T>>& operand(std::size_t index) const override {
+            return index == 0 ? left : right;
+        }
+
         T evaluate(const std::map<std::string, T>& variables) const override {
             return left->evaluate(variables) + right->evaluate(variables);
         }
@@ -116,11 +179,8 @@ namespace ExpressionLibrary {
             return std::make_shared<AddNode<T>>(left->clone(), right->clone());
         }
 
-        std::shared_ptr<Node<T>> differentiate(const std::string& variable) const override {
-            return std::make_shared<AddNode<T>>(
-                left->differentiate(variable),
-                right->differentiate(variable)
-            );
+        std::shared_ptr<Node<T>> derivative(Differentiation<T>& d) const override {
+            return d.factory().add(d(left), d(right));
         }
 
         std::shared_ptr<Node<T>> substitute(const std::string& variable, const T& value) const override {
@@ -138,6 +198,18 @@ namespace ExpressionLibrary {
         MultiplyNode(std::shared_ptr<Node<T>> left, std::shared_ptr<Node<T>> right)
             : left(left), right(right) {}
 
+        NodeKind kind() const override {
+            return NodeKind::Multiply;
+        }
+
+        std::size_t arity() const override {
+            return 2;
+        }
+
+        const std::shared_ptr<Node<T>>& operand(std::size_t index) const override {
+            return index == 0 ? left : right;
+        }
+
         T evaluate(const std::map<std::string, T>& variables) const override {
             return left->evaluate(variables) * right->evaluate(variables);
         }
@@ -150,11 +222,9 @@ namespace ExpressionLibrary {
             return std::make_shared<MultiplyNode<T>>(left->clone(), right->clone());
         }
 
-        std::shared_ptr<Node<T>> differentiate(const std::string& variable) const override {
-            return std::make_shared<AddNode<T>>(
-                std::make_shared<MultiplyNode<T>>(left->differentiate(variable), right->clone()),
-                std::make_shared<MultiplyNode<T>>(left->clone(), right->differentiate(variable))
-            );
+        std::shared_ptr<Node<T>> derivative(Differentiation<T>& d) const override {
+            auto& f = d.factory();
+            return f.add(f.multiply(d(left), right), f.multiply(left, d(right)));
         }
 
         std::shared_ptr<Node<T>> substitute(const std::string& variable, const T& value) const override {
@@ -171,6 +241,18 @@ namespace ExpressionLibrary {
 
         SinNode(std::shared_ptr<Node<T>> arg) : arg(arg) {}
 
+        NodeKind kind() const override {
+            return NodeKind::Sin;
+        }
+
+        std::size_t arity() const override {
+            return 1;
+        }
+
+        const std::shared_ptr<Node<T>>& operand(std::size_t) const override {
+            return arg;
+        }
+
         T evaluate(const std::map<std::string, T>& variables) const override {
             return std::sin(arg->evaluate(variables));
         }
@@ -183,11 +265,9 @@ namespace ExpressionLibrary {
             return std::make_shared<SinNode<T>>(arg->clone());
         }
 
-        std::shared_ptr<Node<T>> differentiate(const std::string& variable) const override {
-            return std::make_shared<MultiplyNode<T>>(
-                std::make_shared<CosNode<T>>(arg->clone()),
-                arg->differentiate(variable)
-            );
+        std::shared_ptr<Node<T>> derivative(Differentiation<T>& d) const override {
+            auto& f = d.factory();
+            return f.multiply(f.cos(arg), d(arg));
         }
 
         std::shared_ptr<Node<T>> substitute(const std::string& variable, const T& value) const override {
@@ -201,6 +281,18 @@ namespace ExpressionLibrary {
 
         CosNode(std::shared_ptr<Node<T>> arg) : arg(arg) {}
 
+        NodeKind kind() const override {
+            return NodeKind::Cos;
+        }
+
+        std::size_t arity() const override {
+            return 1;
+        }
+
+        const std::shared_ptr<Node<T>>& operand(std::size_t) const override {
+            return arg;
+        }
+
         T evaluate(const std::map<std::string, T>& variables) const override {
             return std::cos(arg->evaluate(variables));
         }
@@ -213,11 +305,9 @@ namespace ExpressionLibrary {
             return std::make_shared<CosNode<T>>(arg->clone());
         }
 
-        std::shared_ptr<Node<T>> differentiate(const std::string& variable) const override {
-            return std::make_shared<MultiplyNode<T>>(
-                std::make_shared<NegateNode<T>>(std::make_shared<SinNode<T>>(arg->clone())),
-                arg->differentiate(variable)
-            );
+        std::shared_ptr<Node<T>> derivative(Differentiation<T>& d) const override {
+            auto& f = d.factory();
+            return f.multiply(f.negate(f.sin(arg)), d(arg));
         }
 
         std::shared_ptr<Node<T>> substitute(const std::string& variable, const T& value) const override {
@@ -232,6 +322,18 @@ namespace ExpressionLibrary {
         SubtractNode(std::shared_ptr<Node<T>> left, std::shared_ptr<Node<T>> right)
             : left(left), right(right) {}
 
+        NodeKind kind() const override {
+            return NodeKind::Subtract;
+        }
+
+        std::size_t arity() const override {
+            return 2;
+        }
+
+        const std::shared_ptr<Node<T>>& operand(std::size_t index) const override {
+            return index == 0 ? left : right;
+        }
+
         T evaluate(const std::map<std::string, T>& variables) const override {
             return left->evaluate(variables) - right->evaluate(variables);
         }
@@ -244,11 +346,8 @@ namespace ExpressionLibrary {
             return std::make_shared<SubtractNode<T>>(left->clone(), right->clone());
         }
 
-        std::shared_ptr<Node<T>> differentiate(const std::string& variable) const override {
-            return std::make_shared<SubtractNode<T>>(
-                left->differentiate(variable),
-                right->differentiate(variable)
-            );
+        std::shared_ptr<Node<T>> derivative(Differentiation<T>& d) const override {
+            return d.factory().subtract(d(left), d(right));
         }
 
         std::shared_ptr<Node<T>> substitute(const std::string& variable, const T& value) const override {
@@ -266,6 +365,18 @@ namespace ExpressionLibrary {
         DivideNode(std::shared_ptr<Node<T>> left, std::shared_ptr<Node<T>> right)
             : left(left), right(right) {}
 
+        NodeKind kind() const override {
+            return NodeKind::Divide;
+        }
+
+        std::size_t arity() const override {
+            return 2;
+        }
+
+        const std::shared_ptr<Node<T>>& operand(std::size_t index) const override {
+            return index == 0 ? left : right;
+        }
+
         T evaluate(const std::map<std::string, T>& variables) const override {
             return left->evaluate(variables) / right->evaluate(variables);
         }
@@ -278,13 +389,11 @@ namespace ExpressionLibrary {
             return std::make_shared<DivideNode<T>>(left->clone(), right->clone());
         }
 
-        std::shared_ptr<Node<T>> differentiate(const std::string& variable) const override {
-            return std::make_shared<DivideNode<T>>(
-                std::make_shared<SubtractNode<T>>(
-                    std::make_shared<MultiplyNode<T>>(left->differentiate(variable), right->clone()),
-                    std::make_shared<MultiplyNode<T>>(left->clone(), right->differentiate(variable))
-                ),
-                std::make_shared<PowerNode<T>>(right->clone(), std::make_shared<ConstNode<T>>(2))
+        std::shared_ptr<Node<T>> derivative(Differentiation<T>& d) const override {
+            auto& f = d.factory();
+            return f.divide(
+                f.subtract(f.multiply(d(left), right), f.multiply(left, d(right))),
+                f.power(right, f.constant(T(2)))
             );
         }
 
@@ -296,6 +405,92 @@ namespace ExpressionLibrary {
         }
     };
 
+    // x ^ c for a constant c that is an integer or half an odd integer with
+    // |c| <= MaxExponent: repeated squaring, then a square root for the
+    // half, then a reciprocal for negative c, instead of std::pow. Compiled
+    // programs emit the same operations, so trees and programs agree bit for
+    // bit. For real T the relative error against std::pow stays below
+    // (|c| + 2) epsilon, except where x ^ |c| overflows or underflows while
+    // x ^ c does not, and for -0 and -inf with a half-integer exponent,
+    // which follow sqrt.
+    template <typename T>
+    struct ConstantPower {
+        static constexpr unsigned MaxExponent = 16;
+
+        unsigned whole = 0;      // |c| rounded down
+        bool half = false;       // |c| - whole == 0.5
+        bool reciprocal = false; // c < 0
+
+        static std::optional<ConstantPower> of(const T& c) {
+            if (std::imag(c) != 0) {
+                return std::nullopt;
+            }
+            double twice = 2.0 * static_cast<double>(std::real(c));
+            if (!(std::fabs(twice) <= 2.0 * MaxExponent) || twice != std::floor(twice)) {
+                return std::nullopt;
+            }
+            auto n = static_cast<unsigned>(std::fabs(twice));
+            return ConstantPower{n / 2, n % 2 == 1, twice < 0};
+        }
+
+        // std::pow(x, c) unless c qualifies.
+        static T pow(const T& x, const T& c) {
+            if (auto power = of(c)) {
+                return (*power)(x);
+            }
+            return std::pow(x, c);
+        }
+
+        T operator()(const T& x) const {
+            if (whole == 0 && !half) {
+                return T(1);
+            }
+            T p = x;
+            for (int bit = std::bit_width(whole) - 2; bit >= 0; --bit) {
+                p = p * p;
+                if ((whole >> bit) & 1) {
+                    p = p * x;
+                }
+            }
+            if (half) {
+                p = whole > 0 ? p * std::sqrt(x) : std::sqrt(x);
+            }
+            if (reciprocal) {
+                p = T(1) / p;
+            }
+            return p;
+        }
+    };
+
+    // Whether node mentions no variable, so that it evaluates the same
+    // under any bindings.
+    template <typename T>
+    bool isVariableFree(const Node<T>& node) {
+        if (node.kind() == NodeKind::Var) {
+            return false;
+        }
+        for (std::size_t i = 0; i < node.arity(); ++i) {
+            if (!isVariableFree(*node.operand(i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The value of a node that mentions no variable: a constant, a negated
+    // constant as the parser builds "-2", or an exponent like "3 - 1" that
+    // differentiate builds. Null for any node that reads a variable.
+    template <typename T>
+    std::optional<T> constantValue(const Node<T>& node) {
+        if (node.kind() == NodeKind::Const) {
+            return static_cast<const ConstNode<T>&>(node).value;
+        }
+        if (!isVariableFree(node)) {
+            return std::nullopt;
+        }
+        return node.evaluate({});
+    }
+
     template <typename T>
     struct PowerNode : public Node<T> {
         std::shared_ptr<Node<T>> base, exponent;
@@ -303,7 +498,22 @@ namespace ExpressionLibrary {
         PowerNode(std::shared_ptr<Node<T>> base, std::shared_ptr<Node<T>> exponent)
             : base(base), exponent(exponent) {}
 
+        NodeKind kind() const override {
+            return NodeKind::Power;
+        }
+
+        std::size_t arity() const override {
+            return 2;
+        }
+
+        const std::shared_ptr<Node<T>>& operand(std::size_t index) const override {
+            return index == 0 ? base : exponent;
+        }
+
         T evaluate(const std::map<std::string, T>& variables) const override {
+            if (auto c = constantValue(*exponent)) {
+                return ConstantPower<T>::pow(base->evaluate(variables), *c);
+            }
             return std::pow(base->evaluate(variables), exponent->evaluate(variables));
         }
 
@@ -315,17 +525,19 @@ namespace ExpressionLibrary {
             return std::make_shared<PowerNode<T>>(base->clone(), exponent->clone());
         }
 
-        std::shared_ptr<Node<T>> differentiate(const std::string& variable) const override {
-            return std::make_shared<MultiplyNode<T>>(
-                std::make_shared<MultiplyNode<T>>(
-                    exponent->clone(),
-                    std::make_shared<PowerNode<T>>(
-                        base->clone(),
-                        std::make_shared<SubtractNode<T>>(exponent->clone(), std::make_shared<ConstNode<T>>(1))
-                    )
-                ),
-                base->differentiate(variable)
+        // With an exponent that reads the variable, d(b ^ e) gains the term
+        // b ^ e * ln(b) * d(e); otherwise it is left out, since ln(b) would
+        // turn a zero into NaN for a negative base.
+        std::shared_ptr<Node<T>> derivative(Differentiation<T>& d) const override {
+            auto& f = d.factory();
+            auto byBase = f.multiply(
+                f.multiply(exponent, f.power(base, f.subtract(exponent, f.constant(T(1))))),
+                d(base)
             );
+            if (!d.depends(*exponent)) {
+                return byBase;
+            }
+            return f.add(byBase, f.multiply(f.multiply(f.power(base, exponent), f.ln(base)), d(exponent)));
         }
 
         std::shared_ptr<Node<T>> substitute(const std::string& variable, const T& value) const override {
@@ -342,6 +554,18 @@ namespace ExpressionLibrary {
 
         LnNode(std::shared_ptr<Node<T>> arg) : arg(arg) {}
 
+        NodeKind kind() const override {
+            return NodeKind::Ln;
+        }
+
+        std::size_t arity() const override {
+            return 1;
+        }
+
+        const std::shared_ptr<Node<T>>& operand(std::size_t) const override {
+            return arg;
+        }
+
         T evaluate(const std::map<std::string, T>& variables) const override {
             return std::log(arg->evaluate(variables));
         }
@@ -354,11 +578,8 @@ namespace ExpressionLibrary {
             return std::make_shared<LnNode<T>>(arg->clone());
         }
 
-        std::shared_ptr<Node<T>> differentiate(const std::string& variable) const override {
-            return std::make_shared<DivideNode<T>>(
-                arg->differentiate(variable),
-                arg->clone()
-            );
+        std::shared_ptr<Node<T>> derivative(Differentiation<T>& d) const override {
+            return d.factory().divide(d(arg), arg);
         }
 
         std::shared_ptr<Node<T>> substitute(const std::string& variable, const T& value) const override {
@@ -372,6 +593,18 @@ namespace ExpressionLibrary {
 
         ExpNode(std::shared_ptr<Node<T>> arg) : arg(arg) {}
 
+        NodeKind kind() const override {
+            return NodeKind::Exp;
+        }
+
+        std::size_t arity() const override {
+            return 1;
+        }
+
+        const std::shared_ptr<Node<T>>& operand(std::size_t) const override {
+            return arg;
+        }
+
         T evaluate(const std::map<std::string, T>& variables) const override {
             return std::exp(arg->evaluate(variables));
         }
@@ -384,11 +617,9 @@ namespace ExpressionLibrary {
             return std::make_shared<ExpNode<T>>(arg->clone());
         }
 
-        std::shared_ptr<Node<T>> differentiate(const std::string& variable) const override {
-            return std::make_shared<MultiplyNode<T>>(
-                std::make_shared<ExpNode<T>>(arg->clone()),
-                arg->differentiate(variable)
-            );
+        std::shared_ptr<Node<T>> derivative(Differentiation<T>& d) const override {
+            auto& f = d.factory();
+            return f.multiply(f.exp(arg), d(arg));
         }
 
         std::shared_ptr<Node<T>> substitute(const std::string& variable, const T& value) const override {
@@ -402,6 +633,18 @@ namespace ExpressionLibrary {
 
         NegateNode(std::shared_ptr<Node<T>> arg) : arg(arg) {}
 
+        NodeKind kind() const override {
+            return NodeKind::Negate;
+        }
+
+        std::size_t arity() const override {
+            return 1;
+        }
+
+        const std::shared_ptr<Node<T>>& operand(std::size_t) const override {
+            return arg;
+        }
+
         T evaluate(const std::map<std::string, T>& variables) const override {
             return -arg->evaluate(variables);
         }
@@ -414,8 +657,8 @@ namespace ExpressionLibrary {
             return std::make_shared<NegateNode<T>>(arg->clone());
         }
 
-        std::shared_ptr<Node<T>> differentiate(const std::string& variable) const override {
-            return std::make_shared<NegateNode<T>>(arg->differentiate(variable));
+        std::shared_ptr<Node<T>> derivative(Differentiation<T>& d) const override {
+            return d.factory().negate(d(arg));
         }
 
         std::shared_ptr<Node<T>> substitute(const std::string& variable, const T& value) const override {
@@ -423,6 +666,502 @@ namespace ExpressionLibrary {
         }
     };
 
+
+    // Monotonic storage for nodes. Every node allocated from an arena holds a
+    // reference to it, so the arena is released in one shot when the last of
+    // its nodes is destroyed.
+    class NodeArena {
+    private:
+        std::mutex mutex;
+        std::pmr::monotonic_buffer_resource resource;
+        std::size_t used = 0;
+
+    public:
+        explicit NodeArena(std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+            : resource(upstream) {}
+
+        void* allocate(std::size_t bytes, std::size_t alignment) {
+            std::lock_guard<std::mutex> lock(mutex);
+            used += bytes;
+            return resource.allocate(bytes, alignment);
+        }
+
+        std::size_t bytes() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return used;
+        }
+    };
+
+    template <typename U>
+    struct ArenaAllocator {
+        using value_type = U;
+
+        std::shared_ptr<NodeArena> arena;
+
+        explicit ArenaAllocator(std::shared_ptr<NodeArena> arena) : arena(std::move(arena)) {}
+
+        template <typename V>
+        ArenaAllocator(const ArenaAllocator<V>& other) : arena(other.arena) {}
+
+        U* allocate(std::size_t n) {
+            return static_cast<U*>(arena->allocate(n * sizeof(U), alignof(U)));
+        }
+
+        void deallocate(U*, std::size_t) noexcept {}
+
+        template <typename V>
+        bool operator==(const ArenaAllocator<V>& other) const {
+            return arena == other.arena;
+        }
+    };
+
+    // Resource guards for one NodeFactory. maxNodes bounds the nodes it may
+    // allocate and maxDepth the depth of any node it returns, a lone leaf
+    // having depth 1. Either one being exceeded throws std::runtime_error
+    // before the offending node is allocated. The default depth keeps trees
+    // well inside what the recursive passes (ToString, differentiate,
+    // destruction) survive on an 8 MB stack, about 35000 levels for ToString.
+    struct NodeLimits {
+        static constexpr std::size_t DefaultMaxDepth = 10000;
+
+        std::size_t maxNodes = std::numeric_limits<std::size_t>::max();
+        std::size_t maxDepth = DefaultMaxDepth;
+    };
+
+    // Builds nodes with hash-consing: asking twice for the same kind, payload
+    // and operand pointers returns the same node, so structurally identical
+    // subtrees built through one factory are shared instead of copied.
+    template <typename T>
+    class NodeFactory {
+    private:
+        struct Key {
+            NodeKind kind;
+            const Node<T>* a;
+            const Node<T>* b;
+            T value;
+            std::string name;
+        };
+
+        // Constants are compared bitwise so 0 and -0 (and NaN payloads) stay distinct.
+        struct KeyHash {
+            std::size_t operator()(const Key& key) const {
+                std::size_t h = std::hash<int>()(static_cast<int>(key.kind));
+                auto mix = [&h](std::size_t v) { h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2); };
+                mix(std::hash<const Node<T>*>()(key.a));
+                mix(std::hash<const Node<T>*>()(key.b));
+                mix(std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(&key.value), sizeof(T))));
+                mix(std::hash<std::string>()(key.name));
+                return h;
+            }
+        };
+
+        struct KeyEqual {
+            bool operator()(const Key& l, const Key& r) const {
+                return l.kind == r.kind && l.a == r.a && l.b == r.b &&
+                       std::memcmp(&l.value, &r.value, sizeof(T)) == 0 && l.name == r.name;
+            }
+        };
+
+        std::shared_ptr<NodeArena> arena;
+        std::pmr::monotonic_buffer_resource scratch;
+        std::pmr::unordered_map<Key, std::shared_ptr<Node<T>>, KeyHash, KeyEqual> nodes{&scratch};
+
+        template <typename N, typename... Args>
+        std::shared_ptr<Node<T>> lookup(Key key, Args&&... args) {
+            auto it = nodes.find(key);
+            if (it != nodes.end()) {
+                return it->second;
+            }
+            if (++created > limits.maxNodes) {
+                throw std::runtime_error("Expression exceeds node limit");
+            }
+            std::shared_ptr<Node<T>> node = arena
+                ? std::allocate_shared<N>(ArenaAllocator<N>(arena), std::forward<Args>(args)...)
+                : std::make_shared<N>(std::forward<Args>(args)...);
+            nodes.emplace(std::move(key), node);
+            return node;
+        }
+
+        static const ConstNode<T>* asConst(const std::shared_ptr<Node<T>>& node) {
+            return node && node->kind() == NodeKind::Const ? static_cast<const ConstNode<T>*>(node.get()) : nullptr;
+        }
+
+        static bool isValue(const std::shared_ptr<Node<T>>& node, int value) {
+            const ConstNode<T>* c = asConst(node);
+            return c && c->value == T(value);
+        }
+
+        static bool isNegativeZero(const std::shared_ptr<Node<T>>& node) {
+            const ConstNode<T>* c = asConst(node);
+            if constexpr (std::is_arithmetic_v<T>) {
+                return c && c->value == T(0) && std::signbit(c->value);
+            } else {
+                return c && c->value == T(0) && std::signbit(std::real(c->value)) && std::signbit(std::imag(c->value));
+            }
+        }
+
+        static int rank(NodeKind kind) {
+            return kind == NodeKind::Const ? 0 : kind == NodeKind::Var ? 1 : 2 + static_cast<int>(kind);
+        }
+
+        // Total structural order used to put commutative operands in a
+        // canonical position: constants first, then variables by name, then
+        // operators by kind and operands.
+        static int compare(const Node<T>* a, const Node<T>* b) {
+            if (a == b) return 0;
+            if (rank(a->kind()) != rank(b->kind())) return rank(a->kind()) < rank(b->kind()) ? -1 : 1;
+            if (a->kind() == NodeKind::Const) {
+                const T& x = static_cast<const ConstNode<T>*>(a)->value;
+                const T& y = static_cast<const ConstNode<T>*>(b)->value;
+                if (std::real(x) != std::real(y)) return std::real(x) < std::real(y) ? -1 : 1;
+                if (std::imag(x) != std::imag(y)) return std::imag(x) < std::imag(y) ? -1 : 1;
+                return 0;
+            }
+            if (a->kind() == NodeKind::Var) {
+                return static_cast<const VarNode<T>*>(a)->name.compare(static_cast<const VarNode<T>*>(b)->name);
+            }
+            for (std::size_t i = 0; i < a->arity(); ++i) {
+                int c = compare(a->operand(i).get(), b->operand(i).get());
+                if (c != 0) return c;
+            }
+            return 0;
+        }
+
+        static T fold(NodeKind kind, const T& a, const T& b) {
+            switch (kind) {
+                case NodeKind::Add:      return a + b;
+                case NodeKind::Subtract: return a - b;
+                case NodeKind::Multiply: return a * b;
+                case NodeKind::Divide:   return a / b;
+                case NodeKind::Power:    return ConstantPower<T>::pow(a, b);
+                case NodeKind::Sin:      return std::sin(a);
+                case NodeKind::Cos:      return std::cos(a);
+                case NodeKind::Ln:       return std::log(a);
+                case NodeKind::Exp:      return std::exp(a);
+                case NodeKind::Negate:   return -a;
+                default: break;
+            }
+            throw std::invalid_argument("Node kind has no operands");
+        }
+
+        // Returns a replacement node, or null after possibly reordering the
+        // operands of a commutative kind. x * 0 folds to 0 even when x is
+        // NaN or infinite.
+        std::shared_ptr<Node<T>> rewrite(NodeKind kind, std::shared_ptr<Node<T>>& a, std::shared_ptr<Node<T>>& b) {
+            const ConstNode<T>* ca = asConst(a);
+            const ConstNode<T>* cb = asConst(b);
+            if (ca && (!b || cb)) {
+                return constant(fold(kind, ca->value, cb ? cb->value : T(0)));
+            }
+            switch (kind) {
+                case NodeKind::Add:
+                    if (isValue(a, 0)) return b;
+                    if (isValue(b, 0)) return a;
+                    if (compare(b.get(), a.get()) < 0) std::swap(a, b);
+                    break;
+                case NodeKind::Subtract:
+                    if (isValue(b, 0)) return a;
+                    // 0 - x is +0 where -x is -0; only -0 - x is exactly -x.
+                    if (isNegativeZero(a)) return negate(b);
+                    break;
+                case NodeKind::Multiply:
+                    if (isValue(a, 0) || isValue(b, 0)) return constant(T(0));
+                    if (isValue(a, 1)) return b;
+                    if (isValue(b, 1)) return a;
+                    if (compare(b.get(), a.get()) < 0) std::swap(a, b);
+                    break;
+                case NodeKind::Divide:
+                    if (isValue(b, 1)) return a;
+                    break;
+                case NodeKind::Power:
+                    if (isValue(b, 1)) return a;
+                    if (isValue(b, 0)) return constant(T(1));
+                    break;
+                case NodeKind::Negate:
+                    if (a->kind() == NodeKind::Negate) return a->operand(0);
+                    break;
+                case NodeKind::Ln:
+                    if constexpr (std::is_arithmetic_v<T>) {
+                        if (a->kind() == NodeKind::Exp) return a->operand(0);
+                    }
+                    break;
+                default:
+                    break;
+            }
+            return nullptr;
+        }
+
+        // Depths are only tracked under a finite maxDepth. Nodes built by
+        // this factory record theirs; others are measured once.
+        std::size_t depth(const Node<T>* root) {
+            auto known = depths.find(root);
+            if (known != depths.end()) {
+                return known->second;
+            }
+            if (root->arity() == 0) {
+                depths.emplace(root, 1);
+                return 1;
+            }
+            std::pmr::vector<std::pair<const Node<T>*, bool>> stack{{{root, false}}, &scratch};
+            while (!stack.empty()) {
+                auto [node, expanded] = stack.back();
+                stack.pop_back();
+                if (depths.count(node)) {
+                    continue;
+                }
+                if (!expanded && node->arity() > 0) {
+                    stack.push_back({node, true});
+                    for (std::size_t i = 0; i < node->arity(); ++i) {
+                        stack.push_back({node->operand(i).get(), false});
+                    }
+                    continue;
+                }
+                std::size_t d = 0;
+                for (std::size_t i = 0; i < node->arity(); ++i) {
+                    d = std::max(d, depths.at(node->operand(i).get()));
+                }
+                depths.emplace(node, d + 1);
+            }
+            return depths.at(root);
+        }
+
+        std::shared_ptr<Node<T>> build(NodeKind kind, std::shared_ptr<Node<T>> a, std::shared_ptr<Node<T>> b) {
+            if (simplifying) {
+                if (auto replacement = rewrite(kind, a, b)) {
+                    return replacement;
+                }
+            }
+            std::size_t level = 0;
+            if (limits.maxDepth != std::numeric_limits<std::size_t>::max()) {
+                level = 1 + std::max(depth(a.get()), b ? depth(b.get()) : 0);
+                if (level > limits.maxDepth) {
+                    throw std::runtime_error("Expression exceeds depth limit");
+                }
+            }
+            Key key{kind, a.get(), b.get(), T(0), {}};
+            std::shared_ptr<Node<T>> node;
+            switch (kind) {
+                case NodeKind::Add:      node = lookup<AddNode<T>>(std::move(key), a, b); break;
+                case NodeKind::Subtract: node = lookup<SubtractNode<T>>(std::move(key), a, b); break;
+                case NodeKind::Multiply: node = lookup<MultiplyNode<T>>(std::move(key), a, b); break;
+                case NodeKind::Divide:   node = lookup<DivideNode<T>>(std::move(key), a, b); break;
+                case NodeKind::Power:    node = lookup<PowerNode<T>>(std::move(key), a, b); break;
+                case NodeKind::Sin:      node = lookup<SinNode<T>>(std::move(key), a); break;
+                case NodeKind::Cos:      node = lookup<CosNode<T>>(std::move(key), a); break;
+                case NodeKind::Ln:       node = lookup<LnNode<T>>(std::move(key), a); break;
+                case NodeKind::Exp:      node = lookup<ExpNode<T>>(std::move(key), a); break;
+                case NodeKind::Negate:   node = lookup<NegateNode<T>>(std::move(key), a); break;
+                default: break;
+            }
+            if (node) {
+                if (level) {
+                    depths.emplace(node.get(), level);
+                }
+                return node;
+            }
+            throw std::invalid_argument("Node kind has no operands");
+        }
+
+        bool simplifying;
+        NodeLimits limits;
+        std::size_t created = 0;
+        std::pmr::unordered_map<const Node<T>*, std::size_t> depths{&scratch};
+
+    public:
+        // With simplify set, every node built through the factory is constant
+        // folded and reduced by the identities x+0, x*1, x*0, x^1, x^0, --x
+        // and (for real T) ln(exp(x)); operands of + and * are put in
+        // canonical order.
+        // Nodes are allocated from arena when one is given. The factory's own
+        // lookup tables live in a scratch buffer released with the factory.
+        // Without limits the factory builds trees of any size and depth.
+        explicit NodeFactory(bool simplify = false, std::shared_ptr<NodeArena> arena = nullptr,
+                             NodeLimits limits = {std::numeric_limits<std::size_t>::max(),
+                                                  std::numeric_limits<std::size_t>::max()})
+            : arena(std::move(arena)), simplifying(simplify), limits(limits) {}
+
+        // Nodes allocated so far; shared and reused nodes are not counted.
+        std::size_t allocated() const { return created; }
+
+        // Applies limits to the nodes built from now on, restarting the count.
+        void restrict(NodeLimits limits) {
+            this->limits = limits;
+            created = 0;
+        }
+
+        // Throws if root is deeper than maxDepth, measuring it without
+        // recursion so that recursive passes over root are safe afterwards.
+        void checkDepth(const std::shared_ptr<Node<T>>& root) {
+            if (limits.maxDepth != std::numeric_limits<std::size_t>::max() && depth(root.get()) > limits.maxDepth) {
+                throw std::runtime_error("Expression exceeds depth limit");
+            }
+        }
+
+        std::pmr::memory_resource* scratchResource() { return &scratch; }
+
+        std::shared_ptr<Node<T>> constant(const T& value) {
+            return lookup<ConstNode<T>>(Key{NodeKind::Const, nullptr, nullptr, value, {}}, value);
+        }
+
+        std::shared_ptr<Node<T>> variable(const std::string& name) {
+            return lookup<VarNode<T>>(Key{NodeKind::Var, nullptr, nullptr, T(0), name}, name);
+        }
+
+        std::shared_ptr<Node<T>> add(const std::shared_ptr<Node<T>>& a, const std::shared_ptr<Node<T>>& b) {
+            return build(NodeKind::Add, a, b);
+        }
+
+        std::shared_ptr<Node<T>> subtract(const std::shared_ptr<Node<T>>& a, const std::shared_ptr<Node<T>>& b) {
+            return build(NodeKind::Subtract, a, b);
+        }
+
+        std::shared_ptr<Node<T>> multiply(const std::shared_ptr<Node<T>>& a, const std::shared_ptr<Node<T>>& b) {
+            return build(NodeKind::Multiply, a, b);
+        }
+
+        std::shared_ptr<Node<T>> divide(const std::shared_ptr<Node<T>>& a, const std::shared_ptr<Node<T>>& b) {
+            return build(NodeKind::Divide, a, b);
+        }
+
+        std::shared_ptr<Node<T>> power(const std::shared_ptr<Node<T>>& a, const std::shared_ptr<Node<T>>& b) {
+            return build(NodeKind::Power, a, b);
+        }
+
+        std::shared_ptr<Node<T>> sin(const std::shared_ptr<Node<T>>& a) {
+            return build(NodeKind::Sin, a, nullptr);
+        }
+
+        std::shared_ptr<Node<T>> cos(const std::shared_ptr<Node<T>>& a) {
+            return build(NodeKind::Cos, a, nullptr);
+        }
+
+        std::shared_ptr<Node<T>> ln(const std::shared_ptr<Node<T>>& a) {
+            return build(NodeKind::Ln, a, nullptr);
+        }
+
+        std::shared_ptr<Node<T>> exp(const std::shared_ptr<Node<T>>& a) {
+            return build(NodeKind::Exp, a, nullptr);
+        }
+
+        std::shared_ptr<Node<T>> negate(const std::shared_ptr<Node<T>>& a) {
+            return build(NodeKind::Negate, a, nullptr);
+        }
+
+        // Rebuilds an operator node of the given kind; b is ignored for unary kinds.
+        std::shared_ptr<Node<T>> make(NodeKind kind, const std::shared_ptr<Node<T>>& a, const std::shared_ptr<Node<T>>& b) {
+            return build(kind, a, b);
+        }
+
+        // Returns the shared DAG equivalent of an arbitrary tree.
+        std::shared_ptr<Node<T>> intern(const std::shared_ptr<Node<T>>& root) {
+            return rebuild(root, [this](const Node<T>& leaf) {
+                return leaf.kind() == NodeKind::Const
+                    ? constant(static_cast<const ConstNode<T>&>(leaf).value)
+                    : variable(static_cast<const VarNode<T>&>(leaf).name);
+            });
+        }
+
+        // Replaces a variable by a constant. Subtrees that do not mention the
+        // variable are returned as they are rather than copied.
+        std::shared_ptr<Node<T>> substitute(const std::shared_ptr<Node<T>>& root, const std::string& name, const T& value) {
+            return rebuild(root, [&](const Node<T>& leaf) -> std::shared_ptr<Node<T>> {
+                if (leaf.kind() == NodeKind::Var && static_cast<const VarNode<T>&>(leaf).name == name) {
+                    return constant(value);
+                }
+                return nullptr;
+            });
+        }
+
+    private:
+        // Bottom-up, memoized reconstruction of root through this factory.
+        // leaf maps a Const/Var node to its replacement (null keeps it).
+        template <typename Leaf>
+        std::shared_ptr<Node<T>> rebuild(const std::shared_ptr<Node<T>>& root, Leaf leaf) {
+            std::pmr::unordered_map<const Node<T>*, std::shared_ptr<Node<T>>> done{&scratch};
+            std::pmr::vector<std::pair<const std::shared_ptr<Node<T>>*, bool>> stack{{{&root, false}}, &scratch};
+            while (!stack.empty()) {
+                auto [ptr, expanded] = stack.back();
+                stack.pop_back();
+                const Node<T>* node = ptr->get();
+                if (done.count(node)) {
+                    continue;
+                }
+                if (!expanded && node->arity() > 0) {
+                    stack.push_back({ptr, true});
+                    for (std::size_t i = 0; i < node->arity(); ++i) {
+                        stack.push_back({&node->operand(i), false});
+                    }
+                    continue;
+                }
+                std::shared_ptr<Node<T>> result;
+                if (node->arity() == 0) {
+                    result = leaf(*node);
+                    if (!result) {
+                        result = *ptr;
+                    }
+                } else {
+                    const auto& a = done.at(node->operand(0).get());
+                    const auto& b = node->arity() == 2 ? done.at(node->operand(1).get()) : nullptr;
+                    bool unchanged = a == node->operand(0) && (node->arity() == 1 || b == node->operand(1));
+                    Key key{node->kind(), a.get(), b ? b.get() : nullptr, T(0), {}};
+                    if (unchanged && !simplifying && !nodes.count(key)) {
+                        nodes.emplace(key, *ptr);
+                    }
+                    result = make(node->kind(), a, b);
+                }
+                done.emplace(node, result);
+            }
+            return done.at(root.get());
+        }
+    };
+
+    // Differentiation state for one variable. Derivatives are memoized per
+    // node, so a DAG is differentiated once per distinct node rather than
+    // once per path.
+    template <typename T>
+    class Differentiation {
+    private:
+        NodeFactory<T>& nodes;
+        std::string var;
+        std::pmr::unordered_map<const Node<T>*, std::shared_ptr<Node<T>>> memo;
+        std::pmr::unordered_map<const Node<T>*, bool> mentions;
+
+    public:
+        Differentiation(NodeFactory<T>& factory, const std::string& variable)
+            : nodes(factory), var(variable), memo(factory.scratchResource()), mentions(factory.scratchResource()) {}
+
+        NodeFactory<T>& factory() { return nodes; }
+        const std::string& variable() const { return var; }
+
+        std::shared_ptr<Node<T>> operator()(const std::shared_ptr<Node<T>>& node) {
+            auto it = memo.find(node.get());
+            if (it != memo.end()) {
+                return it->second;
+            }
+            auto result = node->derivative(*this);
+            memo.emplace(node.get(), result);
+            return result;
+        }
+
+        // Whether node reads the variable, so that its derivative may be
+        // nonzero even where simplify would not fold it to 0.
+        bool depends(const Node<T>& node) {
+            if (node.kind() == NodeKind::Var) {
+                return static_cast<const VarNode<T>&>(node).name == var;
+            }
+            auto it = mentions.find(&node);
+            if (it != mentions.end()) {
+                return it->second;
+            }
+            bool result = false;
+            for (std::size_t i = 0; i < node.arity() && !result; ++i) {
+                result = depends(*node.operand(i));
+            }
+            mentions.emplace(&node, result);
+            return result;
+        }
+    };
+
 }
 
 #endif // NODE_H
\ No newline at end of file
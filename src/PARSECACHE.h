@@ -0,0 +1,138 @@
+#ifndef PARSECACHE_H
+#define PARSECACHE_H
+
+#include <cstddef>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "EXPRESSION.h"
+
+namespace ExpressionLibrary {
+
+    // Bounded, thread-safe LRU cache of parsed and compiled formulas keyed on
+    // the exact input text. Entries are evicted least recently used first
+    // once either maxEntries or maxBytes is exceeded; an entry's bytes are
+    // its key, Expression::stats().bytes of its graph and the vectors of its
+    // program. The program is the one the expression evaluates through, so
+    // it is held once. A hit costs one hash lookup under the cache lock and
+    // hands out the shared immutable graph or program, never a copy.
+    template <typename T>
+    class ParseCache {
+    public:
+        struct Counters {
+            std::size_t hits = 0;
+            std::size_t misses = 0;
+            std::size_t evictions = 0;
+            std::size_t entries = 0;
+            std::size_t bytes = 0;
+        };
+
+        explicit ParseCache(std::size_t maxEntries,
+                            std::size_t maxBytes = std::numeric_limits<std::size_t>::max(),
+                            ParseLimits limits = {})
+            : maxEntries(maxEntries), maxBytes(maxBytes), limits(limits) {}
+
+        ParseCache(const ParseCache&) = delete;
+        ParseCache& operator=(const ParseCache&) = delete;
+
+        Expression<T> parse(std::string_view formula) {
+            return find(formula)->expression;
+        }
+
+        std::shared_ptr<const Program<T>> compile(std::string_view formula) {
+            return find(formula)->program;
+        }
+
+        Counters counters() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            Counters result = stats;
+            result.entries = entries.size();
+            return result;
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(mutex);
+            index.clear();
+            entries.clear();
+            stats.bytes = 0;
+        }
+
+    private:
+        struct Entry {
+            std::string key;
+            Expression<T> expression;
+            std::shared_ptr<const Program<T>> program;
+            std::size_t bytes;
+        };
+
+        using Iterator = typename std::list<std::shared_ptr<const Entry>>::iterator;
+
+        std::size_t maxEntries;
+        std::size_t maxBytes;
+        ParseLimits limits;
+        mutable std::mutex mutex;
+        // Most recently used first; index keys view the entries' own keys.
+        std::list<std::shared_ptr<const Entry>> entries;
+        std::unordered_map<std::string_view, Iterator> index;
+        Counters stats;
+
+        // Instructions are held twice, as register code and as the SSA tape.
+        static std::size_t footprint(std::string_view formula, const Expression<T>& expression, const Program<T>& program) {
+            std::size_t bytes = formula.size() + expression.stats().bytes
+                + 2 * program.instructions().size() * sizeof(Instruction)
+                + program.constantPool().size() * sizeof(T);
+            for (const auto& name : program.variables()) {
+                bytes += sizeof(std::string) + name.size();
+            }
+            return bytes;
+        }
+
+        std::shared_ptr<const Entry> find(std::string_view formula) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = index.find(formula);
+                if (it != index.end()) {
+                    ++stats.hits;
+                    entries.splice(entries.begin(), entries, it->second);
+                    return *it->second;
+                }
+                ++stats.misses;
+            }
+
+            // Parse outside the lock so a slow miss does not stall hits; if
+            // another thread inserted the same formula meanwhile, theirs wins.
+            Expression<T> expression = Expression<T>::Parse(formula, nullptr, limits);
+            expression.compiled();
+            std::shared_ptr<const Program<T>> program = expression.program.load();
+            std::size_t bytes = footprint(formula, expression, *program);
+            auto entry = std::make_shared<const Entry>(Entry{std::string(formula), expression, program, bytes});
+
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = index.find(formula);
+            if (it != index.end()) {
+                return *it->second;
+            }
+            if (maxEntries == 0 || bytes > maxBytes) {
+                return entry;
+            }
+            entries.push_front(entry);
+            index.emplace(entry->key, entries.begin());
+            stats.bytes += bytes;
+            while (entries.size() > maxEntries || stats.bytes > maxBytes) {
+                const Entry& victim = *entries.back();
+                stats.bytes -= victim.bytes;
+                index.erase(victim.key);
+                entries.pop_back();
+                ++stats.evictions;
+            }
+            return entry;
+        }
+    };
+
+}
+
+#endif // PARSECACHE_H
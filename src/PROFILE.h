@@ -0,0 +1,209 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "EXPRESSION.h"
+
+namespace ExpressionLibrary {
+
+    // Instrumented evaluation of an expression: per distinct node, the
+    // number of times it was computed, the time spent in it with and without
+    // its operands, and how often its value came out NaN or infinite. Like
+    // the compiled evaluate, a counting pass computes each distinct node once
+    // per repetition, in post-order, and keeps its operand values; a timing
+    // pass then replays every node's own operation once per repetition on
+    // those operands under a single clock read, so the times leave out the
+    // profiler's bookkeeping. The operands are the same in every repetition,
+    // so replaying the last ones is exact. This runs on its own code path:
+    // expressions that are not profiled pay nothing.
+    template <typename T>
+    class EvaluationProfile {
+    public:
+        using Clock = std::chrono::steady_clock;
+        using Nanoseconds = std::chrono::duration<double, std::nano>;
+
+        struct Entry {
+            std::shared_ptr<Node<T>> node;
+            std::vector<std::size_t> operands; // indices into entries()
+            std::uint64_t calls = 0;
+            std::uint64_t paths = 0;           // uses per evaluation of the tree walker, saturating
+            Nanoseconds total{0};              // including operands, a shared one once per use
+            Nanoseconds self{0};
+            std::uint64_t nans = 0;
+            std::uint64_t infinities = 0;
+        };
+
+        // Evaluates expression repetitions times with variables.
+        EvaluationProfile(const Expression<T>& expression, const std::map<std::string, T>& variables,
+                          std::size_t repetitions = 1)
+            : runs(repetitions) {
+            build(expression.root);
+            for (std::size_t i = 0; i < repetitions; ++i) {
+                result = count(variables);
+            }
+            time(variables);
+        }
+
+        // Post-order: operands precede their users and the root is last.
+        const std::vector<Entry>& entries() const { return nodes; }
+        const Entry& root() const { return nodes.back(); }
+
+        // The value of the last evaluation.
+        T value() const { return result; }
+        std::size_t repetitions() const { return runs; }
+
+        // Indices of the count entries with the largest self time, hottest
+        // first.
+        std::vector<std::size_t> hottest(std::size_t count) const {
+            std::vector<std::size_t> order(nodes.size());
+            for (std::size_t i = 0; i < order.size(); ++i) order[i] = i;
+            count = std::min(count, order.size());
+            std::partial_sort(order.begin(), order.begin() + count, order.end(), [&](std::size_t a, std::size_t b) {
+                return nodes[a].self > nodes[b].self;
+            });
+            order.resize(count);
+            return order;
+        }
+
+    private:
+        std::vector<Entry> nodes;
+        std::vector<std::array<T, 2>> inputs;
+        std::vector<T> values;
+        std::size_t runs;
+        T result{};
+        T sink{};
+
+        void build(const std::shared_ptr<Node<T>>& root) {
+            std::unordered_map<const Node<T>*, std::size_t> index;
+            std::vector<std::pair<const std::shared_ptr<Node<T>>*, bool>> stack{{&root, false}};
+            while (!stack.empty()) {
+                auto [node, expanded] = stack.back();
+                stack.pop_back();
+                if (index.count(node->get())) {
+                    continue;
+                }
+                if (!expanded) {
+                    stack.push_back({node, true});
+                    for (std::size_t i = (*node)->arity(); i-- > 0;) {
+                        stack.push_back({&(*node)->operand(i), false});
+                    }
+                    continue;
+                }
+                Entry entry;
+                entry.node = *node;
+                for (std::size_t i = 0; i < (*node)->arity(); ++i) {
+                    entry.operands.push_back(index.at((*node)->operand(i).get()));
+                }
+                index.emplace(node->get(), nodes.size());
+                nodes.push_back(std::move(entry));
+            }
+            inputs.resize(nodes.size());
+            values.resize(nodes.size());
+
+            // Users come after their operands, so walking backwards hands
+            // each node its users' paths before it passes its own on.
+            nodes.back().paths = 1;
+            for (std::size_t i = nodes.size(); i-- > 0;) {
+                for (std::size_t operand : nodes[i].operands) {
+                    std::uint64_t& paths = nodes[operand].paths;
+                    paths = nodes[i].paths > std::numeric_limits<std::uint64_t>::max() - paths
+                        ? std::numeric_limits<std::uint64_t>::max() : paths + nodes[i].paths;
+                }
+            }
+        }
+
+        static bool isNan(const T& v) {
+            return std::isnan(std::real(v)) || std::isnan(std::imag(v));
+        }
+
+        static bool isInfinite(const T& v) {
+            return std::isinf(std::real(v)) || std::isinf(std::imag(v));
+        }
+
+        T count(const std::map<std::string, T>& variables) {
+            for (std::size_t i = 0; i < nodes.size(); ++i) {
+                Entry& entry = nodes[i];
+                std::array<T, 2> operands{};
+                for (std::size_t k = 0; k < entry.operands.size(); ++k) {
+                    operands[k] = values[entry.operands[k]];
+                }
+                T value = apply(*entry.node, operands[0], operands[1], variables);
+                inputs[i] = operands;
+                values[i] = value;
+                ++entry.calls;
+                if (isNan(value)) {
+                    ++entry.nans;
+                } else if (isInfinite(value)) {
+                    ++entry.infinities;
+                }
+            }
+            return values.back();
+        }
+
+        // The signal fence keeps the compiler from hoisting the operation
+        // out of the loop.
+        void time(const std::map<std::string, T>& variables) {
+            Clock::duration clockCost = Clock::duration::max();
+            for (int i = 0; i < 64; ++i) {
+                auto start = Clock::now();
+                clockCost = std::min(clockCost, Clock::now() - start);
+            }
+            std::vector<Nanoseconds> perCall(nodes.size());
+            for (std::size_t i = 0; i < nodes.size(); ++i) {
+                Entry& entry = nodes[i];
+                auto start = Clock::now();
+                for (std::uint64_t c = 0; c < entry.calls; ++c) {
+                    std::atomic_signal_fence(std::memory_order_seq_cst);
+                    sink += apply(*entry.node, inputs[i][0], inputs[i][1], variables);
+                }
+                entry.self = std::max(Nanoseconds(0), Nanoseconds(Clock::now() - start - clockCost));
+                perCall[i] = entry.calls ? entry.self / double(entry.calls) : Nanoseconds(0);
+                for (std::size_t operand : entry.operands) {
+                    perCall[i] += perCall[operand];
+                }
+                entry.total = perCall[i] * double(entry.calls);
+            }
+        }
+
+        // Node::evaluate of node given its operand values.
+        static T apply(const Node<T>& node, const T& a, const T& b, const std::map<std::string, T>& variables) {
+            switch (node.kind()) {
+                case NodeKind::Const:
+                    return static_cast<const ConstNode<T>&>(node).value;
+                case NodeKind::Var:
+                    return node.evaluate(variables);
+                case NodeKind::Add:      return a + b;
+                case NodeKind::Subtract: return a - b;
+                case NodeKind::Multiply: return a * b;
+                case NodeKind::Divide:   return a / b;
+                case NodeKind::Power:
+                    if (auto c = constantValue(*node.operand(1))) {
+                        return ConstantPower<T>::pow(a, *c);
+                    }
+                    return std::pow(a, b);
+                case NodeKind::Sin:      return std::sin(a);
+                case NodeKind::Cos:      return std::cos(a);
+                case NodeKind::Ln:       return std::log(a);
+                case NodeKind::Exp:      return std::exp(a);
+                case NodeKind::Negate:   return -a;
+            }
+            throw std::runtime_error("Unknown node kind");
+        }
+    };
+
+}
+
+#endif // PROFILE_H
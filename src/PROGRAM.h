@@ -0,0 +1,885 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cmath>
+#include <complex>
+#include "NODE.h"
+#include "THREADPOOL.h"
+#include "VECMATH.h"
+
+namespace ExpressionLibrary {
+
+    template <typename T> class ProgramCompiler;
+
+    enum class OpCode : std::uint8_t {
+        Const,
+        Var,
+        Add,
+        Subtract,
+        Multiply,
+        Divide,
+        Power,
+        Sin,
+        Cos,
+        Ln,
+        Exp,
+        Negate,
+        Sqrt
+    };
+
+    // Registers are addressed by dst/a/b. For Const and Var, a is an index into
+    // the constant pool or the variable slots instead.
+    struct Instruction {
+        OpCode op;
+        std::uint32_t dst;
+        std::uint32_t a;
+        std::uint32_t b;
+    };
+
+    // sin, cos, ln and exp at an accuracy tier. Only double has
+    // approximations; other types always use the standard functions.
+    template <typename T>
+    struct MathFunctions {
+        static T sin(const T& x, MathAccuracy accuracy) {
+            if constexpr (std::is_same_v<T, double>) {
+                if (accuracy != MathAccuracy::Full) return VecMath::sin(x, accuracy);
+            }
+            return std::sin(x);
+        }
+
+        static T cos(const T& x, MathAccuracy accuracy) {
+            if constexpr (std::is_same_v<T, double>) {
+                if (accuracy != MathAccuracy::Full) return VecMath::cos(x, accuracy);
+            }
+            return std::cos(x);
+        }
+
+        static T log(const T& x, MathAccuracy accuracy) {
+            if constexpr (std::is_same_v<T, double>) {
+                if (accuracy != MathAccuracy::Full) return VecMath::log(x, accuracy);
+            }
+            return std::log(x);
+        }
+
+        static T exp(const T& x, MathAccuracy accuracy) {
+            if constexpr (std::is_same_v<T, double>) {
+                if (accuracy != MathAccuracy::Full) return VecMath::exp(x, accuracy);
+            }
+            return std::exp(x);
+        }
+    };
+
+    // Non-owning form of a program's register code: a Program's own storage
+    // or a formula mapped from a FormulaFile. The viewed storage must outlive
+    // the view.
+    template <typename T>
+    struct ProgramView {
+        static constexpr std::size_t InlineRegisters = 32;
+
+        std::span<const Instruction> code;
+        std::span<const T> constants;
+        std::uint32_t registers = 0;
+        std::uint32_t result = 0;
+        MathAccuracy accuracy = MathAccuracy::Full;
+
+        // values[i] is the value of variable slot i.
+        T evaluate(std::span<const T> values) const noexcept {
+            return run(values.data());
+        }
+
+        T run(const T* values) const noexcept {
+            if (registers <= InlineRegisters) {
+                std::array<T, InlineRegisters> r;
+                return run(values, r.data());
+            }
+            thread_local std::vector<T> spill;
+            if (spill.size() < registers) {
+                spill.resize(registers);
+            }
+            return run(values, spill.data());
+        }
+
+        T run(const T* values, T* r) const noexcept {
+            using M = MathFunctions<T>;
+            for (const Instruction& ins : code) {
+                switch (ins.op) {
+                    case OpCode::Const:    r[ins.dst] = constants[ins.a]; break;
+                    case OpCode::Var:      r[ins.dst] = values[ins.a]; break;
+                    case OpCode::Add:      r[ins.dst] = r[ins.a] + r[ins.b]; break;
+                    case OpCode::Subtract: r[ins.dst] = r[ins.a] - r[ins.b]; break;
+                    case OpCode::Multiply: r[ins.dst] = r[ins.a] * r[ins.b]; break;
+                    case OpCode::Divide:   r[ins.dst] = r[ins.a] / r[ins.b]; break;
+                    case OpCode::Power:    r[ins.dst] = std::pow(r[ins.a], r[ins.b]); break;
+                    case OpCode::Sin:      r[ins.dst] = M::sin(r[ins.a], accuracy); break;
+                    case OpCode::Cos:      r[ins.dst] = M::cos(r[ins.a], accuracy); break;
+                    case OpCode::Ln:       r[ins.dst] = M::log(r[ins.a], accuracy); break;
+                    case OpCode::Exp:      r[ins.dst] = M::exp(r[ins.a], accuracy); break;
+                    case OpCode::Negate:   r[ins.dst] = -r[ins.a]; break;
+                    case OpCode::Sqrt:     r[ins.dst] = std::sqrt(r[ins.a]); break;
+                }
+            }
+            return r[result];
+        }
+    };
+
+    // Flat, register-allocated form of an expression tree. Every distinct node
+    // (by address) is computed exactly once, so subtrees shared by pointer are
+    // not re-evaluated.
+    template <typename T>
+    class Program {
+    public:
+        static constexpr std::size_t InlineRegisters = ProgramView<T>::InlineRegisters;
+        static constexpr std::size_t BatchRows = 256;
+        static constexpr std::size_t DefaultChunkRows = 16384;
+
+        Program() = default;
+
+        // Copies view, whose code must be valid for variables.size() slots.
+        Program(ProgramView<T> view, std::vector<std::string> variables)
+            : code(view.code.begin(), view.code.end()),
+              constants(view.constants.begin(), view.constants.end()),
+              slots(std::move(variables)),
+              registerCount(view.registers),
+              result(view.result),
+              mathAccuracy(view.accuracy) {
+            buildTape();
+        }
+
+        static Program compile(const Node<T>& root);
+
+        // Compiles several roots into one program in which nodes shared
+        // between roots are computed once. outputs[k] receives the register
+        // that holds roots[k] once the program has run; the result register
+        // is the last root's.
+        static Program compile(std::span<const Node<T>* const> roots, std::vector<std::uint32_t>& outputs);
+
+        T evaluate(const std::map<std::string, T>& variables) const {
+            return run(lookup(variables).data());
+        }
+
+        // values[i] is the value of variables()[i]. Never allocates once the
+        // calling thread has evaluated a program of this register count.
+        T evaluate(std::span<const T> values) const noexcept {
+            return run(values.data());
+        }
+
+        // Returns a program whose variable slots follow names, so callers can
+        // keep their values in a flat array. Throws if a variable used by the
+        // expression is missing from names.
+        Program bind(const std::vector<std::string>& names) const {
+            std::unordered_map<std::string, std::uint32_t> position;
+            for (std::size_t i = 0; i < names.size(); ++i) {
+                position.emplace(names[i], static_cast<std::uint32_t>(i));
+            }
+            std::vector<std::uint32_t> remap;
+            remap.reserve(slots.size());
+            for (const auto& name : slots) {
+                auto it = position.find(name);
+                if (it == position.end()) {
+                    throw std::runtime_error("Variable " + name + " not bound");
+                }
+                remap.push_back(it->second);
+            }
+            Program bound = *this;
+            for (auto* instructions : {&bound.code, &bound.tape}) {
+                for (Instruction& ins : *instructions) {
+                    if (ins.op == OpCode::Var) {
+                        ins.a = remap[ins.a];
+                    }
+                }
+            }
+            bound.slots = names;
+            return bound;
+        }
+
+        T run(const T* values) const noexcept {
+            return view().run(values);
+        }
+
+        T run(const T* values, T* r) const noexcept {
+            return view().run(values, r);
+        }
+
+        // Column-major evaluation: columns[i] holds out.size() values of
+        // variables()[i]. Rows are processed in blocks so every instruction
+        // becomes a loop over BatchRows values; for double these run on the
+        // SIMD kernels in VECMATH.h, and for float on twice as many lanes.
+        void evaluate_batch(std::span<const T* const> columns, std::span<T> out) const {
+            checkColumns(columns);
+            runRows(columns, 0, out.size(), out);
+        }
+
+        // evaluate_batch split into chunks of chunkRows rows run on pool.
+        // chunkRows is rounded up to a multiple of BatchRows so every row is
+        // computed exactly as evaluate_batch would, whatever the pool size.
+        void evaluate_parallel(std::span<const T* const> columns, std::span<T> out,
+                               ThreadPool& pool, std::size_t chunkRows = DefaultChunkRows) const {
+            checkColumns(columns);
+            chunkRows = std::max<std::size_t>(1, (chunkRows + BatchRows - 1) / BatchRows) * BatchRows;
+            std::size_t chunks = (out.size() + chunkRows - 1) / chunkRows;
+            pool.run(chunks, [&](std::size_t chunk) {
+                std::size_t begin = chunk * chunkRows;
+                runRows(columns, begin, std::min(out.size(), begin + chunkRows), out);
+            });
+        }
+
+        // Sum of the batch results over rows: rows are evaluated in T, block
+        // by block, and added up in Accumulator. On a Program<float>,
+        // evaluate_sum<double> keeps float throughput without the rounding
+        // error of a float running sum.
+        template <typename Accumulator = T>
+        Accumulator evaluate_sum(std::span<const T* const> columns, std::size_t rows) const {
+            checkColumns(columns);
+            std::vector<T> block(static_cast<std::size_t>(registerCount) * BatchRows);
+            Accumulator sum(0);
+            for (std::size_t row = 0; row < rows; row += BatchRows) {
+                std::size_t n = std::min(BatchRows, rows - row);
+                runBlock(columns, row, n, block.data());
+                const T* out = block.data() + static_cast<std::size_t>(result) * BatchRows;
+                for (std::size_t i = 0; i < n; ++i) {
+                    sum += static_cast<Accumulator>(out[i]);
+                }
+            }
+            return sum;
+        }
+
+        // Reverse-mode differentiation: one forward sweep that keeps every
+        // intermediate value and one adjoint sweep, so the cost does not depend
+        // on the number of variables. gradient[i] receives d/d variables()[i].
+        // x ^ y uses the full rule, including the y * ln(x) term when the
+        // exponent is not a constant; constant integer and half-integer
+        // exponents were already lowered to the operations of ConstantPower.
+        T evaluate_with_gradient(std::span<const T> values, std::span<T> gradient) const {
+            thread_local std::vector<T> workspace;
+            if (workspace.size() < 2 * tape.size()) {
+                workspace.resize(2 * tape.size());
+            }
+            using M = MathFunctions<T>;
+            const MathAccuracy accuracy = mathAccuracy;
+            T* v = workspace.data();
+            T* adjoint = v + tape.size();
+            for (std::size_t i = 0; i < tape.size(); ++i) {
+                const Instruction& ins = tape[i];
+                switch (ins.op) {
+                    case OpCode::Const:    v[i] = constants[ins.a]; break;
+                    case OpCode::Var:      v[i] = values[ins.a]; break;
+                    case OpCode::Add:      v[i] = v[ins.a] + v[ins.b]; break;
+                    case OpCode::Subtract: v[i] = v[ins.a] - v[ins.b]; break;
+                    case OpCode::Multiply: v[i] = v[ins.a] * v[ins.b]; break;
+                    case OpCode::Divide:   v[i] = v[ins.a] / v[ins.b]; break;
+                    case OpCode::Power:    v[i] = std::pow(v[ins.a], v[ins.b]); break;
+                    case OpCode::Sin:      v[i] = M::sin(v[ins.a], accuracy); break;
+                    case OpCode::Cos:      v[i] = M::cos(v[ins.a], accuracy); break;
+                    case OpCode::Ln:       v[i] = M::log(v[ins.a], accuracy); break;
+                    case OpCode::Exp:      v[i] = M::exp(v[ins.a], accuracy); break;
+                    case OpCode::Negate:   v[i] = -v[ins.a]; break;
+                    case OpCode::Sqrt:     v[i] = std::sqrt(v[ins.a]); break;
+                }
+                adjoint[i] = T(0);
+            }
+            std::fill(gradient.begin(), gradient.end(), T(0));
+            adjoint[resultEntry] = T(1);
+            for (std::size_t i = resultEntry + 1; i-- > 0;) {
+                const Instruction& ins = tape[i];
+                const T g = adjoint[i];
+                switch (ins.op) {
+                    case OpCode::Const:
+                        break;
+                    case OpCode::Var:
+                        gradient[ins.a] += g;
+                        break;
+                    case OpCode::Add:
+                        adjoint[ins.a] += g;
+                        adjoint[ins.b] += g;
+                        break;
+                    case OpCode::Subtract:
+                        adjoint[ins.a] += g;
+                        adjoint[ins.b] -= g;
+                        break;
+                    case OpCode::Multiply:
+                        adjoint[ins.a] += g * v[ins.b];
+                        adjoint[ins.b] += g * v[ins.a];
+                        break;
+                    case OpCode::Divide:
+                        adjoint[ins.a] += g / v[ins.b];
+                        adjoint[ins.b] -= g * v[i] / v[ins.b];
+                        break;
+                    case OpCode::Power:
+                        adjoint[ins.a] += g * v[ins.b] * std::pow(v[ins.a], v[ins.b] - T(1));
+                        if (tape[ins.b].op != OpCode::Const) {
+                            adjoint[ins.b] += g * v[i] * M::log(v[ins.a], accuracy);
+                        }
+                        break;
+                    case OpCode::Sin:
+                        adjoint[ins.a] += g * M::cos(v[ins.a], accuracy);
+                        break;
+                    case OpCode::Cos:
+                        adjoint[ins.a] -= g * M::sin(v[ins.a], accuracy);
+                        break;
+                    case OpCode::Ln:
+                        adjoint[ins.a] += g / v[ins.a];
+                        break;
+                    case OpCode::Exp:
+                        adjoint[ins.a] += g * v[i];
+                        break;
+                    case OpCode::Negate:
+                        adjoint[ins.a] -= g;
+                        break;
+                    case OpCode::Sqrt:
+                        adjoint[ins.a] += g / (T(2) * v[i]);
+                        break;
+                }
+            }
+            return v[resultEntry];
+        }
+
+        // Forward-mode differentiation carrying tangents.size() tangents per
+        // register. directions holds that many vectors of variables().size()
+        // entries back to back; tangents[k] receives the derivative along
+        // direction k. Allocation-free once the thread's workspace is sized.
+        T evaluate_with_tangents(std::span<const T> values, std::span<const T> directions, std::span<T> tangents) const {
+            const std::size_t count = tangents.size();
+            const std::size_t stride = count + 1;
+            thread_local std::vector<T> workspace;
+            if (workspace.size() < registerCount * stride) {
+                workspace.resize(registerCount * stride);
+            }
+            using M = MathFunctions<T>;
+            const MathAccuracy accuracy = mathAccuracy;
+            T* r = workspace.data();
+            for (const Instruction& ins : code) {
+                T* d = r + ins.dst * stride;
+                const T* a = r + ins.a * stride;
+                const T* b = r + ins.b * stride;
+                const T va = ins.op == OpCode::Const || ins.op == OpCode::Var ? T(0) : a[0];
+                const T vb = ins.op == OpCode::Const || ins.op == OpCode::Var ? T(0) : b[0];
+                T v{};
+                switch (ins.op) {
+                    case OpCode::Const:
+                        v = constants[ins.a];
+                        for (std::size_t k = 0; k < count; ++k) d[k + 1] = T(0);
+                        break;
+                    case OpCode::Var:
+                        v = values[ins.a];
+                        for (std::size_t k = 0; k < count; ++k) d[k + 1] = directions[k * slots.size() + ins.a];
+                        break;
+                    case OpCode::Add:
+                        v = va + vb;
+                        for (std::size_t k = 1; k <= count; ++k) d[k] = a[k] + b[k];
+                        break;
+                    case OpCode::Subtract:
+                        v = va - vb;
+                        for (std::size_t k = 1; k <= count; ++k) d[k] = a[k] - b[k];
+                        break;
+                    case OpCode::Multiply:
+                        v = va * vb;
+                        for (std::size_t k = 1; k <= count; ++k) d[k] = a[k] * vb + va * b[k];
+                        break;
+                    case OpCode::Divide:
+                        v = va / vb;
+                        for (std::size_t k = 1; k <= count; ++k) d[k] = (a[k] - v * b[k]) / vb;
+                        break;
+                    case OpCode::Power: {
+                        v = std::pow(va, vb);
+                        const T slope = vb * std::pow(va, vb - T(1));
+                        // d may be b's register: read both tangents first.
+                        for (std::size_t k = 1; k <= count; ++k) {
+                            const T ta = a[k];
+                            const T tb = b[k];
+                            d[k] = slope * ta;
+                            if (tb != T(0)) {
+                                d[k] += v * M::log(va, accuracy) * tb;
+                            }
+                        }
+                        break;
+                    }
+                    case OpCode::Sin: {
+                        v = M::sin(va, accuracy);
+                        const T slope = M::cos(va, accuracy);
+                        for (std::size_t k = 1; k <= count; ++k) d[k] = slope * a[k];
+                        break;
+                    }
+                    case OpCode::Cos: {
+                        v = M::cos(va, accuracy);
+                        const T slope = -M::sin(va, accuracy);
+                        for (std::size_t k = 1; k <= count; ++k) d[k] = slope * a[k];
+                        break;
+                    }
+                    case OpCode::Ln:
+                        v = M::log(va, accuracy);
+                        for (std::size_t k = 1; k <= count; ++k) d[k] = a[k] / va;
+                        break;
+                    case OpCode::Exp:
+                        v = M::exp(va, accuracy);
+                        for (std::size_t k = 1; k <= count; ++k) d[k] = v * a[k];
+                        break;
+                    case OpCode::Negate:
+                        v = -va;
+                        for (std::size_t k = 1; k <= count; ++k) d[k] = -a[k];
+                        break;
+                    case OpCode::Sqrt:
+                        v = std::sqrt(va);
+                        for (std::size_t k = 1; k <= count; ++k) d[k] = a[k] / (T(2) * v);
+                        break;
+                }
+                d[0] = v;
+            }
+            const T* out = r + result * stride;
+            std::copy(out + 1, out + stride, tangents.begin());
+            return out[0];
+        }
+
+        // Value and derivative along direction; variables missing from
+        // direction have a zero tangent.
+        std::pair<T, T> evaluate_with_tangent(const std::map<std::string, T>& variables,
+                                              const std::map<std::string, T>& direction) const {
+            std::vector<T> values = lookup(variables);
+            std::vector<T> tangent(slots.size(), T(0));
+            for (std::size_t i = 0; i < slots.size(); ++i) {
+                auto it = direction.find(slots[i]);
+                if (it != direction.end()) {
+                    tangent[i] = it->second;
+                }
+            }
+            T derivative(0);
+            T value = evaluate_with_tangents(values, tangent, std::span<T>(&derivative, 1));
+            return {value, derivative};
+        }
+
+        std::pair<T, std::map<std::string, T>> evaluate_with_gradient(const std::map<std::string, T>& variables) const {
+            std::vector<T> values = lookup(variables);
+            std::vector<T> gradient(slots.size());
+            T value = evaluate_with_gradient(std::span<const T>(values), std::span<T>(gradient));
+            std::map<std::string, T> named;
+            for (std::size_t i = 0; i < slots.size(); ++i) {
+                named[slots[i]] = gradient[i];
+            }
+            return {value, named};
+        }
+
+        const std::vector<Instruction>& instructions() const { return code; }
+        const std::vector<T>& constantPool() const { return constants; }
+        const std::vector<std::string>& variables() const { return slots; }
+        std::uint32_t registers() const { return registerCount; }
+        std::uint32_t resultRegister() const { return result; }
+
+        // instructions() in SSA form, as the gradient sweep runs it: entry i
+        // computes value i and its operands index earlier entries.
+        const std::vector<Instruction>& tapeInstructions() const { return tape; }
+        std::uint32_t tapeResult() const { return resultEntry; }
+
+        MathAccuracy accuracy() const { return mathAccuracy; }
+
+        // Returns a copy whose sin, cos, ln and exp, derivatives included,
+        // run at the given tier; see MathAccuracy.
+        Program approximate(MathAccuracy accuracy) const {
+            Program approximated = *this;
+            approximated.mathAccuracy = accuracy;
+            return approximated;
+        }
+
+        ProgramView<T> view() const { return {code, constants, registerCount, result, mathAccuracy}; }
+
+    private:
+        friend class ProgramCompiler<T>;
+
+        std::vector<T> lookup(const std::map<std::string, T>& variables) const {
+            std::vector<T> values;
+            values.reserve(slots.size());
+            for (const auto& name : slots) {
+                auto it = variables.find(name);
+                if (it == variables.end()) {
+                    throw std::runtime_error("Variable " + name + " not found");
+                }
+                values.push_back(it->second);
+            }
+            return values;
+        }
+
+        // Rewrites the register code in SSA form: tape[i] computes value i and
+        // its operands are indices of earlier tape entries. The result is
+        // tape[resultEntry], which need not be the last entry when the
+        // program has several outputs.
+        void buildTape() {
+            std::vector<std::uint32_t> owner(registerCount);
+            tape.clear();
+            tape.reserve(code.size());
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                Instruction ins = code[i];
+                if (ins.op != OpCode::Const && ins.op != OpCode::Var) {
+                    ins.a = owner[ins.a];
+                    ins.b = ins.op <= OpCode::Power ? owner[ins.b] : 0;
+                }
+                owner[code[i].dst] = static_cast<std::uint32_t>(i);
+                ins.dst = static_cast<std::uint32_t>(i);
+                tape.push_back(ins);
+            }
+            resultEntry = code.empty() ? 0 : owner[result];
+        }
+
+        void checkColumns(std::span<const T* const> columns) const {
+            if (columns.size() < slots.size()) {
+                throw std::invalid_argument("Expected " + std::to_string(slots.size()) + " columns");
+            }
+        }
+
+        void runRows(std::span<const T* const> columns, std::size_t begin, std::size_t end, std::span<T> out) const {
+            std::vector<T> block(static_cast<std::size_t>(registerCount) * BatchRows);
+            for (std::size_t row = begin; row < end; row += BatchRows) {
+                std::size_t n = std::min(BatchRows, end - row);
+                runBlock(columns, row, n, block.data());
+                std::copy_n(block.data() + static_cast<std::size_t>(result) * BatchRows, n, out.data() + row);
+            }
+        }
+
+        void runBlock(std::span<const T* const> columns, std::size_t row, std::size_t n, T* block) const {
+            for (const Instruction& ins : code) {
+                T* d = block + static_cast<std::size_t>(ins.dst) * BatchRows;
+                const T* a = block + static_cast<std::size_t>(ins.a) * BatchRows;
+                const T* b = block + static_cast<std::size_t>(ins.b) * BatchRows;
+                switch (ins.op) {
+                    case OpCode::Const:
+                        std::fill_n(d, n, constants[ins.a]);
+                        continue;
+                    case OpCode::Var:
+                        std::copy_n(columns[ins.a] + row, n, d);
+                        continue;
+                    default:
+                        break;
+                }
+                if constexpr (std::is_same_v<T, double> || std::is_same_v<T, float>) {
+                    switch (ins.op) {
+                        case OpCode::Add:      VecMath::add(a, b, d, n); break;
+                        case OpCode::Subtract: VecMath::subtract(a, b, d, n); break;
+                        case OpCode::Multiply: VecMath::multiply(a, b, d, n); break;
+                        case OpCode::Divide:   VecMath::divide(a, b, d, n); break;
+                        case OpCode::Power:    VecMath::power(a, b, d, n); break;
+                        case OpCode::Sin:      VecMath::sin(a, d, n, mathAccuracy); break;
+                        case OpCode::Cos:      VecMath::cos(a, d, n, mathAccuracy); break;
+                        case OpCode::Ln:       VecMath::log(a, d, n, mathAccuracy); break;
+                        case OpCode::Exp:      VecMath::exp(a, d, n, mathAccuracy); break;
+                        case OpCode::Negate:   VecMath::negate(a, d, n); break;
+                        case OpCode::Sqrt:     VecMath::sqrt(a, d, n); break;
+                        default: break;
+                    }
+                } else {
+                    switch (ins.op) {
+                        case OpCode::Add:      for (std::size_t i = 0; i < n; ++i) d[i] = a[i] + b[i]; break;
+                        case OpCode::Subtract: for (std::size_t i = 0; i < n; ++i) d[i] = a[i] - b[i]; break;
+                        case OpCode::Multiply: for (std::size_t i = 0; i < n; ++i) d[i] = a[i] * b[i]; break;
+                        case OpCode::Divide:   for (std::size_t i = 0; i < n; ++i) d[i] = a[i] / b[i]; break;
+                        case OpCode::Power:    for (std::size_t i = 0; i < n; ++i) d[i] = std::pow(a[i], b[i]); break;
+                        case OpCode::Sin:      for (std::size_t i = 0; i < n; ++i) d[i] = MathFunctions<T>::sin(a[i], mathAccuracy); break;
+                        case OpCode::Cos:      for (std::size_t i = 0; i < n; ++i) d[i] = MathFunctions<T>::cos(a[i], mathAccuracy); break;
+                        case OpCode::Ln:       for (std::size_t i = 0; i < n; ++i) d[i] = MathFunctions<T>::log(a[i], mathAccuracy); break;
+                        case OpCode::Exp:      for (std::size_t i = 0; i < n; ++i) d[i] = MathFunctions<T>::exp(a[i], mathAccuracy); break;
+                        case OpCode::Negate:   for (std::size_t i = 0; i < n; ++i) d[i] = -a[i]; break;
+                        case OpCode::Sqrt:     for (std::size_t i = 0; i < n; ++i) d[i] = std::sqrt(a[i]); break;
+                        default: break;
+                    }
+                }
+            }
+        }
+
+        std::vector<Instruction> code;
+        std::vector<Instruction> tape;
+        std::vector<T> constants;
+        std::vector<std::string> slots;
+        std::uint32_t registerCount = 0;
+        std::uint32_t result = 0;
+        std::uint32_t resultEntry = 0;
+        MathAccuracy mathAccuracy = MathAccuracy::Full;
+    };
+
+    template <typename T>
+    class ProgramCompiler {
+    private:
+        struct Entry {
+            const Node<T>* node;
+            std::uint32_t uses;
+            std::uint32_t need;
+            std::uint32_t reg;
+            bool emitted;
+        };
+
+        std::vector<Entry> entries;
+        std::unordered_map<const Node<T>*, std::uint32_t> index;
+        std::unordered_map<std::string, std::uint32_t> slotIndex;
+        std::vector<std::uint32_t> freeRegisters;
+        Program<T> program;
+
+        static OpCode opcode(NodeKind kind) {
+            switch (kind) {
+                case NodeKind::Const:    return OpCode::Const;
+                case NodeKind::Var:      return OpCode::Var;
+                case NodeKind::Add:      return OpCode::Add;
+                case NodeKind::Subtract: return OpCode::Subtract;
+                case NodeKind::Multiply: return OpCode::Multiply;
+                case NodeKind::Divide:   return OpCode::Divide;
+                case NodeKind::Power:    return OpCode::Power;
+                case NodeKind::Sin:      return OpCode::Sin;
+                case NodeKind::Cos:      return OpCode::Cos;
+                case NodeKind::Ln:       return OpCode::Ln;
+                case NodeKind::Exp:      return OpCode::Exp;
+                case NodeKind::Negate:   return OpCode::Negate;
+            }
+            throw std::runtime_error("Unknown node kind");
+        }
+
+        std::uint32_t entryOf(const Node<T>* node) const {
+            return index.at(node);
+        }
+
+        // A power with a constant exponent that ConstantPower handles is
+        // emitted as its multiplications and never reads the exponent.
+        static std::optional<ConstantPower<T>> lowered(const Node<T>* node) {
+            if (node->kind() != NodeKind::Power) {
+                return std::nullopt;
+            }
+            auto c = constantValue(*node->operand(1));
+            return c ? ConstantPower<T>::of(*c) : std::nullopt;
+        }
+
+        static std::size_t operands(const Node<T>* node) {
+            return lowered(node) ? 1 : node->arity();
+        }
+
+        // Collects every distinct node in post-order, counting how many parents
+        // reference it and its Ershov number (registers needed to evaluate it).
+        void collect(const Node<T>& root) {
+            std::vector<std::pair<const Node<T>*, bool>> stack{{&root, false}};
+            while (!stack.empty()) {
+                auto [node, expanded] = stack.back();
+                stack.pop_back();
+                if (!expanded) {
+                    if (index.count(node)) {
+                        continue;
+                    }
+                    stack.push_back({node, true});
+                    for (std::size_t i = operands(node); i-- > 0;) {
+                        const Node<T>* child = node->operand(i).get();
+                        if (!index.count(child)) {
+                            stack.push_back({child, false});
+                        }
+                    }
+                    continue;
+                }
+                if (index.count(node)) {
+                    continue;
+                }
+                std::uint32_t need = 1;
+                if (lowered(node)) {
+                    need = std::max(entries[entryOf(node->operand(0).get())].need, 2u);
+                } else if (node->arity() == 1) {
+                    need = entries[entryOf(node->operand(0).get())].need;
+                } else if (node->arity() == 2) {
+                    std::uint32_t l = entries[entryOf(node->operand(0).get())].need;
+                    std::uint32_t r = entries[entryOf(node->operand(1).get())].need;
+                    need = l == r ? l + 1 : std::max(l, r);
+                }
+                for (std::size_t i = 0; i < operands(node); ++i) {
+                    ++entries[entryOf(node->operand(i).get())].uses;
+                }
+                index.emplace(node, static_cast<std::uint32_t>(entries.size()));
+                entries.push_back({node, 0, need, 0, false});
+            }
+        }
+
+        std::uint32_t acquire() {
+            if (!freeRegisters.empty()) {
+                std::uint32_t reg = freeRegisters.back();
+                freeRegisters.pop_back();
+                return reg;
+            }
+            return program.registerCount++;
+        }
+
+        void release(Entry& entry) {
+            if (--entry.uses == 0) {
+                freeRegisters.push_back(entry.reg);
+            }
+        }
+
+        void push(OpCode op, std::uint32_t dst, std::uint32_t a, std::uint32_t b = 0) {
+            program.code.push_back({op, dst, a, b});
+        }
+
+        void pushConstant(std::uint32_t dst, const T& value) {
+            push(OpCode::Const, dst, static_cast<std::uint32_t>(program.constants.size()));
+            program.constants.push_back(value);
+        }
+
+        // Mirrors ConstantPower::operator() step by step; p accumulates the
+        // result while x stays live.
+        void emitPower(Entry& entry, const ConstantPower<T>& power) {
+            Entry& base = entries[entryOf(entry.node->operand(0).get())];
+            const std::uint32_t x = base.reg;
+            const std::uint32_t p = acquire();
+            if (power.whole == 0 && !power.half) {
+                pushConstant(p, T(1));
+            } else {
+                std::uint32_t value = x;
+                for (int bit = std::bit_width(power.whole) - 2; bit >= 0; --bit) {
+                    push(OpCode::Multiply, p, value, value);
+                    value = p;
+                    if ((power.whole >> bit) & 1) {
+                        push(OpCode::Multiply, p, p, x);
+                    }
+                }
+                if (power.half) {
+                    if (power.whole > 0) {
+                        std::uint32_t root = acquire();
+                        push(OpCode::Sqrt, root, x);
+                        push(OpCode::Multiply, p, value, root);
+                        freeRegisters.push_back(root);
+                    } else {
+                        push(OpCode::Sqrt, p, x);
+                    }
+                    value = p;
+                }
+                if (power.reciprocal) {
+                    std::uint32_t one = acquire();
+                    pushConstant(one, T(1));
+                    push(OpCode::Divide, p, one, value);
+                    freeRegisters.push_back(one);
+                    value = p;
+                }
+                if (value != p) {
+                    // x ^ 1: x * 1 copies x bit for bit.
+                    pushConstant(p, T(1));
+                    push(OpCode::Multiply, p, x, p);
+                }
+            }
+            release(base);
+            entry.reg = p;
+            entry.emitted = true;
+        }
+
+        void emit(Entry& entry) {
+            const Node<T>* node = entry.node;
+            if (auto power = lowered(node)) {
+                emitPower(entry, *power);
+                return;
+            }
+            Instruction ins{opcode(node->kind()), 0, 0, 0};
+            if (node->kind() == NodeKind::Const) {
+                ins.a = static_cast<std::uint32_t>(program.constants.size());
+                program.constants.push_back(static_cast<const ConstNode<T>*>(node)->value);
+            } else if (node->kind() == NodeKind::Var) {
+                const std::string& name = static_cast<const VarNode<T>*>(node)->name;
+                auto [it, inserted] = slotIndex.emplace(name, static_cast<std::uint32_t>(program.slots.size()));
+                if (inserted) {
+                    program.slots.push_back(name);
+                }
+                ins.a = it->second;
+            } else {
+                Entry& a = entries[entryOf(node->operand(0).get())];
+                ins.a = a.reg;
+                if (node->arity() == 2) {
+                    Entry& b = entries[entryOf(node->operand(1).get())];
+                    ins.b = b.reg;
+                    release(b);
+                }
+                release(a);
+            }
+            ins.dst = acquire();
+            entry.reg = ins.dst;
+            entry.emitted = true;
+            program.code.push_back(ins);
+        }
+
+        // Emits operands with the larger register need first so that the
+        // register file stays at the Ershov number of the tree.
+        void schedule(const Node<T>& root) {
+            std::vector<std::pair<std::uint32_t, bool>> stack{{entryOf(&root), false}};
+            while (!stack.empty()) {
+                auto [id, expanded] = stack.back();
+                stack.pop_back();
+                Entry& entry = entries[id];
+                if (entry.emitted) {
+                    continue;
+                }
+                if (expanded) {
+                    emit(entry);
+                    continue;
+                }
+                stack.push_back({id, true});
+                const Node<T>* node = entry.node;
+                if (operands(node) == 1) {
+                    stack.push_back({entryOf(node->operand(0).get()), false});
+                } else if (node->arity() == 2) {
+                    std::uint32_t l = entryOf(node->operand(0).get());
+                    std::uint32_t r = entryOf(node->operand(1).get());
+                    if (entries[l].need >= entries[r].need) {
+                        stack.push_back({r, false});
+                        stack.push_back({l, false});
+                    } else {
+                        stack.push_back({l, false});
+                        stack.push_back({r, false});
+                    }
+                }
+            }
+        }
+
+    public:
+        Program<T> compile(const Node<T>& root) {
+            collect(root);
+            Entry& top = entries[entryOf(&root)];
+            ++top.uses;
+            program.code.reserve(entries.size());
+            schedule(root);
+            program.result = top.reg;
+            program.buildTape();
+            return std::move(program);
+        }
+
+        // Every root keeps an extra use, so its register is never reused.
+        Program<T> compile(std::span<const Node<T>* const> roots, std::vector<std::uint32_t>& outputs) {
+            if (roots.empty()) {
+                throw std::invalid_argument("Expected at least one root");
+            }
+            for (const Node<T>* root : roots) {
+                collect(*root);
+            }
+            for (const Node<T>* root : roots) {
+                ++entries[entryOf(root)].uses;
+            }
+            program.code.reserve(entries.size());
+            outputs.clear();
+            for (const Node<T>* root : roots) {
+                schedule(*root);
+                outputs.push_back(entries[entryOf(root)].reg);
+            }
+            program.result = outputs.back();
+            program.buildTape();
+            return std::move(program);
+        }
+    };
+
+    template <typename T>
+    Program<T> Program<T>::compile(const Node<T>& root) {
+        return ProgramCompiler<T>().compile(root);
+    }
+
+    template <typename T>
+    Program<T> Program<T>::compile(std::span<const Node<T>* const> roots, std::vector<std::uint32_t>& outputs) {
+        return ProgramCompiler<T>().compile(roots, outputs);
+    }
+
+}
+
+#endif // PROGRAM_H
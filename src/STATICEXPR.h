@@ -0,0 +1,538 @@
+#ifndef STATICEXPR_H
+#define STATICEXPR_H
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "NODE.h"
+
+namespace ExpressionLibrary {
+
+    // Compile-time expressions: static_expr<"x * sin(x) + y"> is parsed during
+    // compilation, with the grammar of Parser<T>, into a type tree whose
+    // evaluate is plain inlined arithmetic and libm calls. derivative<"x"> is
+    // the type the rules of NODE.h produce for Expression::differentiate, so
+    // both paths evaluate the same operations in the same order.
+    namespace Static {
+
+        template <std::size_t N>
+        struct FixedString {
+            char data[N]{};
+
+            constexpr FixedString(const char (&s)[N]) {
+                for (std::size_t i = 0; i < N; ++i) data[i] = s[i];
+            }
+
+            constexpr std::string_view view() const { return {data, N - 1}; }
+        };
+
+        // Not constexpr, so reaching it while parsing at compile time makes
+        // the compiler report message at the offending static_expr.
+        inline void parseError(const char* message) {
+            throw std::runtime_error(message);
+        }
+
+        struct Term {
+            NodeKind kind = NodeKind::Const;
+            std::size_t a = 0;
+            std::size_t b = 0;
+            double value = 0.0;
+        };
+
+        // Parsed form of a source of N characters: nodes in post-order,
+        // variables in order of first appearance as [offset, offset + length).
+        template <std::size_t N>
+        struct Table {
+            std::array<Term, N + 1> nodes{};
+            std::size_t count = 0;
+            std::size_t root = 0;
+            std::array<std::size_t, N + 1> nameOffset{};
+            std::array<std::size_t, N + 1> nameLength{};
+            std::size_t variables = 0;
+        };
+
+        enum class TokenType { Number, Variable, Function, Operator, LeftParen, RightParen, End };
+
+        struct Token {
+            TokenType type = TokenType::End;
+            std::size_t offset = 0;
+            std::size_t length = 0;
+            char op = 0;
+            double number = 0.0;
+        };
+
+        constexpr bool isDigit(char c) { return c >= '0' && c <= '9'; }
+        constexpr bool isAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+        constexpr bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v'; }
+
+        // Exact decimal to double for literals whose significant digits fit
+        // in 53 bits with a power of ten up to 1e22, where one IEEE multiply
+        // or divide rounds correctly and so agrees with std::from_chars.
+        constexpr double number(std::string_view text) {
+            std::uint64_t digits = 0;
+            std::size_t significant = 0;
+            std::size_t integerZeros = 0;
+            std::size_t fractionZeros = 0;
+            int exponent = 0;
+            bool fraction = false;
+            bool any = false;
+            auto append = [&](std::uint64_t digit) {
+                if (significant == 19) parseError("Number has too many digits for compile-time parsing");
+                digits = digits * 10 + digit;
+                ++significant;
+            };
+            for (char c : text) {
+                if (c == '.') {
+                    fraction = true;
+                    continue;
+                }
+                any = true;
+                if (c == '0') {
+                    ++(fraction ? fractionZeros : integerZeros);
+                    continue;
+                }
+                // Zeros between significant digits are significant.
+                for (; integerZeros > 0; --integerZeros) {
+                    if (significant > 0) append(0);
+                }
+                for (; fractionZeros > 0; --fractionZeros) {
+                    if (significant > 0) append(0);
+                    --exponent;
+                }
+                append(static_cast<std::uint64_t>(c - '0'));
+                if (fraction) --exponent;
+            }
+            if (!any) parseError("Invalid number");
+            if (significant > 0) exponent += static_cast<int>(integerZeros);
+            if (digits > (std::uint64_t(1) << 53) || exponent > 22 || exponent < -22) {
+                parseError("Number cannot be rounded exactly at compile time");
+            }
+            double scale = 1.0;
+            for (int i = 0; i < (exponent < 0 ? -exponent : exponent); ++i) scale *= 10.0;
+            return exponent < 0 ? static_cast<double>(digits) / scale : static_cast<double>(digits) * scale;
+        }
+
+        // Recursive descent over the grammar of Parser<T>: unary minus binds to
+        // the following primary, '^' is right-associative and binds tighter
+        // than '*' and '/', which bind tighter than '+' and '-'. Trailing input
+        // after the expression is ignored, as at runtime.
+        template <std::size_t N>
+        class Parser {
+        public:
+            constexpr explicit Parser(std::string_view input) : input(input) {
+                advance();
+            }
+
+            constexpr Table<N> parse() {
+                table.root = expression();
+                return table;
+            }
+
+        private:
+            std::string_view input;
+            std::size_t pos = 0;
+            Token current;
+            Table<N> table;
+
+            constexpr char at(std::size_t i) const { return i < input.size() ? input[i] : '\0'; }
+
+            constexpr void advance() {
+                while (isSpace(at(pos))) ++pos;
+                current = Token{TokenType::End, pos, 0};
+                if (pos >= input.size()) return;
+                char c = at(pos);
+                if (isDigit(c) || c == '.') {
+                    std::size_t start = pos;
+                    bool decimal = false;
+                    while (isDigit(at(pos)) || at(pos) == '.') {
+                        if (at(pos) == '.') {
+                            if (decimal) break;
+                            decimal = true;
+                        }
+                        ++pos;
+                    }
+                    current = Token{TokenType::Number, start, pos - start};
+                    current.number = number(input.substr(start, pos - start));
+                } else if (isAlpha(c)) {
+                    std::size_t start = pos;
+                    while (isAlpha(at(pos)) || isDigit(at(pos)) || at(pos) == '_') ++pos;
+                    current = Token{at(pos) == '(' ? TokenType::Function : TokenType::Variable, start, pos - start};
+                } else if (c == '(' || c == ')') {
+                    current = Token{c == '(' ? TokenType::LeftParen : TokenType::RightParen, pos++, 1};
+                } else if (c == '+' || c == '-' || c == '*' || c == '/' || c == '^') {
+                    current = Token{TokenType::Operator, pos++, 1, c};
+                } else {
+                    parseError("Unexpected character");
+                }
+            }
+
+            constexpr bool isOperator(char op) const {
+                return current.type == TokenType::Operator && current.op == op;
+            }
+
+            constexpr std::size_t add(NodeKind kind, std::size_t a = 0, std::size_t b = 0, double value = 0.0) {
+                table.nodes[table.count] = Term{kind, a, b, value};
+                return table.count++;
+            }
+
+            constexpr std::size_t variable(std::size_t offset, std::size_t length) {
+                std::string_view name = input.substr(offset, length);
+                std::size_t i = 0;
+                while (i < table.variables && input.substr(table.nameOffset[i], table.nameLength[i]) != name) ++i;
+                if (i == table.variables) {
+                    table.nameOffset[i] = offset;
+                    table.nameLength[i] = length;
+                    ++table.variables;
+                }
+                return add(NodeKind::Var, i);
+            }
+
+            constexpr std::size_t expression() {
+                std::size_t left = term();
+                while (isOperator('+') || isOperator('-')) {
+                    NodeKind kind = current.op == '+' ? NodeKind::Add : NodeKind::Subtract;
+                    advance();
+                    std::size_t right = term();
+                    left = add(kind, left, right);
+                }
+                return left;
+            }
+
+            constexpr std::size_t term() {
+                std::size_t left = power();
+                while (isOperator('*') || isOperator('/')) {
+                    NodeKind kind = current.op == '*' ? NodeKind::Multiply : NodeKind::Divide;
+                    advance();
+                    std::size_t right = power();
+                    left = add(kind, left, right);
+                }
+                return left;
+            }
+
+            constexpr std::size_t power() {
+                std::size_t base = primary();
+                if (!isOperator('^')) return base;
+                advance();
+                std::size_t exponent = power();
+                return add(NodeKind::Power, base, exponent);
+            }
+
+            constexpr std::size_t primary() {
+                std::size_t negations = 0;
+                while (isOperator('-')) {
+                    ++negations;
+                    advance();
+                }
+                std::size_t node = 0;
+                if (current.type == TokenType::Number) {
+                    node = add(NodeKind::Const, 0, 0, current.number);
+                    advance();
+                } else if (current.type == TokenType::Variable) {
+                    Token name = current;
+                    advance();
+                    node = variable(name.offset, name.length);
+                } else if (current.type == TokenType::Function || current.type == TokenType::LeftParen) {
+                    Token open = current;
+                    bool call = open.type == TokenType::Function;
+                    advance();
+                    if (call) advance();
+                    node = expression();
+                    if (current.type != TokenType::RightParen) {
+                        parseError(call ? "Expected ')' after function argument" : "Expected ')'");
+                    }
+                    advance();
+                    if (call) {
+                        std::string_view name = input.substr(open.offset, open.length);
+                        NodeKind kind = name == "sin" ? NodeKind::Sin
+                                      : name == "cos" ? NodeKind::Cos
+                                      : name == "ln"  ? NodeKind::Ln
+                                      : name == "exp" ? NodeKind::Exp
+                                      : NodeKind::Const;
+                        if (kind == NodeKind::Const) parseError("Unknown function");
+                        node = add(kind, node);
+                    }
+                } else {
+                    parseError("Unexpected token");
+                }
+                for (; negations > 0; --negations) {
+                    node = add(NodeKind::Negate, node);
+                }
+                return node;
+            }
+        };
+
+        template <FixedString Source>
+        struct Parsed {
+            static constexpr std::size_t Length = Source.view().size();
+            static constexpr Table<Length> table = Parser<Length>(Source.view()).parse();
+
+            static constexpr auto names = [] {
+                std::array<std::string_view, table.variables> result{};
+                for (std::size_t i = 0; i < table.variables; ++i) {
+                    result[i] = Source.view().substr(table.nameOffset[i], table.nameLength[i]);
+                }
+                return result;
+            }();
+        };
+
+        // Node types. values[I] is the value of the I-th variable.
+        template <double Value>
+        struct Constant {
+            template <typename T>
+            static constexpr T evaluate(const T*) { return T(Value); }
+
+            template <typename Names>
+            static std::string to_string(const Names&) {
+                std::ostringstream oss;
+                oss << Value;
+                return oss.str();
+            }
+        };
+
+        template <std::size_t I>
+        struct Variable {
+            template <typename T>
+            static constexpr T evaluate(const T* values) { return values[I]; }
+
+            template <typename Names>
+            static std::string to_string(const Names& names) { return std::string(names[I]); }
+        };
+
+#define STATICEXPR_BINARY(Name, op, text)                                            \
+        template <typename L, typename R>                                            \
+        struct Name {                                                                \
+            template <typename T>                                                    \
+            static constexpr T evaluate(const T* values) {                           \
+                return L::evaluate(values) op R::evaluate(values);                   \
+            }                                                                        \
+            template <typename Names>                                                \
+            static std::string to_string(const Names& names) {                       \
+                return "(" + L::to_string(names) + text + R::to_string(names) + ")"; \
+            }                                                                        \
+        };
+
+#define STATICEXPR_UNARY(Name, call, text)                                           \
+        template <typename A>                                                        \
+        struct Name {                                                                \
+            template <typename T>                                                    \
+            static T evaluate(const T* values) {                                     \
+                using std::sin, std::cos, std::log, std::exp;                        \
+                return call(A::evaluate(values));                                    \
+            }                                                                        \
+            template <typename Names>                                                \
+            static std::string to_string(const Names& names) {                       \
+                return text "(" + A::to_string(names) + ")";                         \
+            }                                                                        \
+        };
+
+        STATICEXPR_BINARY(Add, +, " + ")
+        STATICEXPR_BINARY(Subtract, -, " - ")
+        STATICEXPR_BINARY(Multiply, *, " * ")
+        STATICEXPR_BINARY(Divide, /, " / ")
+        STATICEXPR_UNARY(Sin, sin, "sin")
+        STATICEXPR_UNARY(Cos, cos, "cos")
+        STATICEXPR_UNARY(Ln, log, "ln")
+        STATICEXPR_UNARY(Exp, exp, "exp")
+
+#undef STATICEXPR_BINARY
+#undef STATICEXPR_UNARY
+
+        // Whether E mentions no variable, as constantValue tells for nodes.
+        template <typename E> struct IsConstant : std::false_type {};
+        template <double Value> struct IsConstant<Constant<Value>> : std::true_type {};
+        template <template <typename> class Node, typename A>
+        struct IsConstant<Node<A>> : IsConstant<A> {};
+        template <template <typename, typename> class Node, typename L, typename R>
+        struct IsConstant<Node<L, R>> : std::bool_constant<IsConstant<L>::value && IsConstant<R>::value> {};
+
+        // Variable-free exponents, such as -2 or the 3 - 1 of a derivative,
+        // go through ConstantPower, as in PowerNode.
+        template <typename B, typename E>
+        struct Power {
+            template <typename T>
+            static T evaluate(const T* values) {
+                if constexpr (IsConstant<E>::value) {
+                    return ConstantPower<T>::pow(B::evaluate(values), E::evaluate(values));
+                } else {
+                    using std::pow;
+                    return pow(B::evaluate(values), E::evaluate(values));
+                }
+            }
+
+            template <typename Names>
+            static std::string to_string(const Names& names) {
+                return "(" + B::to_string(names) + " ^ " + E::to_string(names) + ")";
+            }
+        };
+
+        template <typename A>
+        struct Negate {
+            template <typename T>
+            static constexpr T evaluate(const T* values) { return -A::evaluate(values); }
+
+            template <typename Names>
+            static std::string to_string(const Names& names) { return "-(" + A::to_string(names) + ")"; }
+        };
+
+        // Type of node I of Parsed<Source>::table.
+        template <FixedString Source, std::size_t I, NodeKind Kind = Parsed<Source>::table.nodes[I].kind>
+        struct Build;
+
+        template <FixedString Source, std::size_t I>
+        struct Build<Source, I, NodeKind::Const> {
+            using type = Constant<Parsed<Source>::table.nodes[I].value>;
+        };
+
+        template <FixedString Source, std::size_t I>
+        struct Build<Source, I, NodeKind::Var> {
+            using type = Variable<Parsed<Source>::table.nodes[I].a>;
+        };
+
+        template <template <typename, typename> class Node, FixedString Source, std::size_t I>
+        struct BuildBinary {
+            using type = Node<typename Build<Source, Parsed<Source>::table.nodes[I].a>::type,
+                              typename Build<Source, Parsed<Source>::table.nodes[I].b>::type>;
+        };
+
+        template <template <typename> class Node, FixedString Source, std::size_t I>
+        struct BuildUnary {
+            using type = Node<typename Build<Source, Parsed<Source>::table.nodes[I].a>::type>;
+        };
+
+        template <FixedString S, std::size_t I> struct Build<S, I, NodeKind::Add> : BuildBinary<Add, S, I> {};
+        template <FixedString S, std::size_t I> struct Build<S, I, NodeKind::Subtract> : BuildBinary<Subtract, S, I> {};
+        template <FixedString S, std::size_t I> struct Build<S, I, NodeKind::Multiply> : BuildBinary<Multiply, S, I> {};
+        template <FixedString S, std::size_t I> struct Build<S, I, NodeKind::Divide> : BuildBinary<Divide, S, I> {};
+        template <FixedString S, std::size_t I> struct Build<S, I, NodeKind::Power> : BuildBinary<Power, S, I> {};
+        template <FixedString S, std::size_t I> struct Build<S, I, NodeKind::Sin> : BuildUnary<Sin, S, I> {};
+        template <FixedString S, std::size_t I> struct Build<S, I, NodeKind::Cos> : BuildUnary<Cos, S, I> {};
+        template <FixedString S, std::size_t I> struct Build<S, I, NodeKind::Ln> : BuildUnary<Ln, S, I> {};
+        template <FixedString S, std::size_t I> struct Build<S, I, NodeKind::Exp> : BuildUnary<Exp, S, I> {};
+        template <FixedString S, std::size_t I> struct Build<S, I, NodeKind::Negate> : BuildUnary<Negate, S, I> {};
+
+        // d/d(variable V) of a node type, by the rules of the derivative()
+        // overrides in NODE.h. V past the last variable differentiates by a
+        // variable the expression does not use.
+        template <typename Node, std::size_t V>
+        struct Derivative;
+
+        template <typename Node, std::size_t V>
+        using D = typename Derivative<Node, V>::type;
+
+        template <double Value, std::size_t V>
+        struct Derivative<Constant<Value>, V> { using type = Constant<0.0>; };
+
+        template <std::size_t I, std::size_t V>
+        struct Derivative<Variable<I>, V> { using type = Constant<I == V ? 1.0 : 0.0>; };
+
+        template <typename L, typename R, std::size_t V>
+        struct Derivative<Add<L, R>, V> { using type = Add<D<L, V>, D<R, V>>; };
+
+        template <typename L, typename R, std::size_t V>
+        struct Derivative<Subtract<L, R>, V> { using type = Subtract<D<L, V>, D<R, V>>; };
+
+        template <typename L, typename R, std::size_t V>
+        struct Derivative<Multiply<L, R>, V> {
+            using type = Add<Multiply<D<L, V>, R>, Multiply<L, D<R, V>>>;
+        };
+
+        template <typename L, typename R, std::size_t V>
+        struct Derivative<Divide<L, R>, V> {
+            using type = Divide<Subtract<Multiply<D<L, V>, R>, Multiply<L, D<R, V>>>, Power<R, Constant<2.0>>>;
+        };
+
+        // Whether E reads variable V, as Differentiation::depends tells.
+        template <typename E, std::size_t V> struct Depends : std::false_type {};
+        template <std::size_t I, std::size_t V> struct Depends<Variable<I>, V> : std::bool_constant<I == V> {};
+        template <template <typename> class Node, typename A, std::size_t V>
+        struct Depends<Node<A>, V> : Depends<A, V> {};
+        template <template <typename, typename> class Node, typename L, typename R, std::size_t V>
+        struct Depends<Node<L, R>, V> : std::bool_constant<Depends<L, V>::value || Depends<R, V>::value> {};
+
+        template <typename B, typename E, std::size_t V>
+        struct Derivative<Power<B, E>, V> {
+            using ByBase = Multiply<Multiply<E, Power<B, Subtract<E, Constant<1.0>>>>, D<B, V>>;
+            using type = std::conditional_t<Depends<E, V>::value,
+                                            Add<ByBase, Multiply<Multiply<Power<B, E>, Ln<B>>, D<E, V>>>,
+                                            ByBase>;
+        };
+
+        template <typename A, std::size_t V>
+        struct Derivative<Sin<A>, V> { using type = Multiply<Cos<A>, D<A, V>>; };
+
+        template <typename A, std::size_t V>
+        struct Derivative<Cos<A>, V> { using type = Multiply<Negate<Sin<A>>, D<A, V>>; };
+
+        template <typename A, std::size_t V>
+        struct Derivative<Ln<A>, V> { using type = Divide<D<A, V>, A>; };
+
+        template <typename A, std::size_t V>
+        struct Derivative<Exp<A>, V> { using type = Multiply<Exp<A>, D<A, V>>; };
+
+        template <typename A, std::size_t V>
+        struct Derivative<Negate<A>, V> { using type = Negate<D<A, V>>; };
+
+        // An expression type over the variables of Source.
+        template <FixedString Source, typename Root>
+        struct Expression {
+            using root = Root;
+
+            // Variables in order of first appearance in Source.
+            static constexpr auto variables = Parsed<Source>::names;
+
+            static constexpr std::size_t index(std::string_view name) {
+                std::size_t i = 0;
+                while (i < variables.size() && variables[i] != name) ++i;
+                return i;
+            }
+
+            template <typename T>
+            static constexpr T evaluate(std::span<const T, variables.size()> values) {
+                return Root::evaluate(values.data());
+            }
+
+            template <typename T>
+            static T evaluate(const std::map<std::string, T>& values) {
+                std::array<T, variables.size()> slots{};
+                for (std::size_t i = 0; i < variables.size(); ++i) {
+                    auto it = values.find(std::string(variables[i]));
+                    if (it == values.end()) {
+                        throw std::runtime_error("Variable " + std::string(variables[i]) + " not found");
+                    }
+                    slots[i] = it->second;
+                }
+                return Root::evaluate(slots.data());
+            }
+
+            // Arguments follow variables and are evaluated as double unless
+            // one of them needs a wider type.
+            template <typename... Args>
+                requires(sizeof...(Args) == variables.size())
+            constexpr auto operator()(Args... args) const {
+                using T = std::common_type_t<double, Args...>;
+                const std::array<T, sizeof...(Args)> values{T(args)...};
+                return Root::evaluate(values.data());
+            }
+
+            static std::string to_string() { return Root::to_string(variables); }
+
+            template <FixedString Name>
+            using derivative = Expression<Source, D<Root, index(Name.view())>>;
+        };
+
+    }
+
+    template <Static::FixedString Source>
+    using static_expr = Static::Expression<Source, typename Static::Build<Source, Static::Parsed<Source>::table.root>::type>;
+
+}
+
+#endif // STATICEXPR_H
@@ -0,0 +1,127 @@
+#include "THREADPOOL.h"
+#include <algorithm>
+
+namespace ExpressionLibrary {
+
+    ThreadPool::ThreadPool(std::size_t threads) {
+        if (threads == 0) {
+            threads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+        }
+        for (std::size_t i = 0; i < threads; ++i) {
+            shares.push_back(std::make_unique<Share>());
+        }
+        for (std::size_t i = 1; i < threads; ++i) {
+            workers.emplace_back([this, i] { loop(i); });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::run(std::size_t tasks, const std::function<void(std::size_t)>& body) {
+        if (tasks == 0) return;
+        std::lock_guard<std::mutex> serial(runMutex);
+
+        std::size_t participants = shares.size();
+        for (std::size_t i = 0; i < participants; ++i) {
+            std::lock_guard<std::mutex> lock(shares[i]->mutex);
+            shares[i]->begin = tasks * i / participants;
+            shares[i]->end = tasks * (i + 1) / participants;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &body;
+            failure = nullptr;
+            active = participants;
+            ++generation;
+        }
+        wake.notify_all();
+
+        work(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] { return active == 0; });
+        job = nullptr;
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    void ThreadPool::loop(std::size_t self) {
+        std::size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            work(self);
+        }
+    }
+
+    void ThreadPool::work(std::size_t self) {
+        std::size_t index;
+        while (take(self, index) || (steal(self) && take(self, index))) {
+            try {
+                (*job)(index);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!failure) failure = std::current_exception();
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--active == 0) {
+            finished.notify_one();
+        }
+    }
+
+    bool ThreadPool::take(std::size_t self, std::size_t& index) {
+        Share& share = *shares[self];
+        std::lock_guard<std::mutex> lock(share.mutex);
+        if (share.begin == share.end) return false;
+        index = share.begin++;
+        return true;
+    }
+
+    // Moves the back half of the largest other share into self's share.
+    // Fails once no other share has work left.
+    bool ThreadPool::steal(std::size_t self) {
+        while (true) {
+            std::size_t victim = self;
+            std::size_t most = 0;
+            for (std::size_t i = 0; i < shares.size(); ++i) {
+                if (i == self) continue;
+                std::lock_guard<std::mutex> lock(shares[i]->mutex);
+                if (shares[i]->end - shares[i]->begin > most) {
+                    most = shares[i]->end - shares[i]->begin;
+                    victim = i;
+                }
+            }
+            if (victim == self) return false;
+
+            std::size_t begin, end;
+            {
+                std::lock_guard<std::mutex> lock(shares[victim]->mutex);
+                std::size_t left = shares[victim]->end - shares[victim]->begin;
+                if (left == 0) continue;
+                end = shares[victim]->end;
+                begin = end - (left + 1) / 2;
+                shares[victim]->end = begin;
+            }
+            std::lock_guard<std::mutex> lock(shares[self]->mutex);
+            shares[self]->begin = begin;
+            shares[self]->end = end;
+            return true;
+        }
+    }
+
+}
@@ -0,0 +1,63 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ExpressionLibrary {
+
+    // Fixed-size pool that runs index-parallel loops. Each participant starts
+    // with an equal contiguous share of the indices and takes work from its
+    // front; a participant that runs dry steals the back half of the largest
+    // remaining share. The calling thread is one of the participants.
+    class ThreadPool {
+    public:
+        // threads counts the caller; 0 means std::thread::hardware_concurrency().
+        explicit ThreadPool(std::size_t threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        std::size_t size() const { return workers.size() + 1; }
+
+        // Calls body(i) once for every i in [0, tasks) and returns when all
+        // calls have finished, rethrowing the first exception thrown by body.
+        // Calls from several threads are serialized.
+        void run(std::size_t tasks, const std::function<void(std::size_t)>& body);
+
+    private:
+        struct Share {
+            std::mutex mutex;
+            std::size_t begin = 0;
+            std::size_t end = 0;
+        };
+
+        std::vector<std::thread> workers;
+        std::vector<std::unique_ptr<Share>> shares;
+
+        std::mutex runMutex;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable finished;
+        const std::function<void(std::size_t)>* job = nullptr;
+        std::size_t generation = 0;
+        std::size_t active = 0;
+        bool stopping = false;
+        std::exception_ptr failure;
+
+        void work(std::size_t self);
+        bool take(std::size_t self, std::size_t& index);
+        bool steal(std::size_t self);
+        void loop(std::size_t self);
+    };
+
+}
+
+#endif // THREADPOOL_H
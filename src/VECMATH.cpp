@@ -0,0 +1,614 @@
+#include "VECMATH.h"
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(__APPLE__)
+#define VECMATH_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define VECMATH_CLONES
+#endif
+
+#if defined(__GNUC__)
+#define VECMATH_VECTOR 1
+#define VECMATH_INLINE inline __attribute__((always_inline))
+#pragma GCC diagnostic ignored "-Wpsabi"
+#else
+#define VECMATH_INLINE inline
+#endif
+
+namespace ExpressionLibrary {
+namespace VecMath {
+
+    namespace {
+
+        constexpr double Log2E = 1.44269504088896338700e+00;
+        constexpr double Ln2Hi = 6.93147180369123816490e-01;
+        constexpr double Ln2Lo = 1.90821492927058770002e-10;
+        constexpr double TwoOverPi = 6.36619772367581382433e-01;
+        constexpr double PiOver2_1 = 1.57079632673412561417e+00;
+        constexpr double PiOver2_2 = 6.07710050630396597660e-11;
+        constexpr double PiOver2_3 = 2.02226624871116645580e-21;
+        constexpr double Sqrt2 = 1.41421356237309504880e+00;
+        constexpr double RoundMagic = 6755399441055744.0; // 1.5 * 2^52
+        constexpr double ExpLimit = 708.0;
+        constexpr double TrigLimit = 1e5;
+        constexpr double LogMin = 2.2250738585072014e-308;
+        constexpr double LogMax = 1.7976931348623157e+308;
+
+        constexpr float RoundMagicF = 12582912.0f; // 1.5 * 2^23
+        constexpr float Ln2HiF = 0.693359375f;
+        constexpr float Ln2LoF = -2.12194440e-4f;
+        constexpr float PiOver2_1F = 1.5703125f;
+        constexpr float PiOver2_2F = 4.837512969970703125e-4f;
+        constexpr float PiOver2_3F = 7.54978995489188216e-8f;
+        constexpr float SqrtHalfF = 0.707106781186547524f;
+        // Keeps 2^k normal and finite in expKernel; beyond, libm handles
+        // overflow and subnormal results.
+        constexpr float ExpMinF = -87.0f;
+        constexpr float ExpMaxF = 88.0f;
+        constexpr float TrigLimitF = 8192.0f;
+        constexpr float LogMinF = 1.17549435e-38f;
+        constexpr float LogMaxF = 3.40282347e+38f;
+
+#if VECMATH_VECTOR
+        typedef double v4d __attribute__((vector_size(32)));
+        typedef std::int64_t v4i __attribute__((vector_size(32)));
+        typedef std::uint64_t v4u __attribute__((vector_size(32)));
+        typedef float v8f __attribute__((vector_size(32)));
+        typedef std::int32_t v8i __attribute__((vector_size(32)));
+        typedef std::uint32_t v8u __attribute__((vector_size(32)));
+
+        constexpr std::size_t Lanes = 4;
+        constexpr std::size_t FloatLanes = 8;
+
+        VECMATH_INLINE v4d load(const double* p) {
+            v4d v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        VECMATH_INLINE void store(double* p, const v4d& v) {
+            std::memcpy(p, &v, sizeof(v));
+        }
+
+        VECMATH_INLINE v8f load(const float* p) {
+            v8f v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        VECMATH_INLINE void store(float* p, const v8f& v) {
+            std::memcpy(p, &v, sizeof(v));
+        }
+
+        VECMATH_INLINE v4d splat(double x) {
+            return v4d{x, x, x, x};
+        }
+
+        VECMATH_INLINE v4d select(const v4i& mask, const v4d& a, const v4d& b) {
+            return (v4d)(((v4i)a & mask) | ((v4i)b & ~mask));
+        }
+
+        VECMATH_INLINE v4d expKernel(const v4d& x) {
+            v4d t = x * Log2E + RoundMagic;
+            v4d k = t - RoundMagic;
+            v4i ki = (v4i)t - (v4i)splat(RoundMagic);
+            v4d r = (x - k * Ln2Hi) - k * Ln2Lo;
+
+            v4d p = splat(1.0 / 6227020800.0);
+            p = p * r + 1.0 / 479001600.0;
+            p = p * r + 1.0 / 39916800.0;
+            p = p * r + 1.0 / 3628800.0;
+            p = p * r + 1.0 / 362880.0;
+            p = p * r + 1.0 / 40320.0;
+            p = p * r + 1.0 / 5040.0;
+            p = p * r + 1.0 / 720.0;
+            p = p * r + 1.0 / 120.0;
+            p = p * r + 1.0 / 24.0;
+            p = p * r + 1.0 / 6.0;
+            p = p * r + 0.5;
+            p = p * r * r + r;
+
+            v4d scale = (v4d)((ki + 1023) << 52);
+            return (p + 1.0) * scale;
+        }
+
+        VECMATH_INLINE v4d logKernel(const v4d& x) {
+            v4u bits = (v4u)x;
+            v4u exponentBits = (bits >> 52) | 0x4330000000000000ull;
+            v4d e = (v4d)exponentBits - 4503599627370496.0 - 1023.0;
+            v4d m = (v4d)((bits & 0x000fffffffffffffull) | 0x3ff0000000000000ull);
+
+            v4i big = m > Sqrt2;
+            m = select(big, m * 0.5, m);
+            e = e + (v4d)((v4i)splat(1.0) & big);
+
+            v4d f = (m - 1.0) / (m + 1.0);
+            v4d s = f * f;
+            v4d q = splat(1.0 / 21.0);
+            q = q * s + 1.0 / 19.0;
+            q = q * s + 1.0 / 17.0;
+            q = q * s + 1.0 / 15.0;
+            q = q * s + 1.0 / 13.0;
+            q = q * s + 1.0 / 11.0;
+            q = q * s + 1.0 / 9.0;
+            q = q * s + 1.0 / 7.0;
+            q = q * s + 1.0 / 5.0;
+            q = q * s + 1.0 / 3.0;
+            v4d f2 = f + f;
+            v4d logm = f2 + f2 * s * q;
+
+            return e * Ln2Hi + (logm + e * Ln2Lo);
+        }
+
+        // quadrantOffset 0 gives sin, 1 gives cos.
+        VECMATH_INLINE v4d sinCosKernel(const v4d& x, std::int64_t quadrantOffset) {
+            v4d t = x * TwoOverPi + RoundMagic;
+            v4d j = t - RoundMagic;
+            v4i q = (v4i)t - (v4i)splat(RoundMagic) + quadrantOffset;
+            v4d r = ((x - j * PiOver2_1) - j * PiOver2_2) - j * PiOver2_3;
+            v4d z = r * r;
+
+            v4d ps = splat(1.0 / 355687428096000.0);
+            ps = ps * z - 1.0 / 1307674368000.0;
+            ps = ps * z + 1.0 / 6227020800.0;
+            ps = ps * z - 1.0 / 39916800.0;
+            ps = ps * z + 1.0 / 362880.0;
+            ps = ps * z - 1.0 / 5040.0;
+            ps = ps * z + 1.0 / 120.0;
+            ps = ps * z - 1.0 / 6.0;
+            v4d sinR = select(r == 0.0, r, r + r * z * ps);
+
+            v4d pc = splat(1.0 / 6402373705728000.0);
+            pc = pc * z - 1.0 / 20922789888000.0;
+            pc = pc * z + 1.0 / 87178291200.0;
+            pc = pc * z - 1.0 / 479001600.0;
+            pc = pc * z + 1.0 / 3628800.0;
+            pc = pc * z - 1.0 / 40320.0;
+            pc = pc * z + 1.0 / 720.0;
+            pc = pc * z - 1.0 / 24.0;
+            v4d cosR = (1.0 - 0.5 * z) + z * z * -pc;
+
+            v4i useCos = (q & 1) != 0;
+            v4d result = select(useCos, cosR, sinR);
+            v4i sign = (q & 2) << 62;
+            return (v4d)((v4i)result ^ sign);
+        }
+
+        VECMATH_INLINE v8f splat(float x) {
+            return v8f{x, x, x, x, x, x, x, x};
+        }
+
+        VECMATH_INLINE v8f select(const v8i& mask, const v8f& a, const v8f& b) {
+            return (v8f)(((v8i)a & mask) | ((v8i)b & ~mask));
+        }
+
+        // Single-precision counterparts of the kernels above, with Cephes
+        // polynomials: within 2 ULP of libm on their reduced ranges.
+        VECMATH_INLINE v8f expKernel(const v8f& x) {
+            v8f t = x * (float)Log2E + RoundMagicF;
+            v8f k = t - RoundMagicF;
+            v8i ki = (v8i)t - (v8i)splat(RoundMagicF);
+            v8f r = (x - k * Ln2HiF) - k * Ln2LoF;
+
+            v8f p = splat(1.9875691500e-4f);
+            p = p * r + 1.3981999507e-3f;
+            p = p * r + 8.3334519073e-3f;
+            p = p * r + 4.1665795894e-2f;
+            p = p * r + 1.6666665459e-1f;
+            p = p * r + 5.0000001201e-1f;
+            p = p * r * r + r + 1.0f;
+
+            v8f scale = (v8f)((ki + 127) << 23);
+            return p * scale;
+        }
+
+        VECMATH_INLINE v8f logKernel(const v8f& x) {
+            v8u bits = (v8u)x;
+            v8i e = (v8i)(bits >> 23) - 126;
+            v8f m = (v8f)((bits & 0x007fffffu) | 0x3f000000u);
+
+            v8i small = m < SqrtHalfF;
+            e = e + small;
+            m = select(small, m + m, m) - 1.0f;
+            v8f fe = __builtin_convertvector(e, v8f);
+
+            v8f z = m * m;
+            v8f y = splat(7.0376836292e-2f);
+            y = y * m - 1.1514610310e-1f;
+            y = y * m + 1.1676998740e-1f;
+            y = y * m - 1.2420140846e-1f;
+            y = y * m + 1.4249322787e-1f;
+            y = y * m - 1.6668057665e-1f;
+            y = y * m + 2.0000714765e-1f;
+            y = y * m - 2.4999993993e-1f;
+            y = y * m + 3.3333331174e-1f;
+            y = y * m * z;
+            y = y + fe * Ln2LoF - 0.5f * z;
+            return (m + y) + fe * Ln2HiF;
+        }
+
+        VECMATH_INLINE v8f sinCosKernel(const v8f& x, std::int32_t quadrantOffset) {
+            v8f t = x * (float)TwoOverPi + RoundMagicF;
+            v8f j = t - RoundMagicF;
+            v8i q = (v8i)t - (v8i)splat(RoundMagicF) + quadrantOffset;
+            v8f r = ((x - j * PiOver2_1F) - j * PiOver2_2F) - j * PiOver2_3F;
+            v8f z = r * r;
+
+            v8f ps = splat(-1.9515295891e-4f);
+            ps = ps * z + 8.3321608736e-3f;
+            ps = ps * z - 1.6666654611e-1f;
+            v8f sinR = select(r == 0.0f, r, r + r * z * ps);
+
+            v8f pc = splat(2.443315711809948e-5f);
+            pc = pc * z - 1.388731625493765e-3f;
+            pc = pc * z + 4.166664568298827e-2f;
+            v8f cosR = (1.0f - 0.5f * z) + z * z * pc;
+
+            v8i useCos = (q & 1) != 0;
+            v8f result = select(useCos, cosR, sinR);
+            v8i sign = (q & 2) << 30;
+            return (v8f)((v8i)result ^ sign);
+        }
+
+        VECMATH_INLINE v4i toBits(const v4d& x) { return (v4i)x; }
+        VECMATH_INLINE v4d fromBits(const v4i& x) { return (v4d)x; }
+#endif
+
+        VECMATH_INLINE std::int64_t toBits(double x) { return std::bit_cast<std::int64_t>(x); }
+        VECMATH_INLINE double fromBits(std::int64_t x) { return std::bit_cast<double>(x); }
+        VECMATH_INLINE double select(bool mask, double a, double b) { return mask ? a : b; }
+
+        // Taylor series economized with Chebyshev polynomials to the error
+        // budget of each MathAccuracy tier, over the reduced ranges of the
+        // kernels above: |r| <= 0.8 for sin/cos, |r| <= 0.35 for exp and
+        // s = f^2 <= 0.0295 for log. exp is 1 + r * P(r), so exp(0) is exact.
+        template <MathAccuracy A>
+        struct Coefficients;
+
+        template <>
+        struct Coefficients<MathAccuracy::Digits12> {
+            static constexpr std::array<double, 5> sin{
+                -0.16666666666663327, 0.008333333330723303, -0.0001984126657708898,
+                2.7555889945952363e-06, -2.4796451566899022e-08};
+            static constexpr std::array<double, 5> cos{
+                0.04166666666666428, -0.0013888888887022704, 2.4801584967829853e-05,
+                -2.755629745529846e-07, 2.0694030274952834e-09};
+            static constexpr std::array<double, 9> exp{
+                1.0000000000000013, 0.4999999999978134, 0.1666666666661146, 0.04166666690463005,
+                0.008333333369381786, 0.0013888818973309277, 0.00019841187462590854,
+                2.4877649947615753e-05, 2.763414079264943e-06};
+            static constexpr std::array<double, 5> log{
+                0.3333333333369372, 0.1999999939089929, 0.14285878765726337,
+                0.11095609360832163, 0.09683036806073271};
+        };
+
+        template <>
+        struct Coefficients<MathAccuracy::Digits7> {
+            static constexpr std::array<double, 3> sin{
+                -0.16666664432035666, 0.008332704130729823, -0.00019578507443256154};
+            static constexpr std::array<double, 3> cos{
+                0.04166666442823925, -0.0013888258736643223, 2.4538527860349094e-05};
+            static constexpr std::array<double, 6> exp{
+                1.0000000114319616, 0.5000000049997212, 0.16666498742347774, 0.04166634024942484,
+                0.008369864121188718, 0.0013942150435384477};
+            static constexpr std::array<double, 3> log{
+                0.3333334263631638, 0.19994350403515243, 0.1479160613980901};
+        };
+
+        template <typename V, std::size_t N>
+        VECMATH_INLINE V horner(const V& x, const std::array<double, N>& c) {
+            V y = V{} + c[N - 1];
+            for (std::size_t i = N - 1; i-- > 0;) {
+                y = y * x + c[i];
+            }
+            return y;
+        }
+
+        // Reduced-degree forms of expKernel, logKernel and sinCosKernel for
+        // V = double or v4d.
+        template <MathAccuracy A, typename V>
+        VECMATH_INLINE V expApprox(const V& x) {
+            V t = x * Log2E + RoundMagic;
+            V k = t - RoundMagic;
+            auto ki = toBits(t) - toBits(V{} + RoundMagic);
+            V r = (x - k * Ln2Hi) - k * Ln2Lo;
+            V p = 1.0 + r * horner(r, Coefficients<A>::exp);
+            return p * fromBits((ki + 1023) << 52);
+        }
+
+        template <MathAccuracy A, typename V>
+        VECMATH_INLINE V logApprox(const V& x) {
+            auto bits = toBits(x);
+            V e = fromBits(((bits >> 52) & 0x7ff) | 0x4330000000000000ll) - 4503599627370496.0 - 1023.0;
+            V m = fromBits((bits & 0x000fffffffffffffll) | 0x3ff0000000000000ll);
+            auto big = m > Sqrt2;
+            m = select(big, m * 0.5, m);
+            e = select(big, e + 1.0, e);
+
+            V f = (m - 1.0) / (m + 1.0);
+            V s = f * f;
+            V f2 = f + f;
+            V logm = f2 + f2 * s * horner(s, Coefficients<A>::log);
+            return e * Ln2Hi + (logm + e * Ln2Lo);
+        }
+
+        template <MathAccuracy A, typename V>
+        VECMATH_INLINE V sinCosApprox(const V& x, std::int64_t quadrantOffset) {
+            V t = x * TwoOverPi + RoundMagic;
+            V j = t - RoundMagic;
+            auto q = toBits(t) - toBits(V{} + RoundMagic) + quadrantOffset;
+            V r = ((x - j * PiOver2_1) - j * PiOver2_2) - j * PiOver2_3;
+            V z = r * r;
+            V sinR = select(r == 0.0, r, r + r * z * horner(z, Coefficients<A>::sin));
+            V cosR = (1.0 - 0.5 * z) + z * z * horner(z, Coefficients<A>::cos);
+            V result = select((q & 1) != 0, cosR, sinR);
+            return fromBits(toBits(result) ^ ((q & 2) << 62));
+        }
+
+    }
+
+#if VECMATH_VECTOR
+#define VECMATH_BINARY(op)                                              \
+    std::size_t i = 0;                                                  \
+    for (; i + Lanes <= n; i += Lanes) {                                \
+        store(out + i, load(a + i) op load(b + i));                     \
+    }                                                                   \
+    for (; i < n; ++i) out[i] = a[i] op b[i];
+
+// Lanes outside [lo, hi] (including NaN) are recomputed with libm.
+#define VECMATH_UNARY(kernel, lo, hi, fallback)                         \
+    std::size_t i = 0;                                                  \
+    for (; i + Lanes <= n; i += Lanes) {                                \
+        v4d x = load(a + i);                                            \
+        v4d y = kernel;                                                 \
+        v4i special = ~((x >= (lo)) & (x <= (hi)));                     \
+        if (special[0] | special[1] | special[2] | special[3]) {        \
+            for (std::size_t l = 0; l < Lanes; ++l) {                   \
+                if (special[l]) y[l] = fallback(x[l]);                  \
+            }                                                           \
+        }                                                               \
+        store(out + i, y);                                              \
+    }                                                                   \
+    for (; i < n; ++i) out[i] = fallback(a[i]);
+
+#define VECMATH_BINARY_FLOAT(op)                                        \
+    std::size_t i = 0;                                                  \
+    for (; i + FloatLanes <= n; i += FloatLanes) {                      \
+        store(out + i, load(a + i) op load(b + i));                     \
+    }                                                                   \
+    for (; i < n; ++i) out[i] = a[i] op b[i];
+
+#define VECMATH_UNARY_FLOAT(kernel, lo, hi, fallback)                   \
+    std::size_t i = 0;                                                  \
+    for (; i + FloatLanes <= n; i += FloatLanes) {                      \
+        v8f x = load(a + i);                                            \
+        v8f y = kernel;                                                 \
+        v8i special = ~((x >= (lo)) & (x <= (hi)));                     \
+        v8i any = special;                                              \
+        for (std::size_t w = FloatLanes / 2; w > 0; w /= 2) {           \
+            for (std::size_t l = 0; l < w; ++l) any[l] |= any[l + w];   \
+        }                                                               \
+        if (any[0]) {                                                   \
+            for (std::size_t l = 0; l < FloatLanes; ++l) {              \
+                if (special[l]) y[l] = fallback(x[l]);                  \
+            }                                                           \
+        }                                                               \
+        store(out + i, y);                                              \
+    }                                                                   \
+    for (; i < n; ++i) out[i] = fallback(a[i]);
+#else
+#define VECMATH_BINARY(op)                                              \
+    for (std::size_t i = 0; i < n; ++i) out[i] = a[i] op b[i];
+
+#define VECMATH_BINARY_FLOAT(op) VECMATH_BINARY(op)
+
+#define VECMATH_UNARY(kernel, lo, hi, fallback)                         \
+    for (std::size_t i = 0; i < n; ++i) out[i] = fallback(a[i]);
+
+#define VECMATH_UNARY_FLOAT(kernel, lo, hi, fallback) VECMATH_UNARY(kernel, lo, hi, fallback)
+#endif
+
+    VECMATH_CLONES
+    void add(const double* a, const double* b, double* out, std::size_t n) {
+        VECMATH_BINARY(+)
+    }
+
+    VECMATH_CLONES
+    void subtract(const double* a, const double* b, double* out, std::size_t n) {
+        VECMATH_BINARY(-)
+    }
+
+    VECMATH_CLONES
+    void multiply(const double* a, const double* b, double* out, std::size_t n) {
+        VECMATH_BINARY(*)
+    }
+
+    VECMATH_CLONES
+    void divide(const double* a, const double* b, double* out, std::size_t n) {
+        VECMATH_BINARY(/)
+    }
+
+    void power(const double* a, const double* b, double* out, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) out[i] = std::pow(a[i], b[i]);
+    }
+
+    VECMATH_CLONES
+    void negate(const double* a, double* out, std::size_t n) {
+        std::size_t i = 0;
+#if VECMATH_VECTOR
+        for (; i + Lanes <= n; i += Lanes) {
+            store(out + i, -load(a + i));
+        }
+#endif
+        for (; i < n; ++i) out[i] = -a[i];
+    }
+
+    VECMATH_CLONES
+    void sqrt(const double* a, double* out, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) out[i] = std::sqrt(a[i]);
+    }
+
+    VECMATH_CLONES
+    void sin(const double* a, double* out, std::size_t n) {
+        VECMATH_UNARY(sinCosKernel(x, 0), -TrigLimit, TrigLimit, std::sin)
+    }
+
+    VECMATH_CLONES
+    void cos(const double* a, double* out, std::size_t n) {
+        VECMATH_UNARY(sinCosKernel(x, 1), -TrigLimit, TrigLimit, std::cos)
+    }
+
+    VECMATH_CLONES
+    void exp(const double* a, double* out, std::size_t n) {
+        VECMATH_UNARY(expKernel(x), -ExpLimit, ExpLimit, std::exp)
+    }
+
+    VECMATH_CLONES
+    void log(const double* a, double* out, std::size_t n) {
+        VECMATH_UNARY(logKernel(x), LogMin, LogMax, std::log)
+    }
+
+    double sin(double x, MathAccuracy accuracy) {
+        if (accuracy == MathAccuracy::Full || !(x >= -TrigLimit && x <= TrigLimit)) return std::sin(x);
+        return accuracy == MathAccuracy::Digits12 ? sinCosApprox<MathAccuracy::Digits12>(x, 0)
+                                                  : sinCosApprox<MathAccuracy::Digits7>(x, 0);
+    }
+
+    double cos(double x, MathAccuracy accuracy) {
+        if (accuracy == MathAccuracy::Full || !(x >= -TrigLimit && x <= TrigLimit)) return std::cos(x);
+        return accuracy == MathAccuracy::Digits12 ? sinCosApprox<MathAccuracy::Digits12>(x, 1)
+                                                  : sinCosApprox<MathAccuracy::Digits7>(x, 1);
+    }
+
+    double exp(double x, MathAccuracy accuracy) {
+        if (accuracy == MathAccuracy::Full || !(x >= -ExpLimit && x <= ExpLimit)) return std::exp(x);
+        return accuracy == MathAccuracy::Digits12 ? expApprox<MathAccuracy::Digits12>(x)
+                                                  : expApprox<MathAccuracy::Digits7>(x);
+    }
+
+    double log(double x, MathAccuracy accuracy) {
+        if (accuracy == MathAccuracy::Full || !(x >= LogMin && x <= LogMax)) return std::log(x);
+        return accuracy == MathAccuracy::Digits12 ? logApprox<MathAccuracy::Digits12>(x)
+                                                  : logApprox<MathAccuracy::Digits7>(x);
+    }
+
+#define VECMATH_TIERS(name, kernel, lo, hi)                             \
+    switch (accuracy) {                                                 \
+        case MathAccuracy::Full: {                                      \
+            name(a, out, n);                                            \
+            break;                                                      \
+        }                                                               \
+        case MathAccuracy::Digits12: {                                  \
+            constexpr MathAccuracy A = MathAccuracy::Digits12;          \
+            VECMATH_UNARY(kernel, lo, hi, std::name)                    \
+            break;                                                      \
+        }                                                               \
+        case MathAccuracy::Digits7: {                                   \
+            constexpr MathAccuracy A = MathAccuracy::Digits7;           \
+            VECMATH_UNARY(kernel, lo, hi, std::name)                    \
+            break;                                                      \
+        }                                                               \
+    }
+
+    VECMATH_CLONES
+    void sin(const double* a, double* out, std::size_t n, MathAccuracy accuracy) {
+        VECMATH_TIERS(sin, (sinCosApprox<A>(x, 0)), -TrigLimit, TrigLimit)
+    }
+
+    VECMATH_CLONES
+    void cos(const double* a, double* out, std::size_t n, MathAccuracy accuracy) {
+        VECMATH_TIERS(cos, (sinCosApprox<A>(x, 1)), -TrigLimit, TrigLimit)
+    }
+
+    VECMATH_CLONES
+    void exp(const double* a, double* out, std::size_t n, MathAccuracy accuracy) {
+        VECMATH_TIERS(exp, expApprox<A>(x), -ExpLimit, ExpLimit)
+    }
+
+    VECMATH_CLONES
+    void log(const double* a, double* out, std::size_t n, MathAccuracy accuracy) {
+        VECMATH_TIERS(log, logApprox<A>(x), LogMin, LogMax)
+    }
+
+    VECMATH_CLONES
+    void add(const float* a, const float* b, float* out, std::size_t n) {
+        VECMATH_BINARY_FLOAT(+)
+    }
+
+    VECMATH_CLONES
+    void subtract(const float* a, const float* b, float* out, std::size_t n) {
+        VECMATH_BINARY_FLOAT(-)
+    }
+
+    VECMATH_CLONES
+    void multiply(const float* a, const float* b, float* out, std::size_t n) {
+        VECMATH_BINARY_FLOAT(*)
+    }
+
+    VECMATH_CLONES
+    void divide(const float* a, const float* b, float* out, std::size_t n) {
+        VECMATH_BINARY_FLOAT(/)
+    }
+
+    void power(const float* a, const float* b, float* out, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) out[i] = std::pow(a[i], b[i]);
+    }
+
+    VECMATH_CLONES
+    void negate(const float* a, float* out, std::size_t n) {
+        std::size_t i = 0;
+#if VECMATH_VECTOR
+        for (; i + FloatLanes <= n; i += FloatLanes) {
+            store(out + i, -load(a + i));
+        }
+#endif
+        for (; i < n; ++i) out[i] = -a[i];
+    }
+
+    VECMATH_CLONES
+    void sqrt(const float* a, float* out, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) out[i] = std::sqrt(a[i]);
+    }
+
+    VECMATH_CLONES
+    void sin(const float* a, float* out, std::size_t n) {
+        VECMATH_UNARY_FLOAT(sinCosKernel(x, 0), -TrigLimitF, TrigLimitF, std::sin)
+    }
+
+    VECMATH_CLONES
+    void cos(const float* a, float* out, std::size_t n) {
+        VECMATH_UNARY_FLOAT(sinCosKernel(x, 1), -TrigLimitF, TrigLimitF, std::cos)
+    }
+
+    VECMATH_CLONES
+    void exp(const float* a, float* out, std::size_t n) {
+        VECMATH_UNARY_FLOAT(expKernel(x), ExpMinF, ExpMaxF, std::exp)
+    }
+
+    VECMATH_CLONES
+    void log(const float* a, float* out, std::size_t n) {
+        VECMATH_UNARY_FLOAT(logKernel(x), LogMinF, LogMaxF, std::log)
+    }
+
+    void sin(const float* a, float* out, std::size_t n, MathAccuracy) {
+        sin(a, out, n);
+    }
+
+    void cos(const float* a, float* out, std::size_t n, MathAccuracy) {
+        cos(a, out, n);
+    }
+
+    void exp(const float* a, float* out, std::size_t n, MathAccuracy) {
+        exp(a, out, n);
+    }
+
+    void log(const float* a, float* out, std::size_t n, MathAccuracy) {
+        log(a, out, n);
+    }
+
+}
+}
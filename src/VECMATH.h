@@ -0,0 +1,76 @@
+#ifndef VECMATH_H
+#define VECMATH_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ExpressionLibrary {
+
+    // Accuracy tiers for sin, cos, exp and ln in compiled programs. Full
+    // calls libm (batches use the kernels below, within a few ULP).
+    // Digits12 and Digits7 evaluate shorter polynomials on the same range
+    // reduction, with relative error below 1e-12 (about 4500 ULP) and 1e-7
+    // (about 4.5e8 ULP); arguments outside the reduced ranges go to libm.
+    // Near the zeros of sin and cos the bound is absolute rather than
+    // relative.
+    enum class MathAccuracy : std::uint8_t {
+        Full,
+        Digits12,
+        Digits7
+    };
+
+    // Elementwise kernels over contiguous double and float arrays used by
+    // batch evaluation. Arithmetic kernels and sqrt are exact; sin/cos/exp/log stay
+    // within a few ULP of libm and defer to libm for arguments outside their
+    // reduced range (|x| > 1e5 for sin/cos, overflow/underflow for exp, zero,
+    // negative and subnormal inputs for log). Float kernels run on twice the
+    // lanes of the double ones; their sin/cos/exp/log stay within 2 ULP and
+    // defer to libm for |x| > 8192 (sin/cos) and x outside [-87, 88] (exp).
+    // out may alias any input.
+    namespace VecMath {
+        void add(const double* a, const double* b, double* out, std::size_t n);
+        void subtract(const double* a, const double* b, double* out, std::size_t n);
+        void multiply(const double* a, const double* b, double* out, std::size_t n);
+        void divide(const double* a, const double* b, double* out, std::size_t n);
+        void power(const double* a, const double* b, double* out, std::size_t n);
+        void negate(const double* a, double* out, std::size_t n);
+        void sqrt(const double* a, double* out, std::size_t n);
+        void sin(const double* a, double* out, std::size_t n);
+        void cos(const double* a, double* out, std::size_t n);
+        void exp(const double* a, double* out, std::size_t n);
+        void log(const double* a, double* out, std::size_t n);
+
+        // Scalar and batch forms at an accuracy tier; Full is libm for the
+        // scalar forms and the kernels above for batches.
+        double sin(double x, MathAccuracy accuracy);
+        double cos(double x, MathAccuracy accuracy);
+        double exp(double x, MathAccuracy accuracy);
+        double log(double x, MathAccuracy accuracy);
+        void sin(const double* a, double* out, std::size_t n, MathAccuracy accuracy);
+        void cos(const double* a, double* out, std::size_t n, MathAccuracy accuracy);
+        void exp(const double* a, double* out, std::size_t n, MathAccuracy accuracy);
+        void log(const double* a, double* out, std::size_t n, MathAccuracy accuracy);
+
+        void add(const float* a, const float* b, float* out, std::size_t n);
+        void subtract(const float* a, const float* b, float* out, std::size_t n);
+        void multiply(const float* a, const float* b, float* out, std::size_t n);
+        void divide(const float* a, const float* b, float* out, std::size_t n);
+        void power(const float* a, const float* b, float* out, std::size_t n);
+        void negate(const float* a, float* out, std::size_t n);
+        void sqrt(const float* a, float* out, std::size_t n);
+        void sin(const float* a, float* out, std::size_t n);
+        void cos(const float* a, float* out, std::size_t n);
+        void exp(const float* a, float* out, std::size_t n);
+        void log(const float* a, float* out, std::size_t n);
+
+        // The float kernels already work to single precision, so every tier
+        // runs them.
+        void sin(const float* a, float* out, std::size_t n, MathAccuracy accuracy);
+        void cos(const float* a, float* out, std::size_t n, MathAccuracy accuracy);
+        void exp(const float* a, float* out, std::size_t n, MathAccuracy accuracy);
+        void log(const float* a, float* out, std::size_t n, MathAccuracy accuracy);
+    }
+
+}
+
+#endif // VECMATH_H
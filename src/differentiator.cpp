@@ -1,14 +1,292 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <map>
 #include <memory>
+#include <span>
+#include <vector>
 #include "EXPRESSION.h"
+#include "FORMULAFILE.h"
 #include "NODE.h"
+#include "PROFILE.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DIFFERENTIATOR_MMAP 1
+#endif
 
 void printUsage() {
     std::cout << "Usage:\n"
               << "  differentiator --eval \"expression\" var1=value1 var2=value2 ...\n"
-              << "  differentiator --diff \"expression\" --by var1\n";
+              << "  differentiator --profile \"expression\" [--repeat n] [--top n] var1=value1 ...\n"
+              << "  differentiator --eval-stream \"expression\" [--binary] [file]\n"
+              << "  differentiator --compile formulas.txt formulas.bin\n"
+              << "  differentiator --diff \"expression\" --by var1\n"
+              << "\n"
+              << "--eval-stream runs the vectorized batch kernels, whose sin, cos, exp and ln\n"
+              << "may differ from --eval's libm results by a few ULP.\n";
+}
+
+namespace {
+
+    // Collects stdout writes into large blocks.
+    class Output {
+    private:
+        std::vector<char> buffer = std::vector<char>(1 << 20);
+        std::size_t used = 0;
+
+    public:
+        ~Output() { flush(); }
+
+        void write(const char* data, std::size_t size) {
+            if (used + size > buffer.size()) flush();
+            std::memcpy(buffer.data() + used, data, size);
+            used += size;
+        }
+
+        void flush() {
+            std::fwrite(buffer.data(), 1, used, stdout);
+            used = 0;
+        }
+    };
+
+    // Evaluates rows in blocks through the batch evaluator. CSV results are
+    // printed one per line in shortest round-trip form, binary results as
+    // raw doubles.
+    class StreamEvaluator {
+    private:
+        static constexpr std::size_t BlockRows = 4096;
+
+        ExpressionLibrary::Program<double> program;
+        bool binary;
+        Output& out;
+        std::vector<std::vector<double>> columns;
+        std::vector<const double*> pointers;
+        std::vector<double> results = std::vector<double>(BlockRows);
+        std::size_t rows = 0;
+
+    public:
+        StreamEvaluator(const ExpressionLibrary::Expression<double>& expression,
+                        const std::vector<std::string>& names, bool binary, Output& out)
+            : program(expression.bind(names)), binary(binary), out(out),
+              columns(names.size(), std::vector<double>(BlockRows)) {
+            for (const auto& column : columns) pointers.push_back(column.data());
+        }
+
+        std::size_t width() const { return columns.size(); }
+
+        double* row(std::size_t column) { return &columns[column][rows]; }
+
+        void commit() {
+            if (++rows == BlockRows) flush();
+        }
+
+        void flush() {
+            if (rows == 0) return;
+            program.evaluate_batch(pointers, std::span<double>(results.data(), rows));
+            if (binary) {
+                out.write(reinterpret_cast<const char*>(results.data()), rows * sizeof(double));
+            } else {
+                char text[32];
+                for (std::size_t i = 0; i < rows; ++i) {
+                    char* end = std::to_chars(text, text + sizeof(text) - 1, results[i]).ptr;
+                    *end++ = '\n';
+                    out.write(text, end - text);
+                }
+            }
+            rows = 0;
+        }
+    };
+
+    std::vector<std::string> parseHeader(std::string_view line) {
+        std::vector<std::string> names;
+        while (true) {
+            std::size_t comma = line.find(',');
+            std::string_view name = line.substr(0, comma);
+            std::size_t first = name.find_first_not_of(" \t\r");
+            std::size_t last = name.find_last_not_of(" \t\r");
+            if (first == std::string_view::npos) {
+                throw std::runtime_error("Empty variable name in header");
+            }
+            names.emplace_back(name.substr(first, last - first + 1));
+            if (comma == std::string_view::npos) break;
+            line.remove_prefix(comma + 1);
+        }
+        return names;
+    }
+
+    // Consumes whole rows from data and returns the bytes used; a trailing
+    // partial row is left for the next call unless last is set.
+    std::size_t consumeCsv(StreamEvaluator& evaluator, const char* data, std::size_t size, bool last,
+                           std::size_t& line) {
+        const char* p = data;
+        const char* end = data + size;
+        while (p < end) {
+            const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!eol) {
+                if (!last) break;
+                eol = end;
+            }
+            ++line;
+            const char* q = p;
+            while (q < eol && (*q == ' ' || *q == '\t' || *q == '\r')) ++q;
+            if (q < eol) {
+                for (std::size_t column = 0; column < evaluator.width(); ++column) {
+                    while (q < eol && (*q == ' ' || *q == '\t')) ++q;
+                    auto [next, error] = std::from_chars(q, eol, *evaluator.row(column));
+                    if (error != std::errc()) {
+                        throw std::runtime_error("Invalid number on line " + std::to_string(line));
+                    }
+                    q = next;
+                    while (q < eol && (*q == ' ' || *q == '\t' || *q == '\r')) ++q;
+                    bool lastColumn = column + 1 == evaluator.width();
+                    if (!lastColumn && (q == eol || *q++ != ',')) {
+                        throw std::runtime_error("Expected " + std::to_string(evaluator.width())
+                                                 + " values on line " + std::to_string(line));
+                    }
+                }
+                if (q != eol) {
+                    throw std::runtime_error("Unexpected text on line " + std::to_string(line));
+                }
+                evaluator.commit();
+            }
+            p = eol < end ? eol + 1 : end;
+        }
+        return p - data;
+    }
+
+    std::size_t consumeBinary(StreamEvaluator& evaluator, const char* data, std::size_t size, bool last) {
+        std::size_t rowBytes = evaluator.width() * sizeof(double);
+        std::size_t whole = size / rowBytes;
+        if (last && whole * rowBytes != size) {
+            throw std::runtime_error("Binary input ends inside a row");
+        }
+        for (std::size_t r = 0; r < whole; ++r) {
+            for (std::size_t column = 0; column < evaluator.width(); ++column) {
+                std::memcpy(evaluator.row(column), data + r * rowBytes + column * sizeof(double), sizeof(double));
+            }
+            evaluator.commit();
+        }
+        return whole * rowBytes;
+    }
+
+    // Reads the header line and then the rows from data. Returns the bytes
+    // consumed, header included. Rows before a malformed one are still
+    // written.
+    class StreamParser {
+    private:
+        const ExpressionLibrary::Expression<double>& expression;
+        bool binary;
+        Output& out;
+        std::unique_ptr<StreamEvaluator> evaluator;
+        std::size_t line = 0;
+
+    public:
+        StreamParser(const ExpressionLibrary::Expression<double>& expression, bool binary, Output& out)
+            : expression(expression), binary(binary), out(out) {}
+
+        std::size_t consume(const char* data, std::size_t size, bool last) {
+            std::size_t used = 0;
+            if (!evaluator) {
+                const char* eol = static_cast<const char*>(std::memchr(data, '\n', size));
+                if (!eol && !last) return 0;
+                std::size_t length = eol ? eol - data : size;
+                evaluator = std::make_unique<StreamEvaluator>(expression, parseHeader({data, length}), binary, out);
+                used = eol ? length + 1 : size;
+                ++line;
+            }
+            try {
+                used += binary ? consumeBinary(*evaluator, data + used, size - used, last)
+                               : consumeCsv(*evaluator, data + used, size - used, last, line);
+            } catch (...) {
+                evaluator->flush();
+                throw;
+            }
+            if (last) evaluator->flush();
+            return used;
+        }
+    };
+
+    void streamFile(const std::string& path, StreamParser& parser) {
+#if DIFFERENTIATOR_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Cannot open " + path);
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat " + path);
+        }
+        std::size_t size = static_cast<std::size_t>(info.st_size);
+        if (size == 0) {
+            ::close(fd);
+            throw std::runtime_error("Missing header in " + path);
+        }
+        void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) throw std::runtime_error("Cannot map " + path);
+        ::madvise(mapped, size, MADV_SEQUENTIAL);
+        try {
+            parser.consume(static_cast<const char*>(mapped), size, true);
+        } catch (...) {
+            ::munmap(mapped, size);
+            throw;
+        }
+        ::munmap(mapped, size);
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file) throw std::runtime_error("Cannot open " + path);
+        std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (data.empty()) throw std::runtime_error("Missing header in " + path);
+        parser.consume(data.data(), data.size(), true);
+#endif
+    }
+
+    // Prints the hottest subexpressions by self time, one per line, with
+    // their total time, call count and NaN/Inf results; long subexpressions
+    // are cut.
+    void printProfile(const ExpressionLibrary::EvaluationProfile<double>& profile, std::size_t top) {
+        std::cout << "Result: " << profile.value() << "\n"
+                  << "Evaluations: " << profile.repetitions() << "\n"
+                  << std::setw(12) << "self us" << std::setw(12) << "total us" << std::setw(10) << "calls"
+                  << std::setw(8) << "nan" << std::setw(8) << "inf" << "  subexpression\n";
+        std::cout << std::fixed << std::setprecision(1);
+        for (std::size_t i : profile.hottest(top)) {
+            const auto& entry = profile.entries()[i];
+            std::string text = entry.node->to_string();
+            if (text.size() > 60) text = text.substr(0, 57) + "...";
+            std::cout << std::setw(12) << entry.self.count() / 1000 << std::setw(12) << entry.total.count() / 1000
+                      << std::setw(10) << entry.calls << std::setw(8) << entry.nans << std::setw(8) << entry.infinities
+                      << "  " << text << "\n";
+        }
+    }
+
+    void streamStdin(StreamParser& parser) {
+        std::vector<char> buffer(1 << 20);
+        std::size_t filled = 0;
+        bool any = false;
+        while (true) {
+            if (filled == buffer.size()) buffer.resize(buffer.size() * 2);
+            std::size_t n = std::fread(buffer.data() + filled, 1, buffer.size() - filled, stdin);
+            filled += n;
+            any = any || filled > 0;
+            bool last = n == 0;
+            if (last && !any) throw std::runtime_error("Missing header on stdin");
+            std::size_t used = parser.consume(buffer.data(), filled, last);
+            std::memmove(buffer.data(), buffer.data() + used, filled - used);
+            filled -= used;
+            if (last) break;
+        }
+    }
+
 }
 
 int main(int argc, char* argv[]) {
@@ -21,7 +299,8 @@ int main(int argc, char* argv[]) {
 
     if (command == "--eval") {
         std::string expression = argv[2];
-        std::map<std::string, double> variables;
+        std::vector<std::string> names;
+        std::vector<double> values;
 
         for (int i = 3; i < argc; ++i) {
             std::string arg = argv[i];
@@ -30,21 +309,112 @@ int main(int argc, char* argv[]) {
                 std::cerr << "Invalid variable format: " << arg << "\n";
                 return 1;
             }
-            std::string varName = arg.substr(0, pos);
-            double varValue = std::stod(arg.substr(pos + 1));
-            variables[varName] = varValue;
+            // A variable given twice keeps its last value.
+            std::string name = arg.substr(0, pos);
+            double value = std::stod(arg.substr(pos + 1));
+            auto it = std::find(names.begin(), names.end(), name);
+            if (it == names.end()) {
+                names.push_back(name);
+                values.push_back(value);
+            } else {
+                values[it - names.begin()] = value;
+            }
         }
 
         try {
-            ExpressionLibrary::Parser<double> parser(expression);
-            std::shared_ptr<ExpressionLibrary::Node<double>> root = parser.parse();
+            auto bound = ExpressionLibrary::Expression<double>::Parse(expression).bind(names);
 
-            double result = root->evaluate(variables);
+            double result = bound.evaluate(std::span<const double>(values));
             std::cout << "Result: " << result << "\n";
         } catch (const std::exception& e) {
             std::cerr << "Error: " << e.what() << "\n";
             return 1;
         }
+    } else if (command == "--profile") {
+        std::string expression = argv[2];
+        std::map<std::string, double> variables;
+        std::size_t repeat = 1000;
+        std::size_t top = 10;
+
+        try {
+            for (int i = 3; i < argc; ++i) {
+                std::string arg = argv[i];
+                if ((arg == "--repeat" || arg == "--top") && i + 1 < argc) {
+                    (arg == "--repeat" ? repeat : top) = std::stoul(argv[++i]);
+                    continue;
+                }
+                size_t pos = arg.find('=');
+                if (pos == std::string::npos) {
+                    std::cerr << "Invalid variable format: " << arg << "\n";
+                    return 1;
+                }
+                variables[arg.substr(0, pos)] = std::stod(arg.substr(pos + 1));
+            }
+
+            auto parsed = ExpressionLibrary::Expression<double>::Parse(expression);
+            printProfile(ExpressionLibrary::EvaluationProfile<double>(parsed, variables, repeat), top);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+    } else if (command == "--eval-stream") {
+        std::string expression = argv[2];
+        bool binary = false;
+        std::string path;
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--binary") {
+                binary = true;
+            } else if (path.empty()) {
+                path = arg;
+            } else {
+                printUsage();
+                return 1;
+            }
+        }
+
+        try {
+            auto parsed = ExpressionLibrary::Expression<double>::Parse(expression);
+            Output out;
+            StreamParser parser(parsed, binary, out);
+            if (path.empty() || path == "-") {
+                streamStdin(parser);
+            } else {
+                streamFile(path, parser);
+            }
+        } catch (const std::exception& e) {
+            std::fflush(stdout);
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+    } else if (command == "--compile") {
+        if (argc != 4) {
+            printUsage();
+            return 1;
+        }
+
+        try {
+            std::ifstream in(argv[2]);
+            if (!in) throw std::runtime_error(std::string("Cannot open ") + argv[2]);
+            ExpressionLibrary::FormulaWriter<double> writer;
+            std::string line;
+            for (std::size_t number = 1; std::getline(in, line); ++number) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+                try {
+                    writer.add(ExpressionLibrary::Expression<double>::Parse(line), line);
+                } catch (const std::exception& e) {
+                    throw std::runtime_error("line " + std::to_string(number) + ": " + e.what());
+                }
+            }
+            std::ofstream out(argv[3], std::ios::binary);
+            if (!out) throw std::runtime_error(std::string("Cannot create ") + argv[3]);
+            writer.write(out);
+            std::cout << "Compiled " << writer.size() << " formulas\n";
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
     } else if (command == "--diff") {
         if (argc < 5 || std::string(argv[3]) != "--by") {
             printUsage();
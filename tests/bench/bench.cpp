@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <complex>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <span>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "EXPRESSION.h"
+#include "FORMULAFILE.h"
+#include "INCREMENTAL.h"
+#include "PARSECACHE.h"
+
+using namespace ExpressionLibrary;
+
+// Every heap allocation in the process goes through these, so the difference
+// in the counter around a timed loop is the allocations of the operation.
+namespace {
+    std::atomic<std::size_t> allocations{0};
+}
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    std::size_t alignment = static_cast<std::size_t>(align);
+    if (void* p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) {
+    return ::operator new(size, align);
+}
+
+// GCC pairs free with malloc, not with the operator new above that wraps
+// it, and flags these as mismatched once it inlines them.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+
+namespace {
+
+    const char* const Variables[] = {"x", "y", "z", "w"};
+
+    // A sum of n distinct terms: wide and shallow.
+    std::string wide(std::size_t n) {
+        const char* const shapes[] = {"sin(%a * %b)", "exp(%a) * cos(%b)", "ln(%a + %b) / %a", "%a ^ %b", "-(%a - %b) * %a"};
+        std::string result;
+        for (std::size_t i = 0; i < n; ++i) {
+            std::string term = shapes[i % 5];
+            std::string a = Variables[i % 4];
+            std::string b = Variables[(i / 5 + 1) % 4];
+            for (std::size_t pos; (pos = term.find("%a")) != std::string::npos;) term.replace(pos, 2, a);
+            for (std::size_t pos; (pos = term.find("%b")) != std::string::npos;) term.replace(pos, 2, b);
+            result += (i ? " + " : "") + term;
+        }
+        return result;
+    }
+
+    // n nested layers, each using the previous one twice: the tree doubles in
+    // size every fourth layer while the hash-consed graph stays linear.
+    std::string deep(std::size_t n) {
+        std::string result = "x";
+        for (std::size_t i = 0; i < n; ++i) {
+            std::string v = Variables[i % 4];
+            switch (i % 4) {
+                case 0: result = "sin(" + result + " + " + v + ")"; break;
+                case 1: result = "(" + result + ") * " + v + " - y"; break;
+                case 2: result = "cos(" + result + ") / (" + v + " + z)"; break;
+                case 3: result = "ln(" + result + " * " + result + " + " + v + ")"; break;
+            }
+        }
+        return result;
+    }
+
+    // Tree nodes count shared subtrees once per use; unique nodes once.
+    template <typename T>
+    std::pair<double, std::size_t> countNodes(const std::shared_ptr<Node<T>>& root) {
+        std::unordered_map<const Node<T>*, double> sizes;
+        std::function<double(const Node<T>&)> walk = [&](const Node<T>& node) {
+            auto it = sizes.find(&node);
+            if (it != sizes.end()) return it->second;
+            double size = 1;
+            for (std::size_t i = 0; i < node.arity(); ++i) {
+                size += walk(*node.operand(i));
+            }
+            sizes.emplace(&node, size);
+            return size;
+        };
+        return {walk(*root), sizes.size()};
+    }
+
+    template <typename T>
+    const char* typeName() {
+        return std::is_same_v<T, double> ? "double" : std::is_same_v<T, float> ? "float" : "complex";
+    }
+
+    template <typename T>
+    T sample(std::size_t i) {
+        if constexpr (std::is_floating_point_v<T>) {
+            return T(0.3 + 0.2 * i);
+        } else {
+            return T(0.3 + 0.2 * i, 0.1 - 0.05 * i);
+        }
+    }
+
+    volatile std::size_t sink;
+
+    struct Measurement {
+        double nsPerOp;
+        double allocationsPerOp;
+    };
+
+    // Repeats op until minTime has elapsed, at least once.
+    Measurement measure(const std::function<std::size_t()>& op, std::chrono::nanoseconds minTime) {
+        sink = op();
+        std::size_t iterations = 0;
+        std::size_t before = allocations.load();
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::nanoseconds(0);
+        while (elapsed < minTime) {
+            sink = op();
+            ++iterations;
+            elapsed = std::chrono::steady_clock::now() - start;
+        }
+        std::size_t allocated = allocations.load() - before;
+        return {double(elapsed.count()) / iterations, double(allocated) / iterations};
+    }
+
+    void report(const char* type, const char* shape, std::size_t size, const char* op,
+                const Measurement& m, std::pair<double, std::size_t> nodes) {
+        std::cout << type << ',' << shape << ',' << size << ',' << op << ','
+                  << m.nsPerOp << ',' << m.allocationsPerOp << ','
+                  << nodes.first << ',' << nodes.second << '\n';
+    }
+
+    template <typename T>
+    void run(const char* shape, std::size_t size, const std::string& text, std::chrono::nanoseconds minTime) {
+        const char* type = typeName<T>();
+        auto root = Parser<T>(text).parse();
+        auto nodes = countNodes(root);
+        NodeFactory<T> factory;
+        Differentiation<T> d(factory, "x");
+        auto derivativeNodes = countNodes(d(factory.intern(root)));
+        auto substitutedNodes = countNodes(factory.substitute(root, "x", sample<T>(0)));
+
+        auto expr = Expression<T>::Parse(text);
+        std::map<std::string, T> vars;
+        for (std::size_t i = 0; i < 4; ++i) {
+            vars[Variables[i]] = sample<T>(i);
+        }
+
+        report(type, shape, size, "parse",
+               measure([&] { Expression<T>::Parse(text); return std::size_t(1); }, minTime), nodes);
+        ParseCache<T> cache(16);
+        cache.parse(text);
+        report(type, shape, size, "parse_cached",
+               measure([&] { cache.parse(text); return std::size_t(1); }, minTime), nodes);
+        FormulaWriter<T> writer;
+        writer.add(expr);
+        std::ostringstream stream;
+        writer.write(stream);
+        std::string bytes = stream.str();
+        auto mapped = MappedFile::copy(std::as_bytes(std::span(bytes)));
+        report(type, shape, size, "load",
+               measure([&] { return FormulaFile<T>(mapped).size(); }, minTime), nodes);
+        FormulaFile<T> file(mapped);
+        report(type, shape, size, "load_expression",
+               measure([&] { file.expression(0); return std::size_t(1); }, minTime), nodes);
+        report(type, shape, size, "evaluate",
+               measure([&] { return std::size_t(std::abs(expr.evaluate(vars)) > 0); }, minTime), nodes);
+        IncrementalEvaluator<T> incremental(expr, vars);
+        std::size_t flip = 0;
+        report(type, shape, size, "evaluate_incremental",
+               measure([&] {
+                   incremental.set("x", sample<T>(++flip & 1));
+                   return std::size_t(std::abs(incremental.evaluate()) > 0);
+               }, minTime), nodes);
+        if constexpr (std::is_same_v<T, double>) {
+            auto program = expr.bind(std::vector<std::string>(Variables, Variables + 4));
+            auto jit = JitFunction(program);
+            std::vector<double> values;
+            for (const auto& name : program.variables()) values.push_back(vars[name]);
+            report(type, shape, size, "evaluate_program",
+                   measure([&] { return std::size_t(program.evaluate(std::span<const double>(values)) > 0); }, minTime), nodes);
+            report(type, shape, size, "evaluate_jit",
+                   measure([&] { return std::size_t(jit(values.data()) > 0); }, minTime), nodes);
+            for (auto [tier, name] : {std::pair{MathAccuracy::Digits12, "evaluate_program/digits12"},
+                                      std::pair{MathAccuracy::Digits7, "evaluate_program/digits7"}}) {
+                auto approximate = program.approximate(tier);
+                report(type, shape, size, name,
+                       measure([&] { return std::size_t(approximate.evaluate(std::span<const double>(values)) > 0); }, minTime), nodes);
+            }
+        }
+        report(type, shape, size, "differentiate",
+               measure([&] { expr.differentiate("x"); return std::size_t(1); }, minTime),
+               derivativeNodes);
+        report(type, shape, size, "substitute",
+               measure([&] { expr.substitute("x", sample<T>(0)); return std::size_t(1); }, minTime),
+               substitutedNodes);
+        report(type, shape, size, "to_string",
+               measure([&] { return expr.ToString().size(); }, minTime), nodes);
+    }
+
+    // Batch rows report per-row cost over a column batch, serially and on
+    // pools of increasing size.
+    template <typename T>
+    void runBatch(const char* shape, std::size_t size, const std::string& text, std::chrono::nanoseconds minTime) {
+        const char* type = typeName<T>();
+        auto nodes = countNodes(Parser<T>(text).parse());
+        auto program = Expression<T>::Parse(text).bind({"x", "y", "z", "w"});
+        const std::size_t rows = 1 << 18;
+        std::vector<std::vector<T>> data(4, std::vector<T>(rows));
+        std::vector<const T*> columns;
+        for (std::size_t i = 0; i < 4; ++i) {
+            for (std::size_t r = 0; r < rows; ++r) {
+                data[i][r] = sample<T>(i + r % 7);
+            }
+            columns.push_back(data[i].data());
+        }
+        std::vector<T> out(rows);
+
+        auto perRow = [&](Measurement m) {
+            m.nsPerOp /= rows;
+            m.allocationsPerOp /= rows;
+            return m;
+        };
+        report(type, shape, size, "evaluate_batch",
+               perRow(measure([&] { program.evaluate_batch(columns, out); return std::size_t(1); }, minTime)), nodes);
+        if constexpr (std::is_same_v<T, double>) {
+            for (auto [tier, name] : {std::pair{MathAccuracy::Digits12, "evaluate_batch/digits12"},
+                                      std::pair{MathAccuracy::Digits7, "evaluate_batch/digits7"}}) {
+                auto approximate = program.approximate(tier);
+                report(type, shape, size, name,
+                       perRow(measure([&] { approximate.evaluate_batch(columns, out); return std::size_t(1); }, minTime)), nodes);
+            }
+        }
+        if constexpr (std::is_floating_point_v<T>) {
+            report(type, shape, size, "evaluate_sum/double",
+                   perRow(measure([&] { return std::size_t(program.template evaluate_sum<double>(columns, rows) > 0); }, minTime)), nodes);
+        }
+        std::size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+        for (std::size_t threads = 1; threads <= hardware; threads *= 2) {
+            ThreadPool pool(threads);
+            std::string op = "evaluate_parallel/" + std::to_string(threads);
+            report(type, shape, size, op.c_str(),
+                   perRow(measure([&] { program.evaluate_parallel(columns, out, pool); return std::size_t(1); }, minTime)), nodes);
+        }
+    }
+
+}
+
+// Prints one CSV row per (type, shape, size, operation). Optional argument:
+// minimum measuring time per row in milliseconds (default 200).
+int main(int argc, char* argv[]) {
+    std::chrono::nanoseconds minTime = std::chrono::milliseconds(argc > 1 ? std::atoi(argv[1]) : 200);
+    std::cout.precision(12);
+    std::cout << "type,shape,size,op,ns_per_op,allocs_per_op,tree_nodes,unique_nodes\n";
+    for (std::size_t size : {10, 100, 1000}) {
+        std::string text = wide(size);
+        run<double>("wide", size, text, minTime);
+        run<std::complex<double>>("wide", size, text, minTime);
+    }
+    runBatch<float>("wide", 10, wide(10), minTime);
+    runBatch<double>("wide", 10, wide(10), minTime);
+    runBatch<std::complex<double>>("wide", 10, wide(10), minTime);
+    for (std::size_t size : {4, 16, 48}) {
+        std::string text = deep(size);
+        run<double>("deep", size, text, minTime);
+        run<std::complex<double>>("deep", size, text, minTime);
+    }
+    return 0;
+}
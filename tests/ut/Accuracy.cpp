@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <limits>
+#include <random>
+#include "../../src/EXPRESSION.h"
+#include "../../src/VECMATH.h"
+
+using namespace ExpressionLibrary;
+
+namespace {
+
+    using Scalar = double (*)(double, MathAccuracy);
+    using Batch = void (*)(const double*, double*, std::size_t, MathAccuracy);
+    using Reference = double (*)(double);
+
+    double relativeError(double actual, double expected) {
+        if (std::isnan(actual) && std::isnan(expected)) return 0.0;
+        if (actual == expected) return 0.0;
+        return std::fabs(actual - expected) / std::max(std::fabs(expected), std::numeric_limits<double>::min());
+    }
+
+    std::vector<double> uniform(std::size_t n, double lo, double hi, unsigned seed) {
+        std::mt19937_64 gen(seed);
+        std::uniform_real_distribution<double> dist(lo, hi);
+        std::vector<double> values(n);
+        for (auto& v : values) v = dist(gen);
+        return values;
+    }
+
+    // Checks the scalar and the batch form of a function against libm.
+    void expectWithin(Scalar scalar, Batch batch, Reference reference, MathAccuracy accuracy,
+                      const std::vector<double>& input, double bound) {
+        std::vector<double> out(input.size());
+        batch(input.data(), out.data(), input.size(), accuracy);
+        for (std::size_t i = 0; i < input.size(); ++i) {
+            double expected = reference(input[i]);
+            ASSERT_LE(relativeError(scalar(input[i], accuracy), expected), bound) << "x = " << input[i];
+            ASSERT_LE(relativeError(out[i], expected), bound) << "x = " << input[i];
+        }
+    }
+
+    const MathAccuracy tiers[] = {MathAccuracy::Digits12, MathAccuracy::Digits7};
+
+    double bound(MathAccuracy accuracy) {
+        return accuracy == MathAccuracy::Digits12 ? 1e-12 : 1e-7;
+    }
+
+    Scalar sinAt = VecMath::sin;
+    Scalar cosAt = VecMath::cos;
+    Scalar expAt = VecMath::exp;
+    Scalar logAt = VecMath::log;
+    Batch sinBatch = VecMath::sin;
+    Batch cosBatch = VecMath::cos;
+    Batch expBatch = VecMath::exp;
+    Batch logBatch = VecMath::log;
+    Reference sinRef = std::sin;
+    Reference cosRef = std::cos;
+    Reference expRef = std::exp;
+    Reference logRef = std::log;
+
+}
+
+TEST(AccuracyTest, ExpTiers) {
+    for (MathAccuracy accuracy : tiers) {
+        expectWithin(expAt, expBatch, expRef, accuracy, uniform(1 << 16, -700.0, 700.0, 1), bound(accuracy));
+        expectWithin(expAt, expBatch, expRef, accuracy, uniform(1 << 16, -1.0, 1.0, 2), bound(accuracy));
+    }
+}
+
+TEST(AccuracyTest, LogTiers) {
+    for (MathAccuracy accuracy : tiers) {
+        expectWithin(logAt, logBatch, logRef, accuracy, uniform(1 << 16, 1e-300, 1e300, 3), bound(accuracy));
+        expectWithin(logAt, logBatch, logRef, accuracy, uniform(1 << 16, 0.5, 2.0, 4), bound(accuracy));
+        expectWithin(logAt, logBatch, logRef, accuracy, uniform(1 << 16, 1.0 - 1e-6, 1.0 + 1e-6, 5), bound(accuracy));
+    }
+}
+
+TEST(AccuracyTest, SinCosTiers) {
+    for (MathAccuracy accuracy : tiers) {
+        for (double range : {1.0, 100.0, 1e5}) {
+            expectWithin(sinAt, sinBatch, sinRef, accuracy, uniform(1 << 16, -range, range, 6), bound(accuracy));
+            expectWithin(cosAt, cosBatch, cosRef, accuracy, uniform(1 << 16, -range, range, 7), bound(accuracy));
+        }
+    }
+}
+
+TEST(AccuracyTest, SpecialValuesMatchLibm) {
+    const double inf = std::numeric_limits<double>::infinity();
+    std::vector<double> input{0.0, -0.0, inf, -inf, std::nan(""), 1e-310, -1.0, 800.0, -800.0, 1e6, 709.5, -745.5};
+    for (MathAccuracy accuracy : tiers) {
+        // NaN, infinities, zeros and overflow only compare equal to libm.
+        expectWithin(expAt, expBatch, expRef, accuracy, input, bound(accuracy));
+        expectWithin(logAt, logBatch, logRef, accuracy, input, bound(accuracy));
+        expectWithin(sinAt, sinBatch, sinRef, accuracy, input, bound(accuracy));
+        expectWithin(cosAt, cosBatch, cosRef, accuracy, input, bound(accuracy));
+        EXPECT_TRUE(std::signbit(VecMath::sin(-0.0, accuracy)));
+        EXPECT_EQ(VecMath::exp(0.0, accuracy), 1.0);
+        EXPECT_EQ(VecMath::log(1.0, accuracy), 0.0);
+    }
+}
+
+TEST(AccuracyTest, FullIsLibm) {
+    for (double x : uniform(1000, -50.0, 50.0, 8)) {
+        EXPECT_EQ(VecMath::sin(x, MathAccuracy::Full), std::sin(x));
+        EXPECT_EQ(VecMath::cos(x, MathAccuracy::Full), std::cos(x));
+        EXPECT_EQ(VecMath::exp(x, MathAccuracy::Full), std::exp(x));
+        EXPECT_EQ(VecMath::log(std::fabs(x), MathAccuracy::Full), std::log(std::fabs(x)));
+    }
+}
+
+TEST(AccuracyTest, ApproximateProgram) {
+    auto expr = Expression<double>::Parse("sin(x) * cos(y) + exp(x / 4) - ln(y)");
+    auto full = expr.bind({"x", "y"});
+    EXPECT_EQ(full.accuracy(), MathAccuracy::Full);
+    for (MathAccuracy accuracy : tiers) {
+        auto program = full.approximate(accuracy);
+        EXPECT_EQ(program.accuracy(), accuracy);
+        EXPECT_EQ(program.instructions().size(), full.instructions().size());
+
+        std::size_t rows = 1000;
+        auto x = uniform(rows, -3.0, 3.0, 9);
+        auto y = uniform(rows, 0.5, 3.0, 10);
+        const double* columns[] = {x.data(), y.data()};
+        std::vector<double> out(rows);
+        program.evaluate_batch(columns, out);
+        auto jit = JitFunction(program);
+        for (std::size_t i = 0; i < rows; ++i) {
+            double row[] = {x[i], y[i]};
+            double expected = full.evaluate(std::span<const double>(row));
+            double value = program.evaluate(std::span<const double>(row));
+            // Absolute, as the terms can cancel.
+            EXPECT_NEAR(value, expected, 10 * bound(accuracy));
+            EXPECT_NEAR(out[i], expected, 10 * bound(accuracy));
+            EXPECT_EQ(jit(row), value);
+            EXPECT_EQ(program.view().evaluate(row), value);
+        }
+
+        std::vector<double> gradient(2), expectedGradient(2);
+        double values[] = {0.7, 1.3};
+        program.evaluate_with_gradient(values, gradient);
+        full.evaluate_with_gradient(values, expectedGradient);
+        EXPECT_NEAR(gradient[0], expectedGradient[0], 10 * bound(accuracy));
+        EXPECT_NEAR(gradient[1], expectedGradient[1], 10 * bound(accuracy));
+        EXPECT_EQ(program.bind({"y", "x"}).accuracy(), accuracy);
+    }
+}
+
+TEST(AccuracyTest, OtherTypesIgnoreTiers) {
+    using C = std::complex<double>;
+    Expression<C> z("z");
+    auto expr = z.sin() + z.exp();
+    auto program = expr.compile().approximate(MathAccuracy::Digits7);
+    std::map<std::string, C> vars{{"z", C(0.5, 1.0)}};
+    EXPECT_EQ(program.evaluate(vars), expr.compile().evaluate(vars));
+    auto f = Expression<float>::Parse("sin(x) + ln(x)").compile();
+    EXPECT_EQ(f.approximate(MathAccuracy::Digits7).evaluate({{"x", 0.5f}}), f.evaluate({{"x", 0.5f}}));
+}
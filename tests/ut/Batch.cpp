@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <limits>
+#include <random>
+#include "../../src/EXPRESSION.h"
+#include "../../src/VECMATH.h"
+
+using namespace ExpressionLibrary;
+
+namespace {
+
+    double ulpDistance(double actual, double expected) {
+        if (std::isnan(actual) && std::isnan(expected)) return 0.0;
+        if (actual == expected) return 0.0;
+        double ulp = std::nextafter(std::fabs(expected), std::numeric_limits<double>::infinity()) - std::fabs(expected);
+        return std::fabs(actual - expected) / ulp;
+    }
+
+    std::vector<double> uniform(std::size_t n, double lo, double hi, unsigned seed) {
+        std::mt19937_64 gen(seed);
+        std::uniform_real_distribution<double> dist(lo, hi);
+        std::vector<double> values(n);
+        for (auto& v : values) v = dist(gen);
+        return values;
+    }
+
+    void expectWithinUlps(void (*kernel)(const double*, double*, std::size_t), double (*reference)(double),
+                          const std::vector<double>& input, double maxUlps) {
+        std::vector<double> out(input.size());
+        kernel(input.data(), out.data(), input.size());
+        for (std::size_t i = 0; i < input.size(); ++i) {
+            ASSERT_LE(ulpDistance(out[i], reference(input[i])), maxUlps) << "x = " << input[i];
+        }
+    }
+
+}
+
+TEST(BatchTest, ArithmeticMatchesScalarExactly) {
+    auto expr = Expression<double>::Parse("(x + y) * (x - y) / -(y * 3)");
+    auto program = expr.bind({"x", "y"});
+    std::size_t rows = 1003;
+    auto x = uniform(rows, -10.0, 10.0, 1);
+    auto y = uniform(rows, 0.5, 10.0, 2);
+    const double* columns[] = {x.data(), y.data()};
+    std::vector<double> out(rows);
+    program.evaluate_batch(columns, out);
+    for (std::size_t i = 0; i < rows; ++i) {
+        double row[] = {x[i], y[i]};
+        EXPECT_EQ(out[i], program.evaluate(std::span<const double>(row)));
+    }
+}
+
+TEST(BatchTest, TranscendentalsCloseToScalar) {
+    auto expr = Expression<double>::Parse("sin(x) * cos(y) + exp(x / 4) - ln(y)");
+    std::size_t rows = 777;
+    auto x = uniform(rows, -20.0, 20.0, 3);
+    auto y = uniform(rows, 0.1, 50.0, 4);
+    const double* columns[] = {y.data(), x.data()};
+    std::vector<double> out(rows);
+    expr.evaluate_batch({"y", "x"}, columns, out);
+    for (std::size_t i = 0; i < rows; ++i) {
+        double expected = expr.evaluate_tree({{"x", x[i]}, {"y", y[i]}});
+        EXPECT_NEAR(out[i], expected, 1e-13 * std::max(1.0, std::fabs(expected)));
+    }
+}
+
+TEST(BatchTest, ComplexMatchesScalar) {
+    using C = std::complex<double>;
+    Expression<C> z("z");
+    auto expr = (z * z).sin() + z.exp();
+    std::vector<C> column{C(0.1, 0.2), C(-1.0, 3.0), C(2.5, -0.5)};
+    const C* columns[] = {column.data()};
+    std::vector<C> out(column.size());
+    expr.evaluate_batch({"z"}, columns, out);
+    for (std::size_t i = 0; i < column.size(); ++i) {
+        EXPECT_EQ(out[i], expr.evaluate_tree({{"z", column[i]}}));
+    }
+}
+
+TEST(BatchTest, MissingColumnsThrow) {
+    auto program = Expression<double>::Parse("x + y").compile();
+    std::vector<double> x{1.0};
+    const double* columns[] = {x.data()};
+    std::vector<double> out(1);
+    EXPECT_THROW(program.evaluate_batch(columns, out), std::invalid_argument);
+}
+
+TEST(VecMathTest, ExpAccuracy) {
+    expectWithinUlps(VecMath::exp, std::exp, uniform(1 << 16, -700.0, 700.0, 5), 2.0);
+    expectWithinUlps(VecMath::exp, std::exp, uniform(1 << 16, -1.0, 1.0, 6), 2.0);
+}
+
+TEST(VecMathTest, LogAccuracy) {
+    expectWithinUlps(VecMath::log, std::log, uniform(1 << 16, 1e-300, 1e300, 7), 2.0);
+    expectWithinUlps(VecMath::log, std::log, uniform(1 << 16, 0.9, 1.1, 8), 2.0);
+}
+
+TEST(VecMathTest, SinCosAccuracy) {
+    for (double range : {1.0, 10.0, 1e5}) {
+        expectWithinUlps(VecMath::sin, std::sin, uniform(1 << 16, -range, range, 9), 2.0);
+        expectWithinUlps(VecMath::cos, std::cos, uniform(1 << 16, -range, range, 10), 2.0);
+    }
+}
+
+TEST(VecMathTest, SpecialValuesMatchLibm) {
+    const double inf = std::numeric_limits<double>::infinity();
+    std::vector<double> input{0.0, -0.0, inf, -inf, std::nan(""), 1e-310, -1.0, 800.0, -800.0, 1e6, 709.5, -745.5};
+    expectWithinUlps(VecMath::exp, std::exp, input, 2.0);
+    expectWithinUlps(VecMath::log, std::log, input, 2.0);
+    expectWithinUlps(VecMath::sin, std::sin, input, 2.0);
+    expectWithinUlps(VecMath::cos, std::cos, input, 2.0);
+    double zeros[4] = {-0.0, -0.0, -0.0, -0.0};
+    VecMath::sin(zeros, zeros, 4);
+    for (double z : zeros) {
+        EXPECT_TRUE(std::signbit(z));
+    }
+}
@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+#include "../../src/DERIVATIVES.h"
+
+using namespace ExpressionLibrary;
+
+namespace {
+
+    const char* formulas[] = {
+        "x * sin(x) + y",
+        "(x + y) * (x - y) / (x ^ 2 + 1)",
+        "exp(-x) * cos(y ^ 3) - ln(x + z)",
+        "x ^ y * z",
+        "sin(x * y * z) * sin(x * y * z) + 2",
+        "3",
+    };
+
+}
+
+TEST(DerivativesTest, MatchesRepeatedDifferentiation) {
+    const std::vector<std::string> names{"x", "y", "z"};
+    std::map<std::string, double> vars{{"x", 0.7}, {"y", 1.3}, {"z", 2.5}};
+    std::vector<double> values{0.7, 1.3, 2.5};
+    for (const char* formula : formulas) {
+        auto f = Expression<double>::Parse(formula);
+        DerivativeProgram<double> program(f, names);
+        double value;
+        std::vector<double> gradient(3), hessian(9);
+        program.evaluate(values, std::span(&value, 1), gradient, hessian);
+        EXPECT_EQ(value, f.evaluate_tree(vars)) << formula;
+        for (std::size_t i = 0; i < 3; ++i) {
+            auto di = f.differentiate(names[i], true);
+            EXPECT_EQ(gradient[i], di.evaluate_tree(vars)) << formula << " d" << names[i];
+            for (std::size_t j = 0; j < 3; ++j) {
+                auto expected = (i <= j ? di.differentiate(names[j], true)
+                                        : f.differentiate(names[j], true).differentiate(names[i], true)).evaluate_tree(vars);
+                EXPECT_EQ(hessian[i * 3 + j], expected) << formula << " d" << names[i] << "d" << names[j];
+            }
+        }
+    }
+}
+
+TEST(DerivativesTest, JacobianOfSeveralFunctions) {
+    std::vector<Expression<double>> functions{
+        Expression<double>::Parse("x * y"),
+        Expression<double>::Parse("sin(x * y) + y"),
+        Expression<double>::Parse("w"),
+    };
+    DerivativeProgram<double> program(functions, {"y", "x", "w"}, 1);
+    EXPECT_EQ(program.functions(), 3u);
+    EXPECT_EQ(program.order(), 1u);
+    std::vector<double> values{2.0, 0.5, 4.0};
+    std::vector<double> value(3), jacobian(9);
+    program.evaluate(values, value, jacobian);
+    EXPECT_EQ(value, (std::vector<double>{1.0, std::sin(1.0) + 2.0, 4.0}));
+    EXPECT_EQ(jacobian, (std::vector<double>{
+        0.5, 2.0, 0.0,
+        std::cos(1.0) * 0.5 + 1.0, std::cos(1.0) * 2.0, 0.0,
+        0.0, 0.0, 1.0,
+    }));
+
+    std::vector<double> hessian(27);
+    EXPECT_THROW(program.evaluate(values, value, jacobian, hessian), std::invalid_argument);
+    EXPECT_THROW(program.evaluate(values, std::span(value).first(2), jacobian), std::invalid_argument);
+    EXPECT_THROW(DerivativeProgram<double>(functions, {"x", "y"}), std::runtime_error);
+    EXPECT_THROW(DerivativeProgram<double>(functions, {"x", "y", "w"}, 3), std::invalid_argument);
+}
+
+TEST(DerivativesTest, VariableExponents) {
+    std::vector<Expression<double>> functions{
+        Expression<double>::Parse("x ^ y * z"),
+        Expression<double>::Parse("2 ^ x"),
+        Expression<double>::Parse("(x + 1) ^ (x * y)"),
+    };
+    const std::vector<std::string> names{"x", "y", "z"};
+    DerivativeProgram<double> program(functions, names);
+    std::map<std::string, double> vars{{"x", 0.7}, {"y", 1.3}, {"z", 2.5}};
+    std::vector<double> values{0.7, 1.3, 2.5};
+    std::vector<double> value(3), jacobian(9), hessian(27);
+    program.evaluate(values, value, jacobian, hessian);
+    for (std::size_t f = 0; f < functions.size(); ++f) {
+        auto [expected, gradient] = functions[f].evaluate_with_gradient(vars);
+        EXPECT_EQ(value[f], expected) << f;
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            double g = gradient[names[i]];
+            EXPECT_NEAR(jacobian[f * 3 + i], g, 1e-14 * std::max(1.0, std::fabs(g))) << f << " d" << names[i];
+        }
+    }
+    double ln2 = std::log(2.0);
+    EXPECT_NEAR(jacobian[1 * 3 + 0], std::pow(2.0, 0.7) * ln2, 1e-15);
+    EXPECT_NEAR(hessian[(1 * 3 + 0) * 3 + 0], std::pow(2.0, 0.7) * ln2 * ln2, 1e-15);
+    // d/dy (x ^ y * z) = x ^ y * ln(x) * z, and its x-derivative.
+    EXPECT_NEAR(hessian[1], std::pow(0.7, 0.3) * (1.3 * std::log(0.7) + 1) * 2.5, 1e-14);
+}
+
+TEST(DerivativesTest, SharesWorkAcrossOutputs) {
+    // f = sin(x0 + ... + x7) * exp(x0 * ... * x7): every derivative reuses
+    // the sum, the product and their sin/cos/exp.
+    const std::size_t n = 8;
+    std::vector<std::string> names;
+    std::string sum = "x0", product = "x0";
+    for (std::size_t i = 0; i < n; ++i) {
+        names.push_back("x" + std::to_string(i));
+        if (i > 0) {
+            sum += " + " + names.back();
+            product += " * " + names.back();
+        }
+    }
+    auto f = Expression<double>::Parse("sin(" + sum + ") * exp(" + product + ")");
+    DerivativeProgram<double> program(f, names);
+
+    std::size_t separate = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        auto di = f.differentiate(names[i], true);
+        separate += di.compile().instructions().size();
+        for (std::size_t j = i; j < n; ++j) {
+            separate += di.differentiate(names[j], true).compile().instructions().size();
+        }
+    }
+    // 1 value, 8 gradient and 36 Hessian outputs.
+    EXPECT_LT(program.program().instructions().size() * 4, separate);
+
+    std::vector<double> values(n, 0.5);
+    std::vector<double> gradient(n), hessian(n * n);
+    double value;
+    program.evaluate(values, std::span(&value, 1), gradient, hessian);
+    std::map<std::string, double> vars;
+    for (const auto& name : names) vars[name] = 0.5;
+    EXPECT_EQ(value, f.evaluate_tree(vars));
+    EXPECT_EQ(hessian[2 * n + 5], hessian[5 * n + 2]);
+    EXPECT_EQ(hessian[2 * n + 5], f.differentiate("x2", true).differentiate("x5", true).evaluate_tree(vars));
+}
+
+TEST(DerivativesTest, Complex) {
+    using C = std::complex<double>;
+    Expression<C> z("z");
+    Expression<C> w("w");
+    auto f = (z * w).sin() + z.exp() / w;
+    DerivativeProgram<C> program(f, {"z", "w"});
+    std::map<std::string, C> vars{{"z", C(0.5, 1.0)}, {"w", C(-2.0, 0.25)}};
+    std::vector<C> values{vars["z"], vars["w"]};
+    std::vector<C> gradient(2), hessian(4);
+    program.evaluate(values, {}, gradient, hessian);
+    EXPECT_EQ(gradient[1], f.differentiate("w", true).evaluate_tree(vars));
+    EXPECT_EQ(hessian[1], f.differentiate("z", true).differentiate("w", true).evaluate_tree(vars));
+}
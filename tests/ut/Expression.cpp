@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+#include "../../src/EXPRESSION.h"
+
+using namespace ExpressionLibrary;
+
+TEST(ExpressionTest, CopySharesNodes) {
+    auto expr = Expression<double>::Parse("x * sin(x * y) * exp(x / y) + ln(x * x + y) ^ 2 / cos(x)");
+    auto derivative = expr.differentiate("x").differentiate("x").differentiate("x");
+    Expression<double> copy(derivative);
+    EXPECT_EQ(copy.compile().instructions().size(), derivative.compile().instructions().size());
+
+    Expression<double> assigned(0.0);
+    assigned = derivative;
+    EXPECT_EQ(assigned.compile().instructions().size(), derivative.compile().instructions().size());
+    EXPECT_EQ(assigned.ToString(), derivative.ToString());
+}
+
+TEST(ExpressionTest, MoveAssignment) {
+    Expression<double> target(1.0);
+    Expression<double> source = Expression<double>::Parse("x + 1");
+    target = std::move(source);
+    EXPECT_EQ(target.ToString(), "(x + 1)");
+    EXPECT_DOUBLE_EQ(target.evaluate({{"x", 2.0}}), 3.0);
+}
+
+TEST(ExpressionTest, TransformationsLeaveOriginalIntact) {
+    auto expr = Expression<double>::Parse("x * y + sin(y)");
+    auto copy = expr;
+    auto substituted = copy.substitute("x", 3.0);
+    auto derivative = copy.differentiate("y");
+    EXPECT_EQ(expr.ToString(), "((x * y) + sin(y))");
+    EXPECT_EQ(copy.ToString(), expr.ToString());
+    EXPECT_EQ(substituted.ToString(), "((3 * y) + sin(y))");
+    EXPECT_DOUBLE_EQ(derivative.evaluate({{"x", 2.0}, {"y", 0.0}}), 3.0);
+}
+
+TEST(ExpressionTest, EvaluatesSharedNodesOnce) {
+    // x^(2^40) as 40 nested squarings; its derivative tree has ~2^40 paths.
+    Expression<double> expr("x");
+    for (int i = 0; i < 40; ++i) {
+        expr = expr * expr;
+    }
+    auto derivative = expr.differentiate("x");
+    EXPECT_GT(derivative.stats().nodes, std::uint64_t(1) << 40);
+    EXPECT_LT(derivative.stats().uniqueNodes, 200u);
+    std::map<std::string, double> vars{{"x", 1.0}};
+    EXPECT_EQ(expr.evaluate(vars), 1.0);
+    EXPECT_EQ(derivative.evaluate(vars), std::ldexp(1.0, 40));
+    EXPECT_EQ(expr.evaluate_with_gradient(vars).second["x"], std::ldexp(1.0, 40));
+    EXPECT_EQ(expr.evaluate_with_tangent(vars, {{"x", 1.0}}).second, std::ldexp(1.0, 40));
+
+    Expression<double> copy(derivative);
+    EXPECT_EQ(copy.evaluate({{"x", -1.0}}), -std::ldexp(1.0, 40));
+    EXPECT_THROW(derivative.evaluate({}), std::runtime_error);
+}
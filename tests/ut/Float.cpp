@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <sstream>
+#include "../../src/EXPRESSION.h"
+#include "../../src/FORMULAFILE.h"
+#include "../../src/VECMATH.h"
+
+using namespace ExpressionLibrary;
+
+namespace {
+
+    float ulpDistance(float actual, float expected) {
+        if (std::isnan(actual) && std::isnan(expected)) return 0.0f;
+        if (actual == expected) return 0.0f;
+        float ulp = std::nextafter(std::fabs(expected), std::numeric_limits<float>::infinity()) - std::fabs(expected);
+        return std::fabs(actual - expected) / ulp;
+    }
+
+    std::vector<float> uniform(std::size_t n, float lo, float hi, unsigned seed) {
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<float> dist(lo, hi);
+        std::vector<float> values(n);
+        for (auto& v : values) v = dist(gen);
+        return values;
+    }
+
+    void expectWithinUlps(void (*kernel)(const float*, float*, std::size_t), float (*reference)(float),
+                          const std::vector<float>& input, float maxUlps) {
+        std::vector<float> out(input.size());
+        kernel(input.data(), out.data(), input.size());
+        for (std::size_t i = 0; i < input.size(); ++i) {
+            ASSERT_LE(ulpDistance(out[i], reference(input[i])), maxUlps) << "x = " << input[i];
+        }
+    }
+
+}
+
+TEST(FloatTest, ParseEvaluateDifferentiate) {
+    auto expr = Expression<float>::Parse("x * sin(x) + 0.1 * y ^ 2");
+    std::map<std::string, float> vars{{"x", 0.7f}, {"y", -1.3f}};
+    float x = 0.7f, y = -1.3f;
+    EXPECT_EQ(Expression<float>::Parse("0.1").evaluate({}), 0.1f);
+    EXPECT_EQ(Expression<float>::Parse("16777217").evaluate({}), 16777216.0f);
+    EXPECT_EQ(expr.evaluate(vars), x * std::sin(x) + 0.1f * std::pow(y, 2.0f));
+    EXPECT_EQ(expr.compile().evaluate(vars), expr.evaluate_tree(vars));
+    EXPECT_NEAR(expr.differentiate("x").evaluate(vars), std::sin(x) + x * std::cos(x), 1e-6f);
+    EXPECT_NEAR(expr.differentiate("y", true).evaluate(vars), 0.2f * y, 1e-6f);
+    auto [value, gradient] = expr.evaluate_with_gradient(vars);
+    EXPECT_EQ(value, expr.evaluate_tree(vars));
+    EXPECT_NEAR(gradient["x"], std::sin(x) + x * std::cos(x), 1e-6f);
+}
+
+TEST(FloatTest, BatchMatchesScalar) {
+    auto expr = Expression<float>::Parse("(x + y) * (x - y) / -(y * 3) + sin(x) * cos(y) + exp(x / 4) - ln(y)");
+    auto program = expr.bind({"x", "y"});
+    std::size_t rows = 1003;
+    auto x = uniform(rows, -10.0f, 10.0f, 1);
+    auto y = uniform(rows, 0.5f, 10.0f, 2);
+    const float* columns[] = {x.data(), y.data()};
+    std::vector<float> out(rows);
+    program.evaluate_batch(columns, out);
+    for (std::size_t i = 0; i < rows; ++i) {
+        float row[] = {x[i], y[i]};
+        float expected = program.evaluate(std::span<const float>(row));
+        EXPECT_NEAR(out[i], expected, 1e-5f * std::max(1.0f, std::fabs(expected)));
+    }
+}
+
+TEST(FloatTest, MixedPrecisionSum) {
+    auto program = Expression<float>::Parse("x * 0.1 + sin(x) * 0").bind({"x"});
+    std::size_t rows = 1 << 20;
+    std::vector<float> x(rows, 1.0f);
+    const float* columns[] = {x.data()};
+    std::vector<float> out(rows);
+    program.evaluate_batch(columns, out);
+    double exact = 0.0;
+    float naive = 0.0f;
+    for (float v : out) {
+        exact += v;
+        naive += v;
+    }
+    EXPECT_EQ(program.evaluate_sum<double>(columns, rows), exact);
+    EXPECT_NEAR(exact, 0.1 * rows, 1e-2);
+    EXPECT_GT(std::fabs(naive - exact), 100.0);
+    EXPECT_EQ(program.evaluate_sum(columns, 5), 5 * 0.1f);
+}
+
+TEST(FloatTest, FormulaFileRoundTrip) {
+    auto expr = Expression<float>::Parse("x * sin(x) + 0.1");
+    FormulaWriter<float> writer;
+    writer.add(expr, "f");
+    std::ostringstream stream;
+    writer.write(stream);
+    std::string bytes = stream.str();
+    FormulaFile<float> file(MappedFile::copy(std::as_bytes(std::span(bytes))));
+    float values[] = {0.3f};
+    EXPECT_EQ(file.program(0).evaluate(values), expr.evaluate_tree({{"x", 0.3f}}));
+    EXPECT_THROW(FormulaFile<double>(MappedFile::copy(std::as_bytes(std::span(bytes)))), std::runtime_error);
+}
+
+TEST(VecMathTest, FloatKernels) {
+    auto a = uniform(1003, -100.0f, 100.0f, 3);
+    auto b = uniform(1003, 0.5f, 100.0f, 4);
+    std::vector<float> out(a.size());
+    VecMath::divide(a.data(), b.data(), out.data(), a.size());
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        EXPECT_EQ(out[i], a[i] / b[i]);
+    }
+    for (float range : {1.0f, 100.0f, 1e5f}) {
+        expectWithinUlps(VecMath::sin, ::sinf, uniform(1 << 16, -range, range, 5), 2.0f);
+        expectWithinUlps(VecMath::cos, ::cosf, uniform(1 << 16, -range, range, 6), 2.0f);
+    }
+    expectWithinUlps(VecMath::exp, ::expf, uniform(1 << 16, -100.0f, 100.0f, 7), 2.0f);
+    expectWithinUlps(VecMath::log, ::logf, uniform(1 << 16, 1e-30f, 1e30f, 8), 2.0f);
+
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<float> special{0.0f, -0.0f, inf, -inf, std::nanf(""), 1e-40f, -1.0f, 89.0f, -104.0f, 1e6f, 88.5f, -87.5f};
+    expectWithinUlps(VecMath::exp, ::expf, special, 2.0f);
+    expectWithinUlps(VecMath::log, ::logf, special, 2.0f);
+    expectWithinUlps(VecMath::sin, ::sinf, special, 2.0f);
+    expectWithinUlps(VecMath::cos, ::cosf, special, 2.0f);
+}
@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include "../../src/FORMULAFILE.h"
+
+using namespace ExpressionLibrary;
+
+namespace {
+
+    std::string tempPath(const std::string& name) {
+        return (std::filesystem::temp_directory_path() / ("formulafile_" + name)).string();
+    }
+
+    template <typename T>
+    void save(const FormulaWriter<T>& writer, const std::string& path) {
+        std::ofstream out(path, std::ios::binary);
+        writer.write(out);
+    }
+
+    std::string readBytes(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), {});
+    }
+
+    void writeBytes(const std::string& path, const std::string& bytes) {
+        std::ofstream out(path, std::ios::binary);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+
+    const char* formulas[] = {
+        "x * sin(x) + y",
+        "(x + y) * (x - y) / (x ^ 2 + 1)",
+        "exp(-x) * cos(y ^ 3) - ln(x + z)",
+        "-(-x) ^ 2 ^ 0.5",
+        "2 + 3 * 4 - 5 / 6",
+        "sin(x) * sin(x) + sin(x)",
+    };
+
+}
+
+TEST(FormulaFileTest, RoundTrip) {
+    std::string path = tempPath("roundtrip.bin");
+    FormulaWriter<double> writer;
+    for (const char* formula : formulas) {
+        writer.add(Expression<double>::Parse(formula), formula);
+    }
+    save(writer, path);
+
+    FormulaFile<double> file(path);
+    ASSERT_EQ(file.size(), std::size(formulas));
+    std::map<std::string, double> vars{{"x", 0.7}, {"y", -1.3}, {"z", 2.5}};
+    for (std::size_t i = 0; i < file.size(); ++i) {
+        auto original = Expression<double>::Parse(formulas[i]);
+        auto program = original.compile();
+        EXPECT_EQ(file.key(i), formulas[i]);
+
+        auto names = file.variables(i);
+        ASSERT_EQ(names.size(), program.variables().size());
+        std::vector<double> values;
+        for (std::size_t v = 0; v < names.size(); ++v) {
+            EXPECT_EQ(names[v], program.variables()[v]);
+            values.push_back(vars[std::string(names[v])]);
+        }
+        EXPECT_EQ(file.program(i).evaluate(values), program.evaluate(vars)) << formulas[i];
+        EXPECT_EQ(file.compile(i).evaluate_with_gradient(vars), program.evaluate_with_gradient(vars)) << formulas[i];
+
+        auto loaded = file.expression(i);
+        EXPECT_EQ(loaded.ToString(), original.ToString());
+        EXPECT_EQ(loaded.evaluate(vars), original.evaluate_tree(vars));
+        EXPECT_EQ(loaded.compile().instructions().size(), program.instructions().size());
+    }
+    EXPECT_THROW(file.program(file.size()), std::out_of_range);
+    std::filesystem::remove(path);
+}
+
+TEST(FormulaFileTest, ComplexAndDeepExpressions) {
+    using C = std::complex<double>;
+    std::string path = tempPath("complex.bin");
+    Expression<C> z("z");
+    auto shallow = (z * z).sin() + z.exp();
+    std::string chain = "z";
+    for (int i = 0; i < 5000; ++i) {
+        chain += " * w - z";
+    }
+    auto deep = Expression<C>::Parse(chain);
+    FormulaWriter<C> writer;
+    writer.add(shallow);
+    writer.add(deep, "deep");
+    save(writer, path);
+
+    FormulaFile<C> file(path);
+    std::map<std::string, C> vars{{"z", C(0.25, 0.5)}, {"w", C(0.5, -0.5)}};
+    EXPECT_EQ(file.key(0), "");
+    EXPECT_EQ(file.expression(0).evaluate(vars), shallow.evaluate_tree(vars));
+    std::vector<C> values;
+    for (auto name : file.variables(1)) values.push_back(vars[std::string(name)]);
+    EXPECT_EQ(file.program(1).evaluate(values), deep.compile().evaluate(vars));
+    EXPECT_EQ(file.expression(1).ToString().size(), deep.ToString().size());
+    EXPECT_THROW(FormulaFile<double>{path}, std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+TEST(FormulaFileTest, RejectsMalformedFiles) {
+    std::string path = tempPath("valid.bin");
+    std::string broken = tempPath("broken.bin");
+    FormulaWriter<double> writer;
+    writer.add(Expression<double>::Parse("x * y + 1"), "f");
+    save(writer, path);
+    std::string bytes = readBytes(path);
+
+    writeBytes(broken, bytes.substr(0, bytes.size() - 1));
+    EXPECT_THROW(FormulaFile<double>{broken}, std::runtime_error);
+    writeBytes(broken, "");
+    EXPECT_THROW(FormulaFile<double>{broken}, std::runtime_error);
+    std::string badMagic = bytes;
+    badMagic[0] = 'X';
+    writeBytes(broken, badMagic);
+    EXPECT_THROW(FormulaFile<double>{broken}, std::runtime_error);
+
+    // Point the multiply at registers the program does not have.
+    auto header = reinterpret_cast<const FormulaFormat::Header*>(bytes.data());
+    std::string badRegister = bytes;
+    auto* code = reinterpret_cast<Instruction*>(badRegister.data() + header->instructions.offset);
+    for (std::size_t i = 0; i < header->instructions.count; ++i) {
+        if (code[i].op == OpCode::Multiply) {
+            code[i].b = 1000;
+            break;
+        }
+    }
+    writeBytes(broken, badRegister);
+    EXPECT_THROW(FormulaFile<double>{broken}, std::runtime_error);
+    EXPECT_THROW(FormulaFile<double>{tempPath("missing.bin")}, std::runtime_error);
+
+    // A unary op's second operand is never read and must be 0, and version 1
+    // files predate sqrt.
+    std::string unary = tempPath("unary.bin");
+    FormulaWriter<double> unaryWriter;
+    unaryWriter.add(Expression<double>::Parse("sin(x) + x ^ 0.5"), "g");
+    save(unaryWriter, unary);
+    std::string unaryBytes = readBytes(unary);
+    auto unaryHeader = reinterpret_cast<const FormulaFormat::Header*>(unaryBytes.data());
+    for (OpCode op : {OpCode::Sin, OpCode::Sqrt}) {
+        std::string badUnary = unaryBytes;
+        code = reinterpret_cast<Instruction*>(badUnary.data() + unaryHeader->instructions.offset);
+        for (std::size_t i = 0; i < unaryHeader->instructions.count; ++i) {
+            if (code[i].op == op) {
+                code[i].b = 1u << 30;
+            }
+        }
+        writeBytes(broken, badUnary);
+        EXPECT_THROW(FormulaFile<double>{broken}, std::runtime_error);
+    }
+    std::string versionOne = unaryBytes;
+    reinterpret_cast<FormulaFormat::Header*>(versionOne.data())->version = 1;
+    writeBytes(broken, versionOne);
+    EXPECT_THROW(FormulaFile<double>{broken}, std::runtime_error);
+    std::filesystem::remove(unary);
+
+    // Arbitrary corruption must be rejected or load into something evaluable.
+    std::mt19937 gen(11);
+    for (int trial = 0; trial < 5000; ++trial) {
+        std::string mutated = bytes;
+        for (int flips = 0; flips < 3; ++flips) {
+            mutated[gen() % mutated.size()] ^= static_cast<char>(1 << (gen() % 8));
+        }
+        try {
+            FormulaFile<double> file(MappedFile::copy(std::as_bytes(std::span(mutated))));
+            for (std::size_t i = 0; i < file.size(); ++i) {
+                std::vector<double> values(file.variables(i).size(), 1.5);
+                file.program(i).evaluate(values);
+                file.expression(i).ToString();
+            }
+        } catch (const std::runtime_error&) {
+        }
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove(broken);
+}
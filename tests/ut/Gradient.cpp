@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include "../../src/EXPRESSION.h"
+
+using namespace ExpressionLibrary;
+
+TEST(GradientTest, MatchesSymbolicDerivatives) {
+    const char* formulas[] = {
+        "x * sin(x * y) * exp(x / y) + ln(x * x + y) ^ 2 / cos(x)",
+        "-(x - y) / (y + 3) + cos(x) * x ^ 3",
+        "exp(-x * x) - ln(y) * sin(y)",
+    };
+    std::map<std::string, double> vars{{"x", 0.7}, {"y", 1.3}};
+    for (const char* formula : formulas) {
+        auto expr = Expression<double>::Parse(formula);
+        auto [value, gradient] = expr.evaluate_with_gradient(vars);
+        EXPECT_DOUBLE_EQ(value, expr.evaluate_tree(vars)) << formula;
+        for (const char* var : {"x", "y"}) {
+            double expected = expr.differentiate(var).evaluate_tree(vars);
+            EXPECT_NEAR(gradient[var], expected, 1e-12 * std::max(1.0, std::fabs(expected))) << formula << " d/d" << var;
+        }
+    }
+}
+
+TEST(GradientTest, VariableExponent) {
+    auto expr = Expression<double>::Parse("x ^ y");
+    auto [value, gradient] = expr.evaluate_with_gradient({{"x", 2.0}, {"y", 3.0}});
+    EXPECT_DOUBLE_EQ(value, 8.0);
+    EXPECT_DOUBLE_EQ(gradient["x"], 12.0);
+    EXPECT_DOUBLE_EQ(gradient["y"], 8.0 * std::log(2.0));
+}
+
+TEST(GradientTest, ManyVariables) {
+    std::string formula = "x0 * x0";
+    std::vector<std::string> names{"x0"};
+    for (int i = 1; i < 100; ++i) {
+        std::string v = "x" + std::to_string(i);
+        formula += " + sin(" + v + ") * x" + std::to_string(i - 1);
+        names.push_back(v);
+    }
+    auto program = Expression<double>::Parse(formula).bind(names);
+    std::vector<double> values(names.size());
+    for (std::size_t i = 0; i < values.size(); ++i) values[i] = 0.01 * static_cast<double>(i);
+    std::vector<double> gradient(names.size());
+    program.evaluate_with_gradient(values, gradient);
+    for (std::size_t i = 1; i + 1 < values.size(); ++i) {
+        double expected = std::cos(values[i]) * values[i - 1] + std::sin(values[i + 1]);
+        EXPECT_NEAR(gradient[i], expected, 1e-14);
+    }
+}
+
+TEST(GradientTest, Complex) {
+    using C = std::complex<double>;
+    Expression<C> z("z");
+    Expression<C> w("w");
+    auto expr = (z * w).sin() / (z + w).exp() - z.ln();
+    std::map<std::string, C> vars{{"z", C(0.3, 0.4)}, {"w", C(-1.0, 0.5)}};
+    auto [value, gradient] = expr.evaluate_with_gradient(vars);
+    EXPECT_EQ(value, expr.evaluate_tree(vars));
+    for (const char* var : {"z", "w"}) {
+        C expected = expr.differentiate(var).evaluate_tree(vars);
+        EXPECT_NEAR(std::abs(gradient[var] - expected), 0.0, 1e-12);
+    }
+}
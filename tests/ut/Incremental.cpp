@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include <random>
+#include "../../src/INCREMENTAL.h"
+
+using namespace ExpressionLibrary;
+
+namespace {
+
+    const char* formulas[] = {
+        "x * sin(x) + y",
+        "(x + y) * (x - y) / (x ^ 2 + 1)",
+        "exp(-x) * cos(y ^ 3) - ln(x + z)",
+        "-(-x) ^ 2 ^ 0.5 + z * z",
+        "sin(x * y) * sin(x * y) + sin(z)",
+        "2 + 3 * 4 - 5 / 6",
+    };
+
+}
+
+TEST(IncrementalTest, MatchesProgramAfterEveryChange) {
+    const std::string names[] = {"x", "y", "z", "w"};
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<double> value(-2.0, 2.0);
+    for (const char* formula : formulas) {
+        auto program = Expression<double>::Parse(formula).compile();
+        std::map<std::string, double> vars{{"x", 0.7}, {"y", -1.3}, {"z", 2.5}};
+        IncrementalEvaluator<double> f(program, vars);
+        EXPECT_EQ(f.evaluate(), program.evaluate(vars)) << formula;
+        for (int step = 0; step < 200; ++step) {
+            const std::string& name = names[gen() % 4];
+            double v = step % 10 == 0 ? vars[name] : value(gen);
+            f.set(name, v);
+            if (name != "w") vars[name] = v;
+            if (gen() % 3 == 0) continue;
+            double expected = program.evaluate(vars);
+            double actual = f.evaluate();
+            if (std::isnan(expected)) {
+                EXPECT_TRUE(std::isnan(actual)) << formula;
+            } else {
+                EXPECT_EQ(actual, expected) << formula;
+            }
+            EXPECT_LE(f.updated(), f.size());
+        }
+    }
+}
+
+TEST(IncrementalTest, RecomputesOnlyTheDirtyPath) {
+    std::string text = "x0";
+    std::map<std::string, double> vars{{"x0", 0.0}};
+    for (int i = 1; i < 1000; ++i) {
+        text += " + sin(x" + std::to_string(i) + ")";
+        vars["x" + std::to_string(i)] = i;
+    }
+    auto expr = Expression<double>::Parse(text);
+    IncrementalEvaluator<double> f(expr, vars);
+    EXPECT_EQ(f.updated(), f.size());
+
+    f.set("x500", 0.25);
+    vars["x500"] = 0.25;
+    EXPECT_EQ(f.evaluate(), expr.evaluate_tree(vars));
+    // sin(x500) and the additions from there to the root.
+    EXPECT_EQ(f.updated(), 501u);
+
+    f.set("x999", 0.5);
+    vars["x999"] = 0.5;
+    EXPECT_EQ(f.evaluate(), expr.evaluate_tree(vars));
+    EXPECT_EQ(f.updated(), 2u);
+
+    EXPECT_EQ(f.evaluate(), expr.evaluate_tree(vars));
+    EXPECT_EQ(f.updated(), 0u);
+    f.set("x999", 0.5);
+    f.set("unused", 3.0);
+    f.evaluate();
+    EXPECT_EQ(f.updated(), 0u);
+    EXPECT_THROW(f.set(std::size_t(1000), 1.0), std::out_of_range);
+}
+
+TEST(IncrementalTest, StopsWhereValuesDoNotChange) {
+    auto expr = Expression<double>::Parse("exp(y) + sin(x * 0) * cos(x * 0) + ln(y)");
+    IncrementalEvaluator<double> f(expr, {{"x", 1.0}, {"y", 2.0}});
+    f.set("x", 3.0);
+    EXPECT_EQ(f.evaluate(), expr.evaluate_tree({{"x", 3.0}, {"y", 2.0}}));
+    // Only the two shared x * 0 products, which come out unchanged.
+    EXPECT_EQ(f.updated(), 1u);
+    EXPECT_THROW((IncrementalEvaluator<double>(expr, {{"x", 1.0}})), std::runtime_error);
+}
+
+TEST(IncrementalTest, Complex) {
+    using C = std::complex<double>;
+    Expression<C> z("z");
+    Expression<C> w("w");
+    auto expr = (z * w).sin() + z.exp() / w;
+    std::map<std::string, C> vars{{"z", C(0.5, 1.0)}, {"w", C(-2.0, 0.25)}};
+    IncrementalEvaluator<C> f(expr, vars);
+    f.set("w", C(1.0, -1.0));
+    vars["w"] = C(1.0, -1.0);
+    EXPECT_EQ(f.evaluate(), expr.compile().evaluate(vars));
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include "../../src/EXPRESSION.h"
+
+using namespace ExpressionLibrary;
+
+namespace {
+
+    std::string randomFormula(std::mt19937& gen, int depth) {
+        const char* leaves[] = {"x", "y", "z", "0.5", "3", "-1.25"};
+        if (depth == 0 || gen() % 4 == 0) {
+            return leaves[gen() % 6];
+        }
+        const char* binary[] = {" + ", " - ", " * ", " / ", " ^ "};
+        const char* unary[] = {"sin", "cos", "ln", "exp"};
+        switch (gen() % 3) {
+            case 0: return "(" + randomFormula(gen, depth - 1) + binary[gen() % 5] + randomFormula(gen, depth - 1) + ")";
+            case 1: return std::string(unary[gen() % 4]) + "(" + randomFormula(gen, depth - 1) + ")";
+            default: return "-(" + randomFormula(gen, depth - 1) + ")";
+        }
+    }
+
+    // Which NaN an operation returns is unspecified, so NaNs only need to agree
+    // on being NaN.
+    void expectSameBits(double actual, double expected, const std::string& context) {
+        if (std::isnan(expected)) {
+            EXPECT_TRUE(std::isnan(actual)) << context;
+            return;
+        }
+        EXPECT_EQ(std::bit_cast<std::uint64_t>(actual), std::bit_cast<std::uint64_t>(expected))
+            << context << ": " << actual << " vs " << expected;
+    }
+
+}
+
+TEST(JitTest, NativeWhereSupported) {
+    auto jit = Expression<double>::Parse("x * y").jit({"x", "y"});
+    EXPECT_EQ(jit.native(), JitFunction::supported());
+    EXPECT_EQ(jit.function() != nullptr, jit.native());
+    double values[] = {3.0, 4.0};
+    EXPECT_EQ(jit(values), 12.0);
+}
+
+TEST(JitTest, RandomFormulasMatchTreeBitForBit) {
+    std::mt19937 gen(7);
+    const double inputs[][3] = {
+        {0.75, -1.5, 2.0},
+        {-0.0, 0.0, 1e308},
+        {std::numeric_limits<double>::infinity(), std::nan(""), -3.0},
+        {1e-310, 12345.678, -0.5},
+    };
+    for (int i = 0; i < 400; ++i) {
+        std::string formula = randomFormula(gen, 5);
+        auto expr = Expression<double>::Parse(formula);
+        auto jit = expr.jit({"x", "y", "z"});
+        for (const auto& row : inputs) {
+            double expected = expr.evaluate_tree({{"x", row[0]}, {"y", row[1]}, {"z", row[2]}});
+            expectSameBits(jit(row), expected, formula);
+        }
+    }
+}
+
+TEST(JitTest, BatchMatchesScalar) {
+    auto expr = Expression<double>::Parse("sin(x) * y ^ 2 - exp(-x / y) + ln(y)");
+    auto jit = expr.jit({"x", "y"});
+    std::mt19937_64 gen(3);
+    std::uniform_real_distribution<double> dist(0.1, 10.0);
+    std::size_t rows = 1001;
+    std::vector<double> values(rows * 3);
+    for (auto& v : values) v = dist(gen);
+    std::vector<double> out(rows);
+    jit.evaluate_batch(values.data(), out, 3);
+    for (std::size_t i = 0; i < rows; ++i) {
+        expectSameBits(out[i], jit(values.data() + 3 * i), "row " + std::to_string(i));
+    }
+    jit.evaluate_batch(values.data(), std::span<double>(out.data(), 0), 3);
+}
+
+TEST(JitTest, LargeRegisterFiles) {
+    std::string sum;
+    std::string reversed;
+    for (int i = 1; i <= 700; ++i) {
+        std::string term = "sin(x + " + std::to_string(i) + ")";
+        sum += (i > 1 ? " + " : "") + term;
+        reversed = term + (i > 1 ? " + " : "") + reversed;
+    }
+    auto expr = Expression<double>::Parse("(" + sum + ") * (" + reversed + ")");
+    auto program = expr.bind({"x"});
+    EXPECT_GT(program.registers(), 600u);
+    JitFunction jit(program);
+    double x = 0.3;
+    expectSameBits(jit(&x), expr.evaluate_tree({{"x", x}}), "scalar");
+    std::vector<double> xs{0.1, 0.2, 0.3};
+    std::vector<double> out(3);
+    jit.evaluate_batch(xs.data(), out);
+    expectSameBits(out[2], expr.evaluate_tree({{"x", x}}), "batch");
+}
+
+TEST(JitTest, InterpreterFallback) {
+    auto expr = Expression<double>::Parse("x ^ y + 1");
+    JitFunction interpreted(expr.bind({"x", "y"}), false);
+    EXPECT_FALSE(interpreted.native());
+    EXPECT_EQ(interpreted.function(), nullptr);
+    double values[] = {2.0, 10.0, 3.0, 2.0};
+    EXPECT_EQ(interpreted(values), 1025.0);
+    std::vector<double> out(2);
+    interpreted.evaluate_batch(values, out);
+    EXPECT_EQ(out, (std::vector<double>{1025.0, 10.0}));
+}
+
+TEST(JitTest, CopiesShareCode) {
+    JitFunction copy = [] {
+        auto jit = Expression<double>::Parse("x - 1").jit({"x"});
+        return JitFunction(jit);
+    }();
+    double x = 5.0;
+    EXPECT_EQ(copy(&x), 4.0);
+    EXPECT_THROW(Expression<double>::Parse("x + w").jit({"x"}), std::runtime_error);
+}
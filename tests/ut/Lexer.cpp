@@ -0,0 +1,39 @@
+#include <gtest/gtest.h>
+#include "../../src/EXPRESSION.h"
+
+using namespace ExpressionLibrary;
+
+TEST(LexerTest, TokensViewTheInput) {
+    std::string input = "sin(x_1) * 2.5 ^ -.5";
+    Lexer lexer(input);
+    std::vector<Token> tokens;
+    for (Token t = lexer.nextToken(); t.type != TokenType::End; t = lexer.nextToken()) {
+        tokens.push_back(t);
+        EXPECT_GE(t.text.data(), input.data());
+        EXPECT_LE(t.text.data() + t.text.size(), input.data() + input.size());
+    }
+    ASSERT_EQ(tokens.size(), 9u);
+    EXPECT_EQ(tokens[0].type, TokenType::Function);
+    EXPECT_EQ(tokens[0].function, FunctionType::Sin);
+    EXPECT_EQ(tokens[2].type, TokenType::Variable);
+    EXPECT_EQ(tokens[2].text, "x_1");
+    EXPECT_EQ(tokens[4].op, OperatorType::Multiply);
+    EXPECT_EQ(tokens[5].number, 2.5);
+    EXPECT_EQ(tokens[6].op, OperatorType::Power);
+    EXPECT_EQ(tokens[7].op, OperatorType::Subtract);
+    EXPECT_EQ(tokens[8].number, 0.5);
+}
+
+TEST(LexerTest, NumbersRoundTrip) {
+    for (const char* text : {"0.1", "1.", "123456789012345678", "2.2250738585072014"}) {
+        Token t = Lexer(text).nextToken();
+        EXPECT_EQ(t.type, TokenType::Number);
+        EXPECT_EQ(t.number, std::strtod(text, nullptr)) << text;
+    }
+}
+
+TEST(LexerTest, RejectsMalformedInput) {
+    EXPECT_THROW(Lexer(".").nextToken(), std::runtime_error);
+    EXPECT_THROW(Lexer("$").nextToken(), std::runtime_error);
+    EXPECT_THROW(Expression<double>::Parse("foo(x)"), std::runtime_error);
+}
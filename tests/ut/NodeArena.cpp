@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include "../../src/EXPRESSION.h"
+
+using namespace ExpressionLibrary;
+
+namespace {
+
+    class CountingResource : public std::pmr::memory_resource {
+    public:
+        std::atomic<std::size_t> allocations{0};
+        std::atomic<std::size_t> live{0};
+
+    private:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+            ++allocations;
+            ++live;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+            --live;
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    std::string longSum(int terms) {
+        std::string formula = "sin(x0)";
+        for (int i = 1; i < terms; ++i) {
+            formula += " + x" + std::to_string(i) + " * sin(x" + std::to_string(i - 1) + ")";
+        }
+        return formula;
+    }
+
+}
+
+TEST(NodeArenaTest, ParseAndDifferentiateUseFewUpstreamAllocations) {
+    CountingResource upstream;
+    std::string formula = longSum(200);
+    {
+        auto arena = std::make_shared<NodeArena>(&upstream);
+        auto expr = Expression<double>::Parse(formula, arena);
+        auto derivative = expr.differentiate("x7").substitute("x8", 2.0);
+        EXPECT_LT(upstream.allocations.load(), 32u);
+        EXPECT_GT(arena->bytes(), 200 * sizeof(AddNode<double>));
+
+        auto reference = Expression<double>::Parse(formula).differentiate("x7").substitute("x8", 2.0);
+        EXPECT_EQ(derivative.ToString(), reference.ToString());
+    }
+    EXPECT_EQ(upstream.live.load(), 0u);
+}
+
+TEST(NodeArenaTest, NodesKeepArenaAlive) {
+    CountingResource upstream;
+    std::shared_ptr<Node<double>> survivor;
+    {
+        auto arena = std::make_shared<NodeArena>(&upstream);
+        Parser<double> parser("x * y + 3", arena);
+        survivor = parser.parse();
+    }
+    EXPECT_GT(upstream.live.load(), 0u);
+    EXPECT_DOUBLE_EQ(survivor->evaluate({{"x", 2.0}, {"y", 4.0}}), 11.0);
+    survivor.reset();
+    EXPECT_EQ(upstream.live.load(), 0u);
+}
+
+TEST(NodeArenaTest, SubstituteSharesUntouchedSubtrees) {
+    auto expr = Expression<double>::Parse("sin(y) * y + x");
+    auto substituted = expr.substitute("x", 1.0).compile();
+    EXPECT_DOUBLE_EQ(substituted.evaluate({{"y", 2.0}}), std::sin(2.0) * 2.0 + 1.0);
+}
@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+#include "../../src/EXPRESSION.h"
+
+using namespace ExpressionLibrary;
+
+TEST(NodeFactoryTest, SharesIdenticalNodes) {
+    NodeFactory<double> f;
+    auto a = f.multiply(f.sin(f.variable("x")), f.constant(2.0));
+    auto b = f.multiply(f.sin(f.variable("x")), f.constant(2.0));
+    EXPECT_EQ(a, b);
+    EXPECT_NE(f.constant(0.0), f.constant(-0.0));
+}
+
+TEST(NodeFactoryTest, InternBuildsDag) {
+    auto sinX = [] { return Expression<double>("x").sin(); };
+    auto expr = sinX() * sinX() + sinX();
+    EXPECT_EQ(expr.compile().instructions().size(), 8u);
+    auto shared = expr.intern();
+    EXPECT_EQ(shared.compile().instructions().size(), 4u);
+    EXPECT_EQ(shared.ToString(), expr.ToString());
+}
+
+TEST(NodeFactoryTest, ParserSharesRepeatedSubtrees) {
+    auto expr = Expression<double>::Parse("sin(x) * sin(x) + sin(x)");
+    EXPECT_EQ(expr.compile().instructions().size(), 4u);
+}
+
+TEST(NodeFactoryTest, DifferentiateSharesOperands) {
+    auto node = std::make_shared<MultiplyNode<double>>(
+        std::make_shared<VarNode<double>>("x"),
+        std::make_shared<SinNode<double>>(std::make_shared<VarNode<double>>("x"))
+    );
+    auto derivative = node->differentiate("x");
+    auto& sum = static_cast<const AddNode<double>&>(*derivative);
+    auto& second = static_cast<const MultiplyNode<double>&>(*sum.right);
+    EXPECT_EQ(second.left, node->left);
+}
+
+TEST(NodeFactoryTest, RepeatedDerivativesStayCompact) {
+    auto expr = Expression<double>::Parse("x * sin(x * y) * exp(x / y) + ln(x * x + y) ^ 2 / cos(x)");
+    std::map<std::string, double> vars{{"x", 0.7}, {"y", 1.3}};
+    auto d1 = expr.differentiate("x");
+    auto d2 = d1.differentiate("x");
+    auto d3 = d2.differentiate("x");
+    auto size = [](const Expression<double>& e) { return e.compile().instructions().size(); };
+    // expr's ^ 2 compiles to a single multiply, d1's x ^ (2 - 1) still to a pow.
+    EXPECT_LE(size(d1), 3 * size(expr) + 3);
+    EXPECT_LE(size(d2), 3 * size(d1));
+    EXPECT_LE(size(d3), 3 * size(d2));
+    EXPECT_GT(d3.ToString().size(), 100 * expr.ToString().size());
+    EXPECT_NEAR(d3.compile().evaluate(vars), d3.evaluate_tree(vars), 1e-9 * std::fabs(d3.evaluate_tree(vars)));
+}
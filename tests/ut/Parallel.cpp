@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <thread>
+#include "../../src/EXPRESSION.h"
+
+using namespace ExpressionLibrary;
+
+namespace {
+
+    std::vector<double> uniform(std::size_t n, double lo, double hi, unsigned seed) {
+        std::mt19937_64 gen(seed);
+        std::uniform_real_distribution<double> dist(lo, hi);
+        std::vector<double> values(n);
+        for (auto& v : values) v = dist(gen);
+        return values;
+    }
+
+}
+
+TEST(ThreadPoolTest, RunsEveryIndexOnce) {
+    for (std::size_t threads : {1, 2, 3, 8}) {
+        ThreadPool pool(threads);
+        EXPECT_EQ(pool.size(), threads);
+        for (std::size_t tasks : {0, 1, 7, 1000}) {
+            std::vector<std::atomic<int>> seen(tasks);
+            pool.run(tasks, [&](std::size_t i) {
+                if (i % 5 == 0) std::this_thread::yield();
+                ++seen[i];
+            });
+            for (auto& count : seen) {
+                EXPECT_EQ(count.load(), 1);
+            }
+        }
+    }
+}
+
+TEST(ThreadPoolTest, RethrowsFromBody) {
+    ThreadPool pool(4);
+    EXPECT_THROW(pool.run(100, [](std::size_t i) {
+        if (i == 42) throw std::runtime_error("boom");
+    }), std::runtime_error);
+    std::atomic<int> count{0};
+    pool.run(10, [&](std::size_t) { ++count; });
+    EXPECT_EQ(count.load(), 10);
+}
+
+TEST(ParallelTest, MatchesBatchBitForBit) {
+    auto expr = Expression<double>::Parse("sin(x) * exp(y / 4) + ln(x * x + 1) ^ y - cos(x - y)");
+    std::size_t rows = 100003;
+    auto x = uniform(rows, -30.0, 30.0, 1);
+    auto y = uniform(rows, -3.0, 3.0, 2);
+    const double* columns[] = {x.data(), y.data()};
+    std::vector<double> expected(rows);
+    expr.evaluate_batch({"x", "y"}, columns, expected);
+    for (std::size_t threads : {1, 3, 8}) {
+        ThreadPool pool(threads);
+        for (std::size_t chunk : {1, 300, 5000}) {
+            std::vector<double> out(rows);
+            expr.evaluate_parallel({"x", "y"}, columns, out, pool, chunk);
+            EXPECT_EQ(std::memcmp(out.data(), expected.data(), rows * sizeof(double)), 0)
+                << threads << " threads, chunk " << chunk;
+        }
+    }
+}
+
+TEST(ParallelTest, Complex) {
+    using C = std::complex<double>;
+    Expression<C> z("z");
+    auto expr = (z * z).sin() + z.exp();
+    std::vector<C> column(1000);
+    for (std::size_t i = 0; i < column.size(); ++i) column[i] = C(0.01 * i, -0.02 * i);
+    const C* columns[] = {column.data()};
+    std::vector<C> out(column.size());
+    ThreadPool pool(4);
+    expr.evaluate_parallel({"z"}, columns, out, pool, 256);
+    for (std::size_t i = 0; i < column.size(); ++i) {
+        EXPECT_EQ(out[i], expr.evaluate_tree({{"z", column[i]}}));
+    }
+}
+
+TEST(ParallelTest, ConcurrentEvaluateOnSharedNodes) {
+    auto expr = Expression<double>::Parse("x * sin(x * y) + exp(x / y) - ln(y) ^ 2");
+    auto derivative = expr.differentiate("x");
+    auto program = derivative.compile();
+    std::vector<double> expected(64);
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+        expected[i] = derivative.evaluate({{"x", 0.1 * i}, {"y", 1.5}});
+    }
+    std::atomic<int> wrong{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t] {
+            Expression<double> copy = derivative;
+            for (int round = 0; round < 200; ++round) {
+                std::size_t i = (round * 13 + t) % expected.size();
+                std::map<std::string, double> vars{{"x", 0.1 * i}, {"y", 1.5}};
+                if (copy.evaluate(vars) != expected[i] || program.evaluate(vars) != expected[i]) ++wrong;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    EXPECT_EQ(wrong.load(), 0);
+}
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "../../src/PARSECACHE.h"
+
+using namespace ExpressionLibrary;
+
+TEST(ParseCacheTest, HitsShareTheParsedProgram) {
+    ParseCache<double> cache(8);
+    auto first = cache.compile("x * sin(y)");
+    auto second = cache.compile("x * sin(y)");
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(cache.parse("x * sin(y)").ToString(), Expression<double>::Parse("x * sin(y)").ToString());
+    auto counters = cache.counters();
+    EXPECT_EQ(counters.misses, 1u);
+    EXPECT_EQ(counters.hits, 2u);
+    EXPECT_EQ(counters.entries, 1u);
+    EXPECT_DOUBLE_EQ(first->evaluate({{"x", 2.0}, {"y", 0.0}}), 0.0);
+
+    // The estimate follows the parsed graph, not the instruction count.
+    auto expr = cache.parse("x * sin(y)");
+    EXPECT_GE(counters.bytes, expr.stats().bytes + first->instructions().size() * sizeof(Instruction));
+}
+
+TEST(ParseCacheTest, EvictsLeastRecentlyUsed) {
+    ParseCache<double> cache(2);
+    cache.parse("x");
+    cache.parse("y");
+    cache.parse("x");
+    cache.parse("z");
+    auto counters = cache.counters();
+    EXPECT_EQ(counters.evictions, 1u);
+    EXPECT_EQ(counters.entries, 2u);
+    cache.parse("x");
+    EXPECT_EQ(cache.counters().hits, 2u);
+    cache.parse("y");
+    EXPECT_EQ(cache.counters().misses, 4u);
+}
+
+TEST(ParseCacheTest, BoundedByBytes) {
+    ParseCache<double> cache(1000, 4096);
+    for (int i = 0; i < 200; ++i) {
+        cache.parse("x * " + std::to_string(i) + " + sin(y)");
+        EXPECT_LE(cache.counters().bytes, 4096u);
+    }
+    auto counters = cache.counters();
+    EXPECT_GT(counters.evictions, 0u);
+    EXPECT_EQ(counters.entries + counters.evictions, 200u);
+    cache.clear();
+    EXPECT_EQ(cache.counters().bytes, 0u);
+    EXPECT_EQ(cache.counters().entries, 0u);
+}
+
+TEST(ParseCacheTest, ConcurrentLookups) {
+    ParseCache<double> cache(16);
+    std::vector<std::string> formulas;
+    for (int i = 0; i < 32; ++i) {
+        formulas.push_back("x ^ 2 + " + std::to_string(i));
+    }
+    std::vector<std::thread> threads;
+    std::atomic<int> wrong{0};
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 2000; ++i) {
+                int k = (i * 7 + t) % 32;
+                double value = cache.compile(formulas[k])->evaluate({{"x", 3.0}});
+                if (value != 9.0 + k) ++wrong;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    EXPECT_EQ(wrong.load(), 0);
+    auto counters = cache.counters();
+    EXPECT_EQ(counters.hits + counters.misses, 16000u);
+    EXPECT_LE(counters.entries, 16u);
+}
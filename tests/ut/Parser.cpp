@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include "../../src/EXPRESSION.h"
+
+using namespace ExpressionLibrary;
+
+namespace {
+
+    std::string parsed(const std::string& formula) {
+        return Expression<double>::Parse(formula).ToString();
+    }
+
+    std::string expected(const Expression<double>& expr) {
+        return expr.ToString();
+    }
+
+}
+
+TEST(ParserTest, PrecedenceAndAssociativity) {
+    Expression<double> x("x"), y("y"), z("z");
+    EXPECT_EQ(parsed("x - y - z"), expected((x - y) - z));
+    EXPECT_EQ(parsed("x / y * z"), expected((x / y) * z));
+    EXPECT_EQ(parsed("x + y * z ^ 2"), expected(x + y * (z ^ Expression<double>(2.0))));
+    EXPECT_EQ(parsed("x ^ y ^ z"), expected(x ^ (y ^ z)));
+    EXPECT_EQ(parsed("(x + y) * sin(z - x) ^ 2 / y"),
+              expected((x + y) * (((z - x).sin()) ^ Expression<double>(2.0)) / y));
+    EXPECT_EQ(parsed("-x ^ 2"), "(-(x) ^ 2)");
+    EXPECT_EQ(parsed("2 ^ -x ^ 2"), parsed("2 ^ ((-x) ^ 2)"));
+    EXPECT_EQ(parsed("--x"), "-(-(x))");
+    EXPECT_EQ(parsed("-(x + y)"), "-((x + y))");
+}
+
+TEST(ParserTest, DeepNestingDoesNotRecurse) {
+    std::size_t depth = 200000;
+    std::string formula = std::string(depth, '(') + "x" + std::string(depth, ')');
+    ParseLimits limits;
+    limits.maxDepth = depth + 1;
+    EXPECT_EQ(Expression<double>::Parse(formula, nullptr, limits).ToString(), "x");
+
+    std::string calls = "x";
+    for (int i = 0; i < 5000; ++i) {
+        calls = "sin(" + calls + ")";
+    }
+    EXPECT_DOUBLE_EQ(Expression<double>::Parse(calls).evaluate({{"x", 0.0}}), 0.0);
+}
+
+TEST(ParserTest, LongChains) {
+    std::string sum = "x";
+    std::string power = "x";
+    for (int i = 0; i < 20000; ++i) {
+        sum += " + x";
+    }
+    for (int i = 0; i < 5000; ++i) {
+        power += " ^ 1";
+    }
+    ParseLimits limits;
+    limits.nodes.maxDepth = 30000;
+    EXPECT_DOUBLE_EQ(Expression<double>::Parse(sum, nullptr, limits).compile().evaluate({{"x", 0.5}}), 10000.5);
+    EXPECT_DOUBLE_EQ(Expression<double>::Parse(power).compile().evaluate({{"x", 3.0}}), 3.0);
+}
+
+TEST(ParserTest, DefaultLimitsRefuseTreesTooDeepToDestroy) {
+    std::string minus;
+    std::string sum = "x";
+    for (int i = 0; i < 300000; ++i) {
+        minus += "- ";
+        sum += " + x";
+    }
+    EXPECT_THROW(Expression<double>::Parse(minus + "x"), std::runtime_error);
+    EXPECT_THROW(Expression<double>::Parse(minus + "(x)"), std::runtime_error);
+    EXPECT_THROW(Expression<double>::Parse(sum), std::runtime_error);
+    EXPECT_EQ(Expression<double>::Parse("- - x + y").ToString(), "(-(-(x)) + y)");
+}
+
+TEST(ParserTest, EnforcesLimits) {
+    ParseLimits limits;
+    limits.maxDepth = 3;
+    EXPECT_NO_THROW(Expression<double>::Parse("sin((x ^ y))", nullptr, limits));
+    EXPECT_THROW(Expression<double>::Parse("sin((((x))))", nullptr, limits), std::runtime_error);
+    EXPECT_THROW(Expression<double>::Parse("(x ^ y ^ z ^ w)", nullptr, limits), std::runtime_error);
+    limits = ParseLimits{};
+    limits.maxLength = 5;
+    EXPECT_NO_THROW(Expression<double>::Parse("x + y", nullptr, limits));
+    EXPECT_THROW(Expression<double>::Parse("x + yz", nullptr, limits), std::runtime_error);
+
+    // Repeated subterms are shared, so only distinct nodes count.
+    limits = ParseLimits{};
+    limits.nodes.maxNodes = 3;
+    EXPECT_NO_THROW(Expression<double>::Parse("sin(x) * sin(x)", nullptr, limits));
+    EXPECT_THROW(Expression<double>::Parse("x + y + z", nullptr, limits), std::runtime_error);
+    limits = ParseLimits{};
+    limits.nodes.maxDepth = 3;
+    EXPECT_NO_THROW(Expression<double>::Parse("sin(x) * y", nullptr, limits));
+    EXPECT_THROW(Expression<double>::Parse("x + y + z + w", nullptr, limits), std::runtime_error);
+}
+
+TEST(ParserTest, ReportsMalformedInput) {
+    EXPECT_THROW(Expression<double>::Parse("(x + y"), std::runtime_error);
+    EXPECT_THROW(Expression<double>::Parse("sin(x"), std::runtime_error);
+    EXPECT_THROW(Expression<double>::Parse("x + * y"), std::runtime_error);
+    EXPECT_THROW(Expression<double>::Parse("x +"), std::runtime_error);
+    EXPECT_THROW(Expression<double>::Parse("tan(x)"), std::runtime_error);
+}
@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
-#include "../../src/NODE.h"
+#include <limits>
+#include <random>
+#include "../../src/EXPRESSION.h"
+#include "../../src/INCREMENTAL.h"
 
 using namespace ExpressionLibrary;
 
@@ -36,3 +39,108 @@ TEST(PowerNodeTest, Substitute) {
     auto substituted = node->substitute("x", 2.0);
     EXPECT_DOUBLE_EQ(substituted->evaluate({}), 16.0);
 }
+
+namespace {
+
+    template <typename T>
+    void expectNearPow(T x, T c) {
+        auto power = ConstantPower<T>::of(c);
+        ASSERT_TRUE(power) << c;
+        T expected = std::pow(x, c);
+        T bound = (std::fabs(c) + 2) * std::numeric_limits<T>::epsilon() * std::fabs(expected);
+        EXPECT_NEAR((*power)(x), expected, bound) << x << " ^ " << c;
+    }
+
+}
+
+TEST(PowerNodeTest, ConstantPowerMatchesPow) {
+    std::mt19937_64 gen(1);
+    std::uniform_real_distribution<double> magnitude(-3.0, 3.0);
+    for (int twice = -32; twice <= 32; ++twice) {
+        double c = twice / 2.0;
+        for (int i = 0; i < 1000; ++i) {
+            double x = std::pow(10.0, magnitude(gen));
+            expectNearPow(x, c);
+            // Keeps float results within the normal range.
+            expectNearPow(static_cast<float>(std::cbrt(x)), static_cast<float>(c));
+            if (twice % 2 == 0) {
+                expectNearPow(-x, c);
+            }
+        }
+    }
+    EXPECT_FALSE(ConstantPower<double>::of(16.5));
+    EXPECT_FALSE(ConstantPower<double>::of(0.25));
+    EXPECT_FALSE(ConstantPower<double>::of(std::nan("")));
+    EXPECT_FALSE(ConstantPower<std::complex<double>>::of({2.0, 1.0}));
+
+    const double inf = std::numeric_limits<double>::infinity();
+    for (double x : {0.0, -0.0, inf, -inf, std::nan(""), 1.0, -1.0}) {
+        for (double c : {-3.0, -2.0, -1.0, 0.0, 1.0, 2.0, 3.0, 0.5, 2.5, -0.5}) {
+            if (c != std::floor(c) && (x == -inf || (x == 0.0 && std::signbit(x)))) continue;
+            double expected = std::pow(x, c);
+            double actual = ConstantPower<double>::pow(x, c);
+            EXPECT_TRUE(actual == expected || (std::isnan(actual) && std::isnan(expected))) << x << " ^ " << c;
+            EXPECT_EQ(std::signbit(actual), std::signbit(expected)) << x << " ^ " << c;
+        }
+    }
+}
+
+TEST(PowerNodeTest, CompiledWithoutPow) {
+    auto expr = Expression<double>::Parse(
+        "x ^ 2 + x ^ 5 + y ^ -3 + y ^ 0.5 + x ^ 2.5 * y ^ -1.5 + x ^ 0 + x ^ 1 + y ^ -1 + x ^ 16");
+    auto program = expr.bind({"x", "y"});
+    for (const Instruction& ins : program.instructions()) {
+        EXPECT_NE(ins.op, OpCode::Power);
+    }
+    for (const char* general : {"x ^ y", "x ^ 0.3", "x ^ 17", "x ^ (y - y + 2)"}) {
+        auto code = Expression<double>::Parse(general).compile().instructions();
+        EXPECT_TRUE(std::any_of(code.begin(), code.end(), [](const Instruction& ins) { return ins.op == OpCode::Power; }))
+            << general;
+    }
+
+    std::map<std::string, double> vars{{"x", 1.7}, {"y", 0.6}};
+    double values[] = {1.7, 0.6};
+    double value = expr.evaluate_tree(vars);
+    EXPECT_EQ(program.evaluate(std::span<const double>(values)), value);
+    EXPECT_EQ(JitFunction(program)(values), value);
+    EXPECT_EQ(IncrementalEvaluator<double>(program, std::span<const double>(values)).evaluate(), value);
+    const double* columns[] = {&values[0], &values[1]};
+    double batch;
+    program.evaluate_batch(columns, std::span(&batch, 1));
+    EXPECT_EQ(batch, value);
+    EXPECT_NEAR(value, std::pow(1.7, 2) + std::pow(1.7, 5) + std::pow(0.6, -3) + std::sqrt(0.6)
+                       + std::pow(1.7, 2.5) * std::pow(0.6, -1.5) + 1 + 1.7 + 1 / 0.6 + std::pow(1.7, 16), 1e-12 * value);
+
+    auto [withGradient, gradient] = program.evaluate_with_gradient(vars);
+    EXPECT_EQ(withGradient, value);
+    auto dx = expr.differentiate("x", true).evaluate_tree(vars);
+    auto dy = expr.differentiate("y", true).evaluate_tree(vars);
+    EXPECT_NEAR(gradient["x"], dx, 1e-12 * std::fabs(dx));
+    EXPECT_NEAR(gradient["y"], dy, 1e-12 * std::fabs(dy));
+    EXPECT_NEAR(program.evaluate_with_tangent(vars, {{"y", 1.0}}).second, dy, 1e-12 * std::fabs(dy));
+}
+
+TEST(PowerNodeTest, FoldsConstantExponents) {
+    // differentiate leaves x ^ (3 - 1) and x ^ (-2 - 1) behind.
+    auto expr = Expression<double>::Parse("x ^ 3 + x ^ (1 + 1) + x ^ -2");
+    auto derivative = expr.differentiate("x");
+    for (const auto& e : {expr, derivative}) {
+        for (const Instruction& ins : e.compile().instructions()) {
+            EXPECT_NE(ins.op, OpCode::Power) << e.ToString();
+        }
+    }
+    std::map<std::string, double> vars{{"x", 1.3}};
+    EXPECT_EQ(derivative.evaluate(vars), derivative.evaluate_tree(vars));
+    EXPECT_NEAR(derivative.evaluate(vars), 3 * 1.3 * 1.3 + 2 * 1.3 - 2 / std::pow(1.3, 3), 1e-12);
+}
+
+TEST(PowerNodeTest, ComplexConstantPower) {
+    using C = std::complex<double>;
+    Expression<C> z("z");
+    auto expr = (z ^ C(3.0)) + (z ^ C(0.5)) - (z ^ C(-2.5));
+    std::map<std::string, C> vars{{"z", C(0.5, -1.25)}};
+    C x = vars["z"];
+    C expected = std::pow(x, 3.0) + std::pow(x, 0.5) - std::pow(x, -2.5);
+    EXPECT_NEAR(std::abs(expr.evaluate(vars) - expected), 0.0, 1e-14 * std::abs(expected));
+    EXPECT_EQ(expr.compile().evaluate(vars), expr.evaluate(vars));
+}
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include "../../src/PROFILE.h"
+
+using namespace ExpressionLibrary;
+
+TEST(ProfileTest, CountsFollowCompiledEvaluation) {
+    auto expr = Expression<double>::Parse("sin(x * y) * sin(x * y) + x ^ 2 / y");
+    std::map<std::string, double> vars{{"x", 0.7}, {"y", 1.3}};
+    EvaluationProfile<double> profile(expr, vars, 10);
+    EXPECT_EQ(profile.value(), expr.evaluate(vars));
+    EXPECT_EQ(profile.repetitions(), 10u);
+    EXPECT_EQ(profile.root().calls, 10u);
+    EXPECT_EQ(profile.root().node->to_string(), expr.ToString());
+
+    // The parser shares sin(x * y): computed once per evaluation, like the
+    // compiled program, though the tree walker reaches it twice.
+    std::map<std::string, std::uint64_t> paths;
+    for (const auto& entry : profile.entries()) {
+        EXPECT_EQ(entry.calls, 10u);
+        paths[entry.node->to_string()] = entry.paths;
+        for (std::size_t operand : entry.operands) {
+            EXPECT_LT(operand, static_cast<std::size_t>(&entry - profile.entries().data()));
+        }
+        EXPECT_GE(entry.total, entry.self);
+        EXPECT_EQ(entry.nans + entry.infinities, 0u);
+    }
+    EXPECT_EQ(profile.entries().size(), 9u);
+    EXPECT_EQ(profile.root().paths, 1u);
+    EXPECT_EQ(paths["sin((x * y))"], 2u);
+    EXPECT_EQ(paths["x"], 3u);
+    EXPECT_EQ(paths["y"], 3u);
+    EXPECT_EQ(paths["(x ^ 2)"], 1u);
+
+    auto hottest = profile.hottest(3);
+    ASSERT_EQ(hottest.size(), 3u);
+    EXPECT_GE(profile.entries()[hottest[0]].self, profile.entries()[hottest[1]].self);
+    EXPECT_GE(profile.entries()[hottest[1]].self, profile.entries()[hottest[2]].self);
+    EXPECT_EQ(profile.hottest(100).size(), profile.entries().size());
+}
+
+TEST(ProfileTest, RecordsNanAndInfinity) {
+    auto expr = Expression<double>::Parse("ln(x - 1) + 0 / (x - 1) * y");
+    EvaluationProfile<double> profile(expr, {{"x", 1.0}, {"y", 2.0}}, 3);
+    EXPECT_TRUE(std::isnan(profile.value()));
+    for (const auto& entry : profile.entries()) {
+        std::string text = entry.node->to_string();
+        if (text == "ln((x - 1))") {
+            EXPECT_EQ(entry.infinities, 3u);
+            EXPECT_EQ(entry.nans, 0u);
+        } else if (text == "(0 / (x - 1))") {
+            EXPECT_EQ(entry.nans, 3u);
+        } else if (text == "(x - 1)") {
+            EXPECT_EQ(entry.nans + entry.infinities, 0u);
+        }
+    }
+    EXPECT_EQ(profile.root().nans, 3u);
+}
+
+TEST(ProfileTest, DeepSharingIsLinear) {
+    // 2^60 paths to x, but 61 distinct nodes to compute.
+    auto expr = Expression<double>::Parse("x");
+    for (int i = 0; i < 60; ++i) {
+        expr = expr * expr;
+    }
+    EvaluationProfile<double> profile(expr, {{"x", 1.0}}, 2);
+    EXPECT_EQ(profile.entries().size(), 61u);
+    EXPECT_EQ(profile.value(), 1.0);
+    EXPECT_EQ(profile.entries().front().calls, 2u);
+    EXPECT_EQ(profile.entries().front().paths, std::uint64_t(1) << 60);
+}
+
+TEST(ProfileTest, ComplexAndMissingVariables) {
+    using C = std::complex<double>;
+    Expression<C> z("z");
+    auto expr = (z ^ C(2.0)).exp() - z.ln();
+    std::map<std::string, C> vars{{"z", C(0.5, 1.0)}};
+    EXPECT_EQ(EvaluationProfile<C>(expr, vars).value(), expr.evaluate(vars));
+    EXPECT_THROW(EvaluationProfile<C>(expr, {}), std::runtime_error);
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include "../../src/EXPRESSION.h"
+
+using namespace ExpressionLibrary;
+
+TEST(ProgramTest, EvaluateMatchesTree) {
+    const char* formulas[] = {
+        "x * sin(x) + y",
+        "(x + y) * (x - y) / (x ^ 2 + 1)",
+        "exp(-x) * cos(y ^ 3) - ln(x + y)",
+        "-(-x) ^ 2 ^ 0.5",
+        "2 + 3 * 4 - 5 / 6",
+    };
+    std::map<std::string, double> vars{{"x", 1.25}, {"y", -0.75}};
+    for (const char* formula : formulas) {
+        auto expr = Expression<double>::Parse(formula);
+        auto program = expr.compile();
+        EXPECT_EQ(program.evaluate(vars), expr.evaluate_tree(vars)) << formula;
+    }
+}
+
+TEST(ProgramTest, EvaluateComplex) {
+    using C = std::complex<double>;
+    Expression<C> x("x");
+    Expression<C> y("y");
+    auto expr = (x * y.sin() + (x ^ y)).exp() / (x - y).ln() + x.cos();
+    std::map<std::string, C> vars{{"x", C(0.5, 1.5)}, {"y", C(-2.0, 0.25)}};
+    EXPECT_EQ(expr.compile().evaluate(vars), expr.evaluate_tree(vars));
+}
+
+TEST(ProgramTest, SharedSubtreeComputedOnce) {
+    Expression<double> x("x");
+    auto square = x * x;
+    auto expr = square + square;
+    auto program = expr.compile();
+    EXPECT_EQ(program.instructions().size(), 3u);
+    EXPECT_DOUBLE_EQ(program.evaluate({{"x", 3.0}}), 18.0);
+}
+
+TEST(ProgramTest, RegisterCountStaysSmallForLongSums) {
+    std::string formula = "x";
+    for (int i = 0; i < 500; ++i) {
+        formula += " + x";
+    }
+    auto program = Expression<double>::Parse(formula).compile();
+    EXPECT_LE(program.registers(), 2u);
+    EXPECT_DOUBLE_EQ(program.evaluate({{"x", 2.0}}), 1002.0);
+}
+
+TEST(ProgramTest, MissingVariableThrows) {
+    auto program = Expression<double>::Parse("x + y").compile();
+    EXPECT_THROW(program.evaluate({{"x", 1.0}}), std::runtime_error);
+}
+
+TEST(ProgramTest, BindFollowsCallerOrder) {
+    auto expr = Expression<double>::Parse("x - 2 * y");
+    auto bound = expr.bind({"y", "z", "x"});
+    std::vector<double> values{3.0, 100.0, 10.0};
+    EXPECT_DOUBLE_EQ(bound.evaluate(std::span<const double>(values)), 4.0);
+    EXPECT_EQ(bound.variables(), (std::vector<std::string>{"y", "z", "x"}));
+}
+
+TEST(ProgramTest, BindReportsMissingVariable) {
+    auto expr = Expression<double>::Parse("x * sin(w)");
+    EXPECT_THROW(expr.bind({"x"}), std::runtime_error);
+}
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include <limits>
+#include "../../src/EXPRESSION.h"
+
+using namespace ExpressionLibrary;
+
+namespace {
+
+    std::string simplified(const std::string& formula) {
+        return Expression<double>::Parse(formula).simplify().ToString();
+    }
+
+}
+
+TEST(SimplifyTest, Identities) {
+    EXPECT_EQ(simplified("x + 0"), "x");
+    EXPECT_EQ(simplified("0 + x"), "x");
+    EXPECT_EQ(simplified("x - 0"), "x");
+    EXPECT_EQ(simplified("0 - x"), "(0 - x)");
+    EXPECT_EQ(simplified("x * 1"), "x");
+    EXPECT_EQ(simplified("1 * x"), "x");
+    EXPECT_EQ(simplified("x * 0"), "0");
+    EXPECT_EQ(simplified("x / 1"), "x");
+    EXPECT_EQ(simplified("x ^ 1"), "x");
+    EXPECT_EQ(simplified("x ^ 0"), "1");
+    EXPECT_EQ(simplified("-(-x)"), "x");
+    EXPECT_EQ(simplified("ln(exp(x))"), "x");
+}
+
+TEST(SimplifyTest, KeepsSignOfZero) {
+    auto expr = Expression<double>::Parse("1 / (0 - x)");
+    EXPECT_EQ(expr.simplify().evaluate({{"x", 0.0}}), expr.evaluate_tree({{"x", 0.0}}));
+    EXPECT_EQ(expr.simplify().evaluate({{"x", 0.0}}), std::numeric_limits<double>::infinity());
+    NodeFactory<double> f(true);
+    auto x = f.variable("x");
+    EXPECT_EQ(f.subtract(f.constant(-0.0), x), f.negate(x));
+    EXPECT_NE(f.subtract(f.constant(0.0), x), f.negate(x));
+}
+
+TEST(SimplifyTest, ConstantFolding) {
+    EXPECT_EQ(simplified("2 * 3 + x"), "(6 + x)");
+    EXPECT_EQ(simplified("x * (2 ^ 3 - 8)"), "0");
+    EXPECT_EQ(simplified("sin(0) + exp(0) * y"), "y");
+}
+
+TEST(SimplifyTest, CanonicalOperandOrder) {
+    EXPECT_EQ(simplified("x * 2"), "(2 * x)");
+    EXPECT_EQ(simplified("y + x"), "(x + y)");
+    EXPECT_EQ(Expression<double>::Parse("sin(y) * x").simplify().compile().instructions().size(),
+              Expression<double>::Parse("x * sin(y)").simplify().compile().instructions().size());
+    EXPECT_EQ(simplified("(y + x) - (x + y)"), "((x + y) - (x + y))");
+}
+
+TEST(SimplifyTest, DifferentiateSimplified) {
+    auto expr = Expression<double>::Parse("x + 2");
+    EXPECT_EQ(expr.differentiate("x").ToString(), "(1 + 0)");
+    EXPECT_EQ(expr.differentiate("x", true).ToString(), "1");
+    EXPECT_EQ(Expression<double>::Parse("x ^ 3").differentiate("x", true).ToString(), "(3 * (x ^ 2))");
+}
+
+TEST(SimplifyTest, PreservesValueAndShrinksDerivatives) {
+    auto expr = Expression<double>::Parse("x * sin(x * y) * exp(x / y) + ln(x * x + y) ^ 2 / cos(x)");
+    std::map<std::string, double> vars{{"x", 0.7}, {"y", 1.3}};
+    auto plain = expr.differentiate("x").differentiate("y");
+    auto reduced = expr.differentiate("x", true).differentiate("y", true);
+    EXPECT_NEAR(reduced.evaluate(vars), plain.evaluate(vars), 1e-12 * std::fabs(plain.evaluate(vars)));
+    EXPECT_LT(reduced.compile().instructions().size(), plain.compile().instructions().size());
+}
+
+TEST(SimplifyTest, Complex) {
+    using C = std::complex<double>;
+    Expression<C> z("z");
+    auto expr = (z * Expression<C>(C(1.0, 0.0)) + Expression<C>(C(0.0, 0.0))).ln().exp();
+    EXPECT_EQ(expr.simplify().ToString(), "exp(ln(z))");
+}
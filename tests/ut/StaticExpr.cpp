@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+#include "../../src/EXPRESSION.h"
+#include "../../src/STATICEXPR.h"
+
+using namespace ExpressionLibrary;
+
+namespace {
+
+    // Checks a static expression against the runtime parser: same printed
+    // tree, same value, and the same first derivative by every variable.
+    template <Static::FixedString Source>
+    void expectAgrees(const std::map<std::string, double>& vars) {
+        using E = static_expr<Source>;
+        std::string text(Source.view());
+        auto dynamic = Expression<double>::Parse(text);
+        EXPECT_EQ(E::to_string(), dynamic.ToString()) << text;
+        EXPECT_EQ(E::evaluate(vars), dynamic.evaluate(vars)) << text;
+
+        using Dx = typename E::template derivative<"x">;
+        auto dx = dynamic.differentiate("x");
+        EXPECT_EQ(Dx::to_string(), dx.ToString()) << text;
+        EXPECT_EQ(Dx::evaluate(vars), dx.evaluate(vars)) << text;
+    }
+
+}
+
+TEST(StaticExprTest, VariablesInOrderOfAppearance) {
+    using E = static_expr<"y * sin(x) + y ^ z">;
+    static_assert(E::variables.size() == 3);
+    static_assert(E::variables[0] == "y" && E::variables[1] == "x" && E::variables[2] == "z");
+    EXPECT_EQ(E{}(2.0, 0.0, 3.0), 8.0);
+}
+
+TEST(StaticExprTest, EvaluatesAtCompileTime) {
+    using E = static_expr<"(x + 1) * (x - 1) / -y">;
+    static_assert(E{}(3.0, 2.0) == -4.0);
+    static_assert(static_expr<"0.1 * 3">{}() == 0.1 * 3);
+    static_assert(static_expr<"--2 * -x - 1">{}(3.0) == -7.0);
+    constexpr double values[] = {4.0};
+    static_assert(static_expr<"x * x">::evaluate<double>(values) == 16.0);
+}
+
+TEST(StaticExprTest, NumbersMatchRuntimeParser) {
+    const std::map<std::string, double> none;
+    EXPECT_EQ(static_expr<"0.1">::evaluate(none), Expression<double>::Parse("0.1").evaluate(none));
+    EXPECT_EQ(static_expr<"3.14159265358979">::evaluate(none), Expression<double>::Parse("3.14159265358979").evaluate(none));
+    EXPECT_EQ(static_expr<"1000000000000000000000">::evaluate(none), 1e21);
+    EXPECT_EQ(static_expr<"0.000123">::evaluate(none), 0.000123);
+    EXPECT_EQ(static_expr<"10.50">::evaluate(none), 10.5);
+    EXPECT_EQ(static_expr<"1.">::evaluate(none), 1.0);
+    EXPECT_EQ(static_expr<".25">::evaluate(none), 0.25);
+    EXPECT_EQ(static_expr<"--2 ^ 3 ^ 2">{}(), 512.0);
+}
+
+TEST(StaticExprTest, AgreesWithRuntimePath) {
+    std::map<std::string, double> vars{{"x", 0.7}, {"y", -1.3}, {"z", 2.0}};
+    expectAgrees<"x * sin(x) + y">(vars);
+    expectAgrees<"(x + y) * (x - y) / (x ^ 2 + 1)">(vars);
+    expectAgrees<"exp(-x) * cos(y ^ 3) - ln(x + z)">(vars);
+    expectAgrees<"-(-x) ^ 2 ^ 0.5">(vars);
+    expectAgrees<"2 + 3 * 4 - 5 / 6 * x">(vars);
+    expectAgrees<"-sin(x) ^ -z / --y * 2 ^ -x">(vars);
+    expectAgrees<"ln(exp(x * y)) * (z - x) ^ x">(vars);
+    expectAgrees<"x ^ (1 + 1) * (z - x) ^ 3">(vars);
+    expectAgrees<"x y trailing input is ignored">(vars);
+}
+
+TEST(StaticExprTest, HigherAndForeignDerivatives) {
+    using E = static_expr<"x * sin(x * y) + y ^ 3">;
+    using Dxy = E::derivative<"x">::derivative<"y">;
+    auto dynamic = Expression<double>::Parse("x * sin(x * y) + y ^ 3").differentiate("x").differentiate("y");
+    std::map<std::string, double> vars{{"x", 0.4}, {"y", 1.7}};
+    EXPECT_EQ(Dxy::to_string(), dynamic.ToString());
+    EXPECT_EQ(Dxy::evaluate(vars), dynamic.evaluate(vars));
+    EXPECT_EQ(E::derivative<"w">{}(0.4, 1.7), 0.0);
+}
+
+TEST(StaticExprTest, Complex) {
+    using C = std::complex<double>;
+    using E = static_expr<"sin(z * w) + exp(z) / w">;
+    std::map<std::string, C> vars{{"z", C(0.5, 1.0)}, {"w", C(-2.0, 0.25)}};
+    Expression<C> z("z");
+    Expression<C> w("w");
+    auto dynamic = (z * w).sin() + z.exp() / w;
+    EXPECT_EQ(E::evaluate(vars), dynamic.evaluate(vars));
+    EXPECT_EQ(E::derivative<"z">::evaluate(vars), dynamic.differentiate("z").evaluate(vars));
+    EXPECT_THROW(E::evaluate(std::map<std::string, C>{{"z", C(1.0)}}), std::runtime_error);
+}
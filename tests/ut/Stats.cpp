@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <limits>
+#include "../../src/EXPRESSION.h"
+
+using namespace ExpressionLibrary;
+
+TEST(StatsTest, CountsTreeAndDistinctNodes) {
+    auto sinX = [] { return Expression<double>("x").sin(); };
+    auto expr = sinX() * sinX() + Expression<double>(2.0) * Expression<double>("y");
+    auto stats = expr.stats();
+    EXPECT_EQ(stats.nodes, 9u);
+    EXPECT_EQ(stats.uniqueNodes, 7u);
+    EXPECT_EQ(stats.depth, 4u);
+    EXPECT_EQ(stats.variables, (std::set<std::string>{"x", "y"}));
+
+    // Interning shares the copies of sin(x): same shape, fewer objects.
+    auto shared = expr.intern().stats();
+    EXPECT_EQ(shared.nodes, stats.nodes);
+    EXPECT_EQ(shared.uniqueNodes, stats.uniqueNodes);
+    EXPECT_EQ(shared.depth, stats.depth);
+    EXPECT_LT(shared.bytes, stats.bytes);
+    EXPECT_GT(shared.bytes, 0u);
+
+    auto leaf = Expression<double>(0.0).stats();
+    EXPECT_EQ(leaf.nodes, 1u);
+    EXPECT_EQ(leaf.depth, 1u);
+    EXPECT_TRUE(leaf.variables.empty());
+    EXPECT_EQ((Expression<double>(0.0) + Expression<double>(-0.0)).stats().uniqueNodes, 3u);
+}
+
+TEST(StatsTest, TreeCountSaturates) {
+    auto expr = Expression<double>::Parse("x");
+    for (int i = 0; i < 70; ++i) {
+        expr = expr * expr;
+    }
+    auto stats = expr.stats();
+    EXPECT_EQ(stats.nodes, std::numeric_limits<std::uint64_t>::max());
+    EXPECT_EQ(stats.uniqueNodes, 71u);
+    EXPECT_EQ(stats.depth, 71u);
+}
+
+TEST(StatsTest, DifferentiateAndSubstituteEnforceLimits) {
+    auto expr = Expression<double>::Parse("sin(x * y) * exp(x) + x ^ 3");
+    std::map<std::string, double> vars{{"x", 0.3}, {"y", 1.7}};
+    auto derivative = expr.differentiate("x");
+    auto stats = derivative.stats();
+
+    NodeLimits limits;
+    limits.maxNodes = stats.uniqueNodes * 4;
+    limits.maxDepth = stats.depth;
+    EXPECT_EQ(expr.differentiate("x", false, limits).evaluate(vars), derivative.evaluate(vars));
+    limits.maxDepth = stats.depth - 1;
+    EXPECT_THROW(expr.differentiate("x", false, limits), std::runtime_error);
+    limits = NodeLimits{};
+    limits.maxNodes = 5;
+    EXPECT_THROW(expr.differentiate("x", false, limits), std::runtime_error);
+
+    // Repeated differentiation adds more nodes each time until the guard trips.
+    limits.maxNodes = 500;
+    auto d = expr;
+    EXPECT_THROW(for (int i = 0; i < 20; ++i) d = d.differentiate("x", false, limits), std::runtime_error);
+
+    limits = NodeLimits{};
+    limits.maxNodes = 1;
+    EXPECT_EQ(expr.substitute("z", 1.0, limits).ToString(), expr.ToString());
+    EXPECT_THROW(expr.substitute("x", 1.0, limits), std::runtime_error);
+    limits.maxNodes = 100;
+    EXPECT_EQ(expr.substitute("x", 0.3, limits).evaluate(vars), expr.evaluate(vars));
+}
+
+TEST(StatsTest, DifferentiateLimitExcludesInput) {
+    // A tree of 200 distinct y terms, rebuilt by simplify, and a derivative
+    // in x of a handful of nodes.
+    Expression<double> expr = Expression<double>("x").sin();
+    for (int i = 0; i < 100; ++i) {
+        expr = expr + Expression<double>("y") * Expression<double>(double(i + 2));
+    }
+    ASSERT_GT(expr.simplify().stats().uniqueNodes, 200u);
+
+    NodeLimits limits;
+    limits.maxNodes = 10;
+    auto derivative = expr.differentiate("x", true, limits);
+    EXPECT_EQ(derivative.ToString(), "cos(x)");
+    EXPECT_LE(derivative.stats().uniqueNodes, limits.maxNodes);
+}
+
+TEST(StatsTest, DefaultLimitsRefuseDeepInputs) {
+    // Built with operators, so no limit applies while building.
+    auto deep = Expression<double>("x");
+    for (std::size_t i = 0; i < 2 * NodeLimits::DefaultMaxDepth; ++i) {
+        deep = deep.sin();
+    }
+    EXPECT_THROW(deep.differentiate("x"), std::runtime_error);
+    EXPECT_THROW(deep.substitute("x", 1.0), std::runtime_error);
+
+    auto shallow = Expression<double>("x");
+    for (std::size_t i = 0; i + 1 < NodeLimits::DefaultMaxDepth; ++i) {
+        shallow = shallow.sin();
+    }
+    EXPECT_EQ(shallow.substitute("x", 0.0).evaluate_tree({}), 0.0);
+    NodeLimits unlimited;
+    unlimited.maxDepth = std::numeric_limits<std::size_t>::max();
+    EXPECT_NO_THROW(shallow.differentiate("x", false, unlimited));
+}
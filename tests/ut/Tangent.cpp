@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+#include "../../src/EXPRESSION.h"
+
+using namespace ExpressionLibrary;
+
+TEST(TangentTest, MatchesSymbolicDerivative) {
+    auto expr = Expression<double>::Parse("x * sin(x * y) * exp(x / y) + ln(x * x + y) ^ 2 / cos(x) - -y");
+    std::map<std::string, double> vars{{"x", 0.7}, {"y", 1.3}};
+    auto [value, dx] = expr.evaluate_with_tangent(vars, {{"x", 1.0}});
+    EXPECT_DOUBLE_EQ(value, expr.evaluate_tree(vars));
+    double expected = expr.differentiate("x").evaluate_tree(vars);
+    EXPECT_NEAR(dx, expected, 1e-12 * std::fabs(expected));
+}
+
+TEST(TangentTest, SeveralDirectionsAtOnce) {
+    auto program = Expression<double>::Parse("x ^ y + x * y").bind({"x", "y"});
+    std::vector<double> values{2.0, 3.0};
+    std::vector<double> directions{1.0, 0.0,
+                                   0.0, 1.0,
+                                   0.5, 2.0};
+    std::vector<double> tangents(3);
+    double value = program.evaluate_with_tangents(values, directions, tangents);
+    double dx = 3.0 * 4.0 + 3.0;
+    double dy = 8.0 * std::log(2.0) + 2.0;
+    EXPECT_DOUBLE_EQ(value, 14.0);
+    EXPECT_DOUBLE_EQ(tangents[0], dx);
+    EXPECT_DOUBLE_EQ(tangents[1], dy);
+    EXPECT_NEAR(tangents[2], 0.5 * dx + 2.0 * dy, 1e-12);
+}
+
+TEST(TangentTest, ResultRegisterReusesExponent) {
+    std::map<std::string, double> vars{{"x", 2.0}, {"y", 3.0}};
+    for (auto [formula, dy] : {std::pair{"x ^ y + x", 8.0 * std::log(2.0)},
+                               std::pair{"x ^ (2 * y) + x", 128.0 * std::log(2.0)}}) {
+        auto expr = Expression<double>::Parse(formula);
+        EXPECT_NEAR(expr.evaluate_with_tangent(vars, {{"y", 1.0}}).second, dy, 1e-12 * std::fabs(dy)) << formula;
+        EXPECT_NEAR(expr.evaluate_with_gradient(vars).second["y"], dy, 1e-12 * std::fabs(dy)) << formula;
+    }
+}
+
+TEST(TangentTest, ConstantExponentOfNegativeBase) {
+    auto [value, derivative] = Expression<double>::Parse("x ^ 3").evaluate_with_tangent({{"x", -2.0}}, {{"x", 1.0}});
+    EXPECT_DOUBLE_EQ(value, -8.0);
+    EXPECT_DOUBLE_EQ(derivative, 12.0);
+}
+
+TEST(TangentTest, Complex) {
+    using C = std::complex<double>;
+    Expression<C> z("z");
+    auto expr = z.sin() * z.exp() / (z + Expression<C>(C(2.0, 0.0)));
+    std::map<std::string, C> vars{{"z", C(0.3, -0.8)}};
+    auto [value, derivative] = expr.evaluate_with_tangent(vars, {{"z", C(1.0, 0.0)}});
+    EXPECT_EQ(value, expr.evaluate_tree(vars));
+    EXPECT_NEAR(std::abs(derivative - expr.differentiate("z").evaluate_tree(vars)), 0.0, 1e-12);
+}